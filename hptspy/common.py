@@ -14,6 +14,7 @@ if TYPE_CHECKING:
 
 # Bring names into current scope
 ObservationShape = _common.ObservationShape
+PackedObservation = _common.PackedObservation
 
 
 def load_problems(
@@ -13,9 +13,13 @@
 #include <spdlog/spdlog.h>
 // NOLINTEND
 
+#include <chrono>
+#include <future>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "algorithm/interleaved_scheduler.h"
 #include "algorithm/yieldable.h"
 #include "env/simple_env.h"
 #include "model/heuristic_convnet/heuristic_convnet_wrapper.h"    // For inference input/output types
@@ -23,6 +27,7 @@
 #include "util/block_allocator.h"
 #include "util/concepts.h"
 #include "util/priority_set.h"
+#include "util/shared_budget.h"
 #include "util/utility.h"
 #include "util/zip.h"
 
@@ -30,6 +35,7 @@ namespace hpts::algorithm::astar {
 
 constexpr double WEIGHT = 1.0;
 static std::size_t INFERENCE_BATCH_SIZE = 1;    // NOLINT (*-non-const-global-variables)
+static bool ASYNC_INFERENCE = false;            // NOLINT (*-non-const-global-variables)
 
 // All states must satisfy constraints
 template <typename T>
@@ -47,6 +53,7 @@ struct SearchInputModel {
     int search_budget = {};
     std::shared_ptr<StopToken> stop_token;
     std::shared_ptr<AStarEvaluatorT> model_eval;
+    std::shared_ptr<SharedBudget> shared_budget = nullptr;    // Joint budget with other searches if set
 };
 template <AStarEnv EnvT>
 struct SearchInputNoModel {
@@ -54,6 +61,7 @@ struct SearchInputNoModel {
     EnvT state;
     int search_budget = {};
     std::shared_ptr<StopToken> stop_token;
+    std::shared_ptr<SharedBudget> shared_budget = nullptr;    // Joint budget with other searches if set
 };
 
 // Search algorithm output
@@ -67,7 +75,7 @@ struct SearchOutput {
     double solution_prob = 1;
     double solution_log_prob = 0;
     std::vector<EnvT> solution_path_states{};
-    std::vector<Observation> solution_path_observations{};
+    std::vector<PackedObservation> solution_path_observations{};
     std::vector<int> solution_path_actions{};
     std::vector<double> solution_path_costs{};
 };
@@ -140,13 +148,22 @@ class YieldableAStarModel {
     using NodeT = detail::Node<EnvT>;
     using InferenceInputT = AStarEvaluatorT::InferenceInput;
     using InferenceOutputT = AStarEvaluatorT::InferenceOutput;
+    using InferenceFutureT = std::future<std::vector<InferenceOutputT>>;
     using OpenListT =
         PrioritySet<NodeT, typename NodeT::CompareOrderedLess, typename NodeT::Hasher, typename NodeT::CompareEqual>;
     using ClosedListT = absl::flat_hash_set<std::unique_ptr<NodeT>, typename NodeT::Hasher, typename NodeT::CompareEqual>;
 
 public:
+    // Expose inference types for schedulers which run inference on behalf of the search
+    using InferenceInput = InferenceInputT;
+    using InferenceOutput = InferenceOutputT;
+
     YieldableAStarModel(const SearchInputModel<EnvT, AStarEvaluatorT> &input)
-        : input(input), status(Status::INIT), model(input.model_eval) {
+        : input(input),
+          status(Status::INIT),
+          model(input.model_eval),
+          inference_batch_size(INFERENCE_BATCH_SIZE),
+          async_inference(ASYNC_INFERENCE) {
         reset();
     }
 
@@ -160,7 +177,7 @@ public:
             NodeT root_node(input.state);
             inference_inputs.emplace_back(root_node.state.get_observation());
             inference_nodes.push_back(root_node);
-            batch_predict();
+            request_inference();
         }
         SPDLOG_DEBUG("Initializing open: ");
         status = Status::OK;
@@ -168,15 +185,30 @@ public:
 
     void reset() {
         status = Status::INIT;
+        awaiting_inference = false;
         timeout = false;
         search_output = SearchOutput<EnvT>{.puzzle_name = input.puzzle_name};
         inference_nodes.clear();
         inference_inputs.clear();
+        inflight_nodes.clear();
+        inflight_predictions = {};
         open.clear();
         closed.clear();
     }
 
     void step() {
+        if (awaiting_inference) {
+            SPDLOG_ERROR("Inference outputs need to be set before calling step()");
+            throw std::logic_error("Inference outputs need to be set before calling step()");
+        }
+        // Fold in async predictions, only blocking if there is nothing else to expand
+        if (async_inference && !defer_inference) {
+            poll_inference(open.empty());
+            if (open.empty() && !inference_inputs.empty()) {
+                submit_inference();
+                poll_inference(true);
+            }
+        }
         if (open.empty()) {
             status = Status::ERROR;
             SPDLOG_ERROR("Exhausted open list - name: {:s}, budget: {:d}.", input.puzzle_name, input.search_budget);
@@ -202,8 +234,9 @@ public:
             return;
         }
 
-        // Timeout
-        if (input.search_budget >= 0 && search_output.num_expanded >= input.search_budget) {
+        // Timeout, either on our own budget or the one jointly charged with other searches
+        if ((input.search_budget >= 0 && search_output.num_expanded >= input.search_budget) ||
+            (input.shared_budget && !input.shared_budget->charge())) {
             timeout = true;
             SPDLOG_INFO("Buget timeout - name: {:s}, exp: {:d}, gen: {:d}, budget: {:d}", input.puzzle_name,
                         search_output.num_expanded, search_output.num_generated, input.search_budget);
@@ -228,8 +261,8 @@ public:
         SPDLOG_DEBUG("Open size: {:d}, Inference batched size: {:d}", open.size(), inference_inputs.size());
 
         // Batch inference
-        if (open.empty() || inference_inputs.size() >= INFERENCE_BATCH_SIZE) {
-            batch_predict();
+        if (open.empty() || inference_inputs.size() >= inference_batch_size) {
+            request_inference();
         }
     }
 
@@ -241,6 +274,28 @@ public:
         return search_output;
     }
 
+    /**
+     * Defer inference to the caller instead of querying the model directly.
+     * Once is_awaiting_inference() is set, the caller takes the queued inputs and must set the outputs before the
+     * next call to step().
+     */
+    void set_defer_inference(bool defer) {
+        defer_inference = defer;
+    }
+
+    [[nodiscard]] bool is_awaiting_inference() const {
+        return awaiting_inference;
+    }
+
+    [[nodiscard]] auto take_inference_inputs() -> std::vector<InferenceInputT> {
+        return std::exchange(inference_inputs, {});
+    }
+
+    void set_inference_outputs(std::vector<InferenceOutputT> &&predictions) {
+        process_predictions(inference_nodes, predictions);
+        awaiting_inference = false;
+    }
+
     EnvT get_open_state(std::size_t index = 0) {
         if (index >= open.size()) {
             throw std::invalid_argument("Index out of bounds");
@@ -253,17 +308,57 @@ public:
     }
 
 private:
+    // Run inference on the queued nodes, or flag that the caller needs to run it for us
+    void request_inference() {
+        if (defer_inference) {
+            awaiting_inference = true;
+        } else if (async_inference) {
+            // Only a single batch is in flight, otherwise keep queueing until it returns
+            poll_inference(false);
+            if (!inflight_predictions.valid()) {
+                submit_inference();
+            }
+        } else {
+            batch_predict();
+        }
+    }
+
+    // Batch predict inference
     void batch_predict() {
         SPDLOG_DEBUG("Running inference.");
         std::vector<InferenceOutputT> predictions = model->Inference(inference_inputs);
-        for (auto &&[child_node, prediction] : zip(inference_nodes, predictions)) {
+        process_predictions(inference_nodes, predictions);
+        inference_inputs.clear();
+    }
+
+    // Send the queued nodes off for inference without waiting on the result
+    void submit_inference() {
+        SPDLOG_DEBUG("Submitting async inference.");
+        std::swap(inflight_nodes, inference_nodes);
+        inflight_predictions = model->InferenceAsync(std::exchange(inference_inputs, {}));
+    }
+
+    // Fold in the outstanding async predictions if they are ready, or block until they are if wait is set
+    void poll_inference(bool wait) {
+        if (!inflight_predictions.valid()) {
+            return;
+        }
+        if (!wait && inflight_predictions.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
+        std::vector<InferenceOutputT> predictions = inflight_predictions.get();
+        process_predictions(inflight_nodes, predictions);
+    }
+
+    // Set the network outputs on the queued nodes and move them into open
+    void process_predictions(std::vector<NodeT> &nodes, std::vector<InferenceOutputT> &predictions) {
+        for (auto &&[child_node, prediction] : zip(nodes, predictions)) {
             child_node.h = prediction.heuristic;
             child_node.cost = child_node.g + child_node.h;
             open.push(std::move(child_node));
             ++search_output.num_generated;
         }
-        inference_inputs.clear();
-        inference_nodes.clear();
+        nodes.clear();
     }
 
     void set_solution_trajectory(const NodeT &node) {
@@ -287,11 +382,17 @@ private:
     Status status{};
     bool timeout = false;
     std::shared_ptr<AStarEvaluatorT> model;
+    std::size_t inference_batch_size;
     SearchOutput<EnvT> search_output;
     std::vector<NodeT> inference_nodes;
     std::vector<InferenceInputT> inference_inputs;
     OpenListT open;
     ClosedListT closed;
+    bool defer_inference = false;
+    bool awaiting_inference = false;
+    bool async_inference;
+    std::vector<NodeT> inflight_nodes;
+    InferenceFutureT inflight_predictions;
 };
 
 template <AStarEnv EnvT>
@@ -357,8 +458,9 @@ public:
             return;
         }
 
-        // Timeout
-        if (input.search_budget >= 0 && search_output.num_expanded >= input.search_budget) {
+        // Timeout, either on our own budget or the one jointly charged with other searches
+        if ((input.search_budget >= 0 && search_output.num_expanded >= input.search_budget) ||
+            (input.shared_budget && !input.shared_budget->charge())) {
             timeout = true;
             SPDLOG_INFO("Buget timeout - name: {:s}, exp: {:d}, gen: {:d}, budget: {:d}", input.puzzle_name,
                         search_output.num_expanded, search_output.num_generated, input.search_budget);
@@ -457,6 +559,8 @@ private:
 template <AStarEnv EnvT, model::IsModelEvaluator AStarEvaluatorT>
     requires IsTypeAmongVariant<AStarEvaluatorT, AStarHeuristicNetEvaluator>
 auto search(const SearchInputModel<EnvT, AStarEvaluatorT> &input) -> SearchOutput<EnvT> {
+    // Lets the evaluator dispatch batches early once all active searchers are waiting on inference
+    const model::ActiveSearcherGuard searcher_guard(input.model_eval);
     YieldableAStarModel<EnvT, AStarEvaluatorT> step_phs(input);
     step_phs.init();
     while (step_phs.get_status() == Status::OK && !input.stop_token->stop_requested()) {
@@ -464,6 +568,12 @@ auto search(const SearchInputModel<EnvT, AStarEvaluatorT> &input) -> SearchOutpu
     }
     return step_phs.get_search_output();
 }
+// Run all searches on the calling thread, sharing inference batches between them
+template <AStarEnv EnvT, model::IsModelEvaluator AStarEvaluatorT>
+    requires IsTypeAmongVariant<AStarEvaluatorT, AStarHeuristicNetEvaluator>
+auto search_interleaved(const std::vector<SearchInputModel<EnvT, AStarEvaluatorT>> &inputs) -> std::vector<SearchOutput<EnvT>> {
+    return run_interleaved<YieldableAStarModel<EnvT, AStarEvaluatorT>, SearchOutput<EnvT>>(inputs);
+}
 template <AStarEnv EnvT>
 auto search(const SearchInputNoModel<EnvT> &input) -> SearchOutput<EnvT> {
     YieldableAStarNoModel<EnvT> step_phs(input);
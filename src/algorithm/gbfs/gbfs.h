@@ -0,0 +1,565 @@
+// File: gbfs.h
+// Description: Greedy best-first search implementation
+
+#ifndef HPTS_ALGORITHM_GBFS_H_
+#define HPTS_ALGORITHM_GBFS_H_
+
+#include <absl/container/flat_hash_set.h>
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Set logging library macro level to remove debug logging out at compile time
+// NOLINTBEGIN
+#ifdef DEBUG_PRINT
+#define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_DEBUG
+#else
+#define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_INFO
+#endif
+#include <spdlog/spdlog.h>
+// NOLINTEND
+
+#include "algorithm/interleaved_scheduler.h"
+#include "algorithm/yieldable.h"
+#include "common/observation.h"
+#include "env/simple_env.h"
+#include "model/heuristic_convnet/heuristic_convnet_wrapper.h"    // For inference input/output types
+#include "model/model_evaluator.h"
+#include "model/twoheaded_convnet/twoheaded_convnet_wrapper.h"    // For inference input/output types
+#include "util/concepts.h"
+#include "util/priority_set.h"
+#include "util/shared_budget.h"
+#include "util/utility.h"
+#include "util/zip.h"
+
+namespace hpts::algorithm::gbfs {
+
+static std::size_t INFERENCE_BATCH_SIZE = 1;    // NOLINT (*-non-const-global-variables)
+static bool ASYNC_INFERENCE = false;            // NOLINT (*-non-const-global-variables)
+
+// All states must satisfy constraints
+template <typename T>
+concept GBFSEnv = env::SimpleEnv<T>;
+
+// Model types we can work with, anything with a heuristic head
+using GBFSHeuristicNetEvaluator = std::variant<model::ModelEvaluator<model::wrapper::HeuristicConvNetWrapperMSE>,
+                                               model::ModelEvaluator<model::wrapper::TwoHeadedConvNetWrapperLevin>,
+                                               model::ModelEvaluator<model::wrapper::TwoHeadedConvNetWrapperPolicyGradient>,
+                                               model::ModelEvaluator<model::wrapper::TwoHeadedConvNetWrapperPHS>>;
+
+// Input to GBFS search algorithm
+template <GBFSEnv EnvT, model::IsModelEvaluator GBFSEvaluatorT>
+    requires IsTypeAmongVariant<GBFSEvaluatorT, GBFSHeuristicNetEvaluator>
+struct SearchInputModel {
+    std::string puzzle_name;
+    EnvT state;
+    int search_budget = {};
+    std::shared_ptr<StopToken> stop_token;
+    std::shared_ptr<GBFSEvaluatorT> model_eval;
+    std::shared_ptr<SharedBudget> shared_budget = nullptr;    // Joint budget with other searches if set
+};
+template <GBFSEnv EnvT>
+struct SearchInputNoModel {
+    std::string puzzle_name;
+    EnvT state;
+    int search_budget = {};
+    std::shared_ptr<StopToken> stop_token;
+    std::shared_ptr<SharedBudget> shared_budget = nullptr;    // Joint budget with other searches if set
+};
+
+// Search algorithm output
+template <GBFSEnv EnvT>
+struct SearchOutput {
+    std::string puzzle_name;
+    bool solution_found = false;
+    double solution_cost = -1;
+    int num_expanded = 0;
+    int num_generated = 0;
+    double solution_prob = 1;
+    double solution_log_prob = 0;
+    std::vector<EnvT> solution_path_states{};
+    std::vector<PackedObservation> solution_path_observations{};
+    std::vector<int> solution_path_actions{};
+    std::vector<double> solution_path_costs{};
+};
+
+namespace detail {
+// Node used in search
+template <GBFSEnv EnvT>
+struct Node {
+    Node() = delete;
+    Node(const EnvT &state) : state(state) {}
+
+    void apply_action(Node<EnvT> &current, double cost, int a) {
+        state.apply_action(a);
+        g = current.g + cost;
+        action = a;
+    }
+
+    struct Hasher {
+        using is_transparent = void;
+        std::size_t operator()(const Node &node) const {
+            return node.state.get_hash();
+        }
+        std::size_t operator()(const std::unique_ptr<Node> &node) const {
+            return node->state.get_hash();
+        }
+    };
+    struct CompareEqual {
+        using is_transparent = void;
+        bool operator()(const Node &lhs, const Node &rhs) const {
+            return lhs.state == rhs.state;
+        }
+        bool operator()(const std::unique_ptr<Node> &lhs, const std::unique_ptr<Node> &rhs) const {
+            return lhs->state == rhs->state;
+        }
+        bool operator()(const std::unique_ptr<Node> &lhs, const Node &rhs) const {
+            return lhs->state == rhs.state;
+        }
+        bool operator()(const Node &lhs, const std::unique_ptr<Node> &rhs) const {
+            return lhs.state == rhs->state;
+        }
+    };
+    // Ordered purely on h, ties broken towards deeper nodes
+    struct CompareOrderedLess {
+        bool operator()(const Node &lhs, const Node &rhs) const {
+            return lhs.h < rhs.h || (lhs.h == rhs.h && lhs.g > rhs.g);
+        }
+    };
+    struct CompareOrderedGreater {
+        bool operator()(const Node &lhs, const Node &rhs) const {
+            return lhs.h > rhs.h;
+        }
+    };
+
+    // NOLINTBEGIN (misc-non-private-member-variables-in-classes)
+    EnvT state;
+    double g = 0;
+    double h = 0;
+    Node *parent = nullptr;
+    int action = -1;
+    // NOLINTEND (misc-non-private-member-variables-in-classes)
+};
+}    // namespace detail
+
+template <GBFSEnv EnvT, model::IsModelEvaluator GBFSEvaluatorT>
+    requires IsTypeAmongVariant<GBFSEvaluatorT, GBFSHeuristicNetEvaluator> &&
+             HasHeuristic<typename GBFSEvaluatorT::InferenceOutput>
+class YieldableGBFSModel {
+    using NodeT = detail::Node<EnvT>;
+    using InferenceInputT = GBFSEvaluatorT::InferenceInput;
+    using InferenceOutputT = GBFSEvaluatorT::InferenceOutput;
+    using InferenceFutureT = std::future<std::vector<InferenceOutputT>>;
+    using OpenListT =
+        PrioritySet<NodeT, typename NodeT::CompareOrderedLess, typename NodeT::Hasher, typename NodeT::CompareEqual>;
+    using ClosedListT = absl::flat_hash_set<std::unique_ptr<NodeT>, typename NodeT::Hasher, typename NodeT::CompareEqual>;
+
+public:
+    // Expose inference types for schedulers which run inference on behalf of the search
+    using InferenceInput = InferenceInputT;
+    using InferenceOutput = InferenceOutputT;
+
+    YieldableGBFSModel(const SearchInputModel<EnvT, GBFSEvaluatorT> &input)
+        : input(input),
+          status(Status::INIT),
+          model(input.model_eval),
+          inference_batch_size(INFERENCE_BATCH_SIZE),
+          async_inference(ASYNC_INFERENCE) {
+        reset();
+    }
+
+    // Initialize the search with root node inference output
+    void init() {
+        SPDLOG_DEBUG("Initializing GBFS: budget: {:d}", input.search_budget);
+        if (status != Status::INIT) {
+            SPDLOG_ERROR("Coroutine needs to be reset() before calling init()");
+            throw std::logic_error("Coroutine needs to be reset() before calling init()");
+        }
+        NodeT root_node(input.state);
+        // Children are goal tested on generation, so the root needs to be checked here
+        if (root_node.state.is_solution()) {
+            set_solution_trajectory(root_node);
+            status = Status::SOLVED;
+            return;
+        }
+        inference_inputs.push_back(make_inference_input(root_node.state.get_observation()));
+        inference_nodes.push_back(std::move(root_node));
+        request_inference();
+        SPDLOG_DEBUG("Initializing open: ");
+        status = Status::OK;
+    }
+
+    void reset() {
+        status = Status::INIT;
+        awaiting_inference = false;
+        timeout = false;
+        search_output = SearchOutput<EnvT>{.puzzle_name = input.puzzle_name};
+        inference_nodes.clear();
+        inference_inputs.clear();
+        inflight_nodes.clear();
+        inflight_predictions = {};
+        open.clear();
+        closed.clear();
+    }
+
+    // Single step of the search algorithm
+    void step() {
+        if (awaiting_inference) {
+            SPDLOG_ERROR("Inference outputs need to be set before calling step()");
+            throw std::logic_error("Inference outputs need to be set before calling step()");
+        }
+        // Fold in async predictions, only blocking if there is nothing else to expand
+        if (async_inference && !defer_inference) {
+            poll_inference(open.empty());
+            if (open.empty() && !inference_inputs.empty()) {
+                submit_inference();
+                poll_inference(true);
+            }
+        }
+        if (open.empty()) {
+            status = Status::ERROR;
+            SPDLOG_ERROR("Exhausted open list - name: {:s}, budget: {:d}.", input.puzzle_name, input.search_budget);
+            return;
+        }
+
+        // Remove top node from open and put into closed
+        auto current_u_ptr = std::make_unique<NodeT>(*open.pop_and_move());
+        auto &current = static_cast<NodeT &>(*current_u_ptr);
+        const auto current_ptr = current_u_ptr.get();
+        closed.insert(std::move(current_u_ptr));
+        ++search_output.num_expanded;
+
+        SPDLOG_DEBUG("-------------------------------------");
+        SPDLOG_DEBUG("Expanding: {:d}, g: {:.2f}, h: {:.2f}", search_output.num_expanded, current.g, current.h);
+        SPDLOG_DEBUG("\n{:s}", current.state.to_str());
+
+        // Timeout, either on our own budget or the one jointly charged with other searches
+        if ((input.search_budget >= 0 && search_output.num_expanded >= input.search_budget) ||
+            (input.shared_budget && !input.shared_budget->charge())) {
+            timeout = true;
+            SPDLOG_INFO("Buget timeout - name: {:s}, exp: {:d}, gen: {:d}, budget: {:d}", input.puzzle_name,
+                        search_output.num_expanded, search_output.num_generated, input.search_budget);
+            status = Status::TIMEOUT;
+            return;
+        }
+
+        // Consider all children
+        for (const auto &a : current.state.child_actions()) {
+            NodeT child_node = current;
+            child_node.parent = current_ptr;
+            child_node.apply_action(current, 1, a);
+            SPDLOG_DEBUG("Generating: {:d}, g: {:.2f}", a, child_node.g);
+            SPDLOG_DEBUG("\n{:s}", child_node.state.to_str());
+
+            // Solution found, no optimality guarantees so we return on generation instead of expansion
+            if (child_node.state.is_solution()) {
+                SPDLOG_INFO("Solved - name: {:s}, exp: {:d}, gen: {:d}, budget: {:d}, c: {:.0f}", input.puzzle_name,
+                            search_output.num_expanded, search_output.num_generated, input.search_budget, child_node.g);
+                set_solution_trajectory(child_node);
+                status = Status::SOLVED;
+                return;
+            }
+
+            // If new state, add to queue for inference
+            if (closed.find(child_node) == closed.end() && !open.contains(child_node)) {
+                inference_inputs.push_back(make_inference_input(child_node.state.get_observation()));
+                inference_nodes.push_back(std::move(child_node));
+            }
+        }
+
+        SPDLOG_DEBUG("Open size: {:d}, Inference batched size: {:d}", open.size(), inference_inputs.size());
+
+        // Batch inference
+        if (open.empty() || inference_inputs.size() >= inference_batch_size) {
+            request_inference();
+        }
+    }
+
+    [[nodiscard]] Status get_status() const {
+        return status;
+    }
+
+    [[nodiscard]] SearchOutput<EnvT> get_search_output() const {
+        return search_output;
+    }
+
+    /**
+     * Defer inference to the caller instead of querying the model directly.
+     * Once is_awaiting_inference() is set, the caller takes the queued inputs and must set the outputs before the
+     * next call to step().
+     */
+    void set_defer_inference(bool defer) {
+        defer_inference = defer;
+    }
+
+    [[nodiscard]] bool is_awaiting_inference() const {
+        return awaiting_inference;
+    }
+
+    [[nodiscard]] auto take_inference_inputs() -> std::vector<InferenceInputT> {
+        return std::exchange(inference_inputs, {});
+    }
+
+    void set_inference_outputs(std::vector<InferenceOutputT> &&predictions) {
+        process_predictions(inference_nodes, predictions);
+        awaiting_inference = false;
+    }
+
+private:
+    // Only the heuristic is needed, so two-headed networks skip their policy head
+    [[nodiscard]] static auto make_inference_input(Observation &&observation) -> InferenceInputT {
+        if constexpr (HasHeadMask<InferenceInputT>) {
+            return {std::move(observation), model::network::TwoHeadedConvNetHeads::HEURISTIC};
+        } else {
+            return {std::move(observation)};
+        }
+    }
+
+    // Run inference on the queued nodes, or flag that the caller needs to run it for us
+    void request_inference() {
+        if (defer_inference) {
+            awaiting_inference = true;
+        } else if (async_inference) {
+            // Only a single batch is in flight, otherwise keep queueing until it returns
+            poll_inference(false);
+            if (!inflight_predictions.valid()) {
+                submit_inference();
+            }
+        } else {
+            batch_predict();
+        }
+    }
+
+    // Batch predict inference
+    void batch_predict() {
+        SPDLOG_DEBUG("Running inference.");
+        std::vector<InferenceOutputT> predictions = model->Inference(inference_inputs);
+        process_predictions(inference_nodes, predictions);
+        inference_inputs.clear();
+    }
+
+    // Send the queued nodes off for inference without waiting on the result
+    void submit_inference() {
+        SPDLOG_DEBUG("Submitting async inference.");
+        std::swap(inflight_nodes, inference_nodes);
+        inflight_predictions = model->InferenceAsync(std::exchange(inference_inputs, {}));
+    }
+
+    // Fold in the outstanding async predictions if they are ready, or block until they are if wait is set
+    void poll_inference(bool wait) {
+        if (!inflight_predictions.valid()) {
+            return;
+        }
+        if (!wait && inflight_predictions.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
+        std::vector<InferenceOutputT> predictions = inflight_predictions.get();
+        process_predictions(inflight_nodes, predictions);
+    }
+
+    // Set the network outputs on the queued nodes and move them into open
+    void process_predictions(std::vector<NodeT> &nodes, std::vector<InferenceOutputT> &predictions) {
+        for (auto &&[child_node, prediction] : zip(nodes, predictions)) {
+            child_node.h = prediction.heuristic;
+            open.push(std::move(child_node));
+            ++search_output.num_generated;
+        }
+        nodes.clear();
+    }
+
+    // Walk backwards up until the root, setting data
+    void set_solution_trajectory(const NodeT &node) {
+        double solution_cost = 0;
+        auto current = &node;
+        search_output.solution_found = true;
+        search_output.solution_cost = current->g;
+        search_output.solution_prob = 1;
+        search_output.solution_log_prob = 0;
+        while (current->parent) {
+            search_output.solution_path_states.push_back(current->parent->state);
+            search_output.solution_path_observations.push_back(current->parent->state.get_observation());
+            search_output.solution_path_actions.push_back(current->action);
+            solution_cost += (current->g - current->parent->g);
+            search_output.solution_path_costs.push_back(solution_cost);
+            current = current->parent;
+        }
+    }
+
+    SearchInputModel<EnvT, GBFSEvaluatorT> input;     // Search input, contaning problem instance, model, budget, etc.
+    Status status{};                                  // Current search status
+    bool timeout = false;                             // Timout flag on budget
+    std::shared_ptr<GBFSEvaluatorT> model;            // Network with heuristic head
+    std::size_t inference_batch_size;                 // Number of nodes to queue before running inference
+    SearchOutput<EnvT> search_output;                 // Output of the search algorithm, containing trajectory + stats
+    std::vector<NodeT> inference_nodes;               // Nodes in queue for batch inference
+    std::vector<InferenceInputT> inference_inputs;    // Corresponding input structs the network evaluator expects
+    OpenListT open;                                   // Open list
+    ClosedListT closed;                               // Closed list
+    bool defer_inference = false;                     // Inference is run by the caller instead of the search
+    bool awaiting_inference = false;                  // Queued nodes are waiting on the caller to run inference
+    bool async_inference;                             // Keep expanding while inference runs in the background
+    std::vector<NodeT> inflight_nodes;                // Nodes with inference currently running in the background
+    InferenceFutureT inflight_predictions;            // Background inference result
+};
+
+template <GBFSEnv EnvT>
+class YieldableGBFSNoModel {
+    using NodeT = detail::Node<EnvT>;
+    using OpenListT =
+        PrioritySet<NodeT, typename NodeT::CompareOrderedLess, typename NodeT::Hasher, typename NodeT::CompareEqual>;
+    using ClosedListT = absl::flat_hash_set<std::unique_ptr<NodeT>, typename NodeT::Hasher, typename NodeT::CompareEqual>;
+
+public:
+    YieldableGBFSNoModel(const SearchInputNoModel<EnvT> &input) : input(input), status(Status::INIT) {
+        reset();
+    }
+
+    void init() {
+        SPDLOG_DEBUG("Initializing GBFS: budget: {:d}", input.search_budget);
+        if (status != Status::INIT) {
+            SPDLOG_ERROR("Coroutine needs to be reset() before calling init()");
+            throw std::logic_error("Coroutine needs to be reset() before calling init()");
+        }
+        NodeT root_node(input.state);
+        if (root_node.state.is_solution()) {
+            set_solution_trajectory(root_node);
+            status = Status::SOLVED;
+            return;
+        }
+        root_node.h = root_node.state.get_heuristic();
+        open.push(std::move(root_node));
+        ++search_output.num_generated;
+        SPDLOG_DEBUG("Initializing open: ");
+        status = Status::OK;
+    }
+
+    void reset() {
+        status = Status::INIT;
+        timeout = false;
+        search_output = SearchOutput<EnvT>{.puzzle_name = input.puzzle_name};
+        open.clear();
+        closed.clear();
+    }
+
+    void step() {
+        if (open.empty()) {
+            status = Status::ERROR;
+            SPDLOG_ERROR("Exhausted open list - name: {:s}, budget: {:d}.", input.puzzle_name, input.search_budget);
+            return;
+        }
+        auto current_u_ptr = std::make_unique<NodeT>(*open.pop_and_move());
+        auto &current = static_cast<NodeT &>(*current_u_ptr);
+        const auto current_ptr = current_u_ptr.get();
+        closed.insert(std::move(current_u_ptr));
+        ++search_output.num_expanded;
+
+        SPDLOG_DEBUG("-------------------------------------");
+        SPDLOG_DEBUG("Expanding: {:d}, g: {:.2f}, h: {:.2f}", search_output.num_expanded, current.g, current.h);
+        SPDLOG_DEBUG("\n{:s}", current.state.to_str());
+
+        // Timeout, either on our own budget or the one jointly charged with other searches
+        if ((input.search_budget >= 0 && search_output.num_expanded >= input.search_budget) ||
+            (input.shared_budget && !input.shared_budget->charge())) {
+            timeout = true;
+            SPDLOG_INFO("Buget timeout - name: {:s}, exp: {:d}, gen: {:d}, budget: {:d}", input.puzzle_name,
+                        search_output.num_expanded, search_output.num_generated, input.search_budget);
+            status = Status::TIMEOUT;
+            return;
+        }
+
+        // Consider all children
+        for (const auto &a : current.state.child_actions()) {
+            NodeT child_node = current;
+            child_node.parent = current_ptr;
+            child_node.apply_action(current, 1, a);
+            SPDLOG_DEBUG("Generating: {:d}, g: {:.2f}", a, child_node.g);
+            SPDLOG_DEBUG("\n{:s}", child_node.state.to_str());
+
+            if (child_node.state.is_solution()) {
+                SPDLOG_INFO("Solved - name: {:s}, exp: {:d}, gen: {:d}, budget: {:d}, c: {:.0f}", input.puzzle_name,
+                            search_output.num_expanded, search_output.num_generated, input.search_budget, child_node.g);
+                set_solution_trajectory(child_node);
+                status = Status::SOLVED;
+                return;
+            }
+
+            // Greedy search never re-opens, first path found to a state is kept
+            if (closed.find(child_node) == closed.end() && !open.contains(child_node)) {
+                child_node.h = child_node.state.get_heuristic();
+                open.push(std::move(child_node));
+                ++search_output.num_generated;
+            }
+        }
+    }
+
+    [[nodiscard]] Status get_status() const {
+        return status;
+    }
+
+    [[nodiscard]] SearchOutput<EnvT> get_search_output() const {
+        return search_output;
+    }
+
+private:
+    void set_solution_trajectory(const NodeT &node) {
+        double solution_cost = 0;
+        auto current = &node;
+        search_output.solution_found = true;
+        search_output.solution_cost = current->g;
+        search_output.solution_prob = 1;
+        search_output.solution_log_prob = 0;
+        while (current->parent) {
+            search_output.solution_path_states.push_back(current->parent->state);
+            search_output.solution_path_observations.push_back(current->parent->state.get_observation());
+            search_output.solution_path_actions.push_back(current->action);
+            solution_cost += (current->g - current->parent->g);
+            search_output.solution_path_costs.push_back(solution_cost);
+            current = current->parent;
+        }
+    }
+
+    SearchInputNoModel<EnvT> input;
+    Status status{};
+    bool timeout = false;
+    SearchOutput<EnvT> search_output;
+    OpenListT open;
+    ClosedListT closed;
+};
+
+template <GBFSEnv EnvT, model::IsModelEvaluator GBFSEvaluatorT>
+    requires IsTypeAmongVariant<GBFSEvaluatorT, GBFSHeuristicNetEvaluator>
+auto search(const SearchInputModel<EnvT, GBFSEvaluatorT> &input) -> SearchOutput<EnvT> {
+    // Lets the evaluator dispatch batches early once all active searchers are waiting on inference
+    const model::ActiveSearcherGuard searcher_guard(input.model_eval);
+    YieldableGBFSModel<EnvT, GBFSEvaluatorT> step_gbfs(input);
+    step_gbfs.init();
+    // Iteratively search until status changes (solved or timeout)
+    while (step_gbfs.get_status() == Status::OK && !input.stop_token->stop_requested()) {
+        step_gbfs.step();
+    }
+    return step_gbfs.get_search_output();
+}
+// Run all searches on the calling thread, sharing inference batches between them
+template <GBFSEnv EnvT, model::IsModelEvaluator GBFSEvaluatorT>
+    requires IsTypeAmongVariant<GBFSEvaluatorT, GBFSHeuristicNetEvaluator>
+auto search_interleaved(const std::vector<SearchInputModel<EnvT, GBFSEvaluatorT>> &inputs) -> std::vector<SearchOutput<EnvT>> {
+    return run_interleaved<YieldableGBFSModel<EnvT, GBFSEvaluatorT>, SearchOutput<EnvT>>(inputs);
+}
+template <GBFSEnv EnvT>
+auto search(const SearchInputNoModel<EnvT> &input) -> SearchOutput<EnvT> {
+    YieldableGBFSNoModel<EnvT> step_gbfs(input);
+    step_gbfs.init();
+    while (step_gbfs.get_status() == Status::OK && !input.stop_token->stop_requested()) {
+        step_gbfs.step();
+    }
+    return step_gbfs.get_search_output();
+}
+
+}    // namespace hpts::algorithm::gbfs
+
+#endif    // HPTS_ALGORITHM_GBFS_H_
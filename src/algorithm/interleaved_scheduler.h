@@ -0,0 +1,111 @@
+// File: interleaved_scheduler.h
+// Description: Steps many searches on a single thread, combining their inference queries into shared batches
+
+#ifndef HPTS_ALGORITHM_INTERLEAVED_SCHEDULER_H_
+#define HPTS_ALGORITHM_INTERLEAVED_SCHEDULER_H_
+
+#include <spdlog/spdlog.h>
+
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "algorithm/yieldable.h"
+#include "model/model_evaluator.h"
+
+namespace hpts::algorithm {
+
+/**
+ * Run the searches for the given inputs round-robin on the calling thread.
+ * Each search is stepped until it has a batch ready for inference (or terminates), then the pending inputs of all
+ * searches are merged into a single forward pass and the outputs are handed back to their owning searches.
+ * @note All inputs must share the same model evaluator
+ * @param inputs Search inputs, one per search to run
+ * @return Search outputs, in the same order as the inputs
+ */
+template <typename YieldableT, typename SearchOutputT, typename SearchInputT>
+    requires IsInferenceYieldable<YieldableT>
+auto run_interleaved(const std::vector<SearchInputT> &inputs) -> std::vector<SearchOutputT> {
+    using InferenceInputT = YieldableT::InferenceInput;
+    using InferenceOutputT = YieldableT::InferenceOutput;
+    if (inputs.empty()) {
+        return {};
+    }
+    const auto model = inputs[0].model_eval;
+    for (const auto &input : inputs) {
+        if (input.model_eval != model) {
+            SPDLOG_ERROR("Interleaved searches need to share the same model evaluator.");
+            throw std::invalid_argument("Interleaved searches need to share the same model evaluator.");
+        }
+    }
+
+    // All searches share this thread, so they count as a single searcher for the evaluator
+    const model::ActiveSearcherGuard searcher_guard(model);
+
+    std::vector<std::unique_ptr<YieldableT>> searches;
+    searches.reserve(inputs.size());
+    for (const auto &input : inputs) {
+        searches.push_back(std::make_unique<YieldableT>(input));
+        searches.back()->set_defer_inference(true);
+        searches.back()->init();
+    }
+
+    std::vector<InferenceInputT> batch_inputs;
+    std::vector<std::pair<std::size_t, std::size_t>> requests;    // Owning search index and number of inputs
+    while (true) {
+        // Step each search until it needs inference or is done
+        for (std::size_t i = 0; i < searches.size(); ++i) {
+            auto &search = *searches[i];
+            while (search.get_status() == Status::OK && !search.is_awaiting_inference() &&
+                   !inputs[i].stop_token->stop_requested()) {
+                search.step();
+            }
+        }
+
+        // Collect pending inputs from the searches which are still running
+        batch_inputs.clear();
+        requests.clear();
+        for (std::size_t i = 0; i < searches.size(); ++i) {
+            auto &search = *searches[i];
+            if (search.get_status() != Status::OK || !search.is_awaiting_inference() ||
+                inputs[i].stop_token->stop_requested()) {
+                continue;
+            }
+            std::vector<InferenceInputT> search_inputs = search.take_inference_inputs();
+            requests.emplace_back(i, search_inputs.size());
+            batch_inputs.insert(batch_inputs.end(), std::make_move_iterator(search_inputs.begin()),
+                                std::make_move_iterator(search_inputs.end()));
+        }
+        if (requests.empty()) {
+            break;
+        }
+
+        // Single forward pass, then hand results back to their owners
+        SPDLOG_DEBUG("Interleaved inference on {:d} inputs from {:d} searches.", batch_inputs.size(), requests.size());
+        std::vector<InferenceOutputT> batch_outputs;
+        if (!batch_inputs.empty()) {
+            batch_outputs = model->Inference(batch_inputs);
+        }
+        auto output_iter = batch_outputs.begin();
+        for (const auto &[search_idx, num_inputs] : requests) {
+            const auto output_end = output_iter + static_cast<std::ptrdiff_t>(num_inputs);
+            std::vector<InferenceOutputT> search_outputs(std::make_move_iterator(output_iter),
+                                                         std::make_move_iterator(output_end));
+            searches[search_idx]->set_inference_outputs(std::move(search_outputs));
+            output_iter = output_end;
+        }
+    }
+
+    std::vector<SearchOutputT> outputs;
+    outputs.reserve(searches.size());
+    for (const auto &search : searches) {
+        outputs.push_back(search->get_search_output());
+    }
+    return outputs;
+}
+
+}    // namespace hpts::algorithm
+
+#endif    // HPTS_ALGORITHM_INTERLEAVED_SCHEDULER_H_
@@ -6,12 +6,18 @@
 
 #include <absl/container/flat_hash_set.h>
 
+#include <algorithm>
+#include <cassert>
+#include <chrono>
 #include <cmath>
 #include <concepts>
 #include <exception>
+#include <future>
 #include <memory>
+#include <optional>
 #include <queue>
 #include <string>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -25,14 +31,17 @@
 #include <spdlog/spdlog.h>
 // NOLINTEND
 
+#include "algorithm/interleaved_scheduler.h"
 #include "algorithm/yieldable.h"
 #include "common/observation.h"
 #include "env/simple_env.h"
 #include "model/model_evaluator.h"
 #include "model/policy_convnet/policy_convnet_wrapper.h"          // For inference input/output types
+#include "model/replay_evaluator.h"
 #include "model/twoheaded_convnet/twoheaded_convnet_wrapper.h"    // For inference input/output types
 #include "util/concepts.h"
 #include "util/priority_set.h"
+#include "util/shared_budget.h"
 #include "util/utility.h"
 #include "util/zip.h"
 
@@ -43,6 +52,7 @@ constexpr double WEIGHT = 1.0;
 static std::size_t INFERENCE_BATCH_SIZE = 1;         // NOLINT(*-non-const-global-variables,*-avoid-magic-numbers)
 static std::size_t BLOCK_ALLOCATION_SIZE = 10000;    // NOLINT(*-non-const-global-variables,*-avoid-magic-numbers)
 static double MIX_EPSILON = 0;                       // NOLINT(*-non-const-global-variables,*-avoid-magic-numbers)
+static bool ASYNC_INFERENCE = false;                 // NOLINT(*-non-const-global-variables,*-avoid-magic-numbers)
 constexpr double EPS = 1e-8;                         // NOLINT(*-non-const-global-variables,*-avoid-magic-numbers)
 
 // All states must satisfy constraints
@@ -55,10 +65,12 @@ using PHSPolicyNetEvaluator = std::variant<model::ModelEvaluator<model::wrapper:
                                            model::ModelEvaluator<model::wrapper::TwoHeadedConvNetWrapperPHS>,
                                            model::ModelEvaluator<model::wrapper::PolicyConvNetWrapperLevin>,
                                            model::ModelEvaluator<model::wrapper::PolicyConvNetWrapperPolicyGradient>,
-                                           model::ModelEvaluator<model::wrapper::PolicyConvNetWrapperPHS>>;
+                                           model::ModelEvaluator<model::wrapper::PolicyConvNetWrapperPHS>,
+                                           model::ReplayEvaluator<model::wrapper::TwoHeadedConvNetWrapperLevin>,
+                                           model::ReplayEvaluator<model::wrapper::PolicyConvNetWrapperLevin>>;
 
 // Input to PHS search algorithm
-template <PHSEnv EnvT, model::IsModelEvaluator PHSEvaluatorT>
+template <PHSEnv EnvT, model::IsInferenceEvaluator PHSEvaluatorT>
     requires IsTypeAmongVariant<PHSEvaluatorT, PHSPolicyNetEvaluator>
 struct SearchInput {
     std::string puzzle_name;
@@ -66,6 +78,9 @@ struct SearchInput {
     int search_budget = {};
     std::shared_ptr<StopToken> stop_token;
     std::shared_ptr<PHSEvaluatorT> model_eval;
+    std::optional<double> mix_epsilon = std::nullopt;                  // Overrides MIX_EPSILON if set
+    std::optional<std::size_t> inference_batch_size = std::nullopt;    // Overrides INFERENCE_BATCH_SIZE if set
+    std::shared_ptr<SharedBudget> shared_budget = nullptr;             // Joint budget with other searches if set
 };
 
 // Search algorithm output
@@ -79,7 +94,7 @@ struct SearchOutput {
     double solution_prob = 1;
     double solution_log_prob = 0;
     std::vector<EnvT> solution_path_states{};
-    std::vector<Observation> solution_path_observations{};
+    std::vector<PackedObservation> solution_path_observations{};
     std::vector<int> solution_path_actions{};
     std::vector<double> solution_path_costs{};
 };
@@ -152,17 +167,28 @@ static constexpr double phs_cost(double log_p, double g, double h) {
 }
 }    // namespace detail
 
-template <PHSEnv EnvT, model::IsModelEvaluator PHSEvaluatorT>
+template <PHSEnv EnvT, model::IsInferenceEvaluator PHSEvaluatorT>
 class YieldablePHS {
     using NodeT = detail::Node<EnvT>;
     using InferenceInputT = PHSEvaluatorT::InferenceInput;
     using InferenceOutputT = PHSEvaluatorT::InferenceOutput;
+    using InferenceFutureT = std::future<std::vector<InferenceOutputT>>;
     using OpenListT =
         PrioritySet<NodeT, typename NodeT::CompareOrderedLess, typename NodeT::Hasher, typename NodeT::CompareEqual>;
     using ClosedListT = absl::flat_hash_set<std::unique_ptr<NodeT>, typename NodeT::Hasher, typename NodeT::CompareEqual>;
 
 public:
-    YieldablePHS(const SearchInput<EnvT, PHSEvaluatorT> &input) : input(input), status(Status::INIT), model(input.model_eval) {
+    // Expose inference types for schedulers which run inference on behalf of the search
+    using InferenceInput = InferenceInputT;
+    using InferenceOutput = InferenceOutputT;
+
+    YieldablePHS(const SearchInput<EnvT, PHSEvaluatorT> &input)
+        : input(input),
+          status(Status::INIT),
+          model(input.model_eval),
+          mix_epsilon(input.mix_epsilon.value_or(MIX_EPSILON)),
+          inference_batch_size(input.inference_batch_size.value_or(INFERENCE_BATCH_SIZE)),
+          async_inference(ASYNC_INFERENCE) {
         reset();
     }
 
@@ -174,19 +200,22 @@ public:
             throw std::logic_error("Coroutine needs to be reset() before calling init()");
         }
         NodeT root_node(input.state);
-        inference_inputs.emplace_back(root_node.state.get_observation());
+        inference_inputs.push_back(make_inference_input(root_node.state.get_observation()));
         inference_nodes.push_back(root_node);
-        batch_predict();
+        request_inference();
         SPDLOG_DEBUG("Initializing open: ");
         status = Status::OK;
     }
 
     void reset() {
         status = Status::INIT;
+        awaiting_inference = false;
         timeout = false;
         search_output = SearchOutput<EnvT>{.puzzle_name = input.puzzle_name};
         inference_nodes.clear();
         inference_inputs.clear();
+        inflight_nodes.clear();
+        inflight_predictions = {};
         open.clear();
         closed.clear();
     }
@@ -194,11 +223,25 @@ public:
     void reset(const SearchInput<EnvT, PHSEvaluatorT> &input) {
         this->input = input;
         model = std::get<0>(input.model_evals);
+        mix_epsilon = input.mix_epsilon.value_or(MIX_EPSILON);
+        inference_batch_size = input.inference_batch_size.value_or(INFERENCE_BATCH_SIZE);
         reset();
     }
 
     // Single step of the search algorithm
     void step() {
+        if (awaiting_inference) {
+            SPDLOG_ERROR("Inference outputs need to be set before calling step()");
+            throw std::logic_error("Inference outputs need to be set before calling step()");
+        }
+        // Fold in async predictions, only blocking if there is nothing else to expand
+        if (async_inference && !defer_inference) {
+            poll_inference(open.empty());
+            if (open.empty() && !inference_inputs.empty()) {
+                submit_inference();
+                poll_inference(true);
+            }
+        }
         if (open.empty()) {
             status = Status::ERROR;
             SPDLOG_ERROR("Exhausted open list - name: {:s}, budget: {:d}.", input.puzzle_name, input.search_budget);
@@ -217,8 +260,9 @@ public:
                      current.h);
         SPDLOG_DEBUG("\n{:s}", current.state.to_str());
 
-        // Timeout
-        if (input.search_budget >= 0 && search_output.num_expanded >= input.search_budget) {
+        // Timeout, either on our own budget or the one jointly charged with other searches
+        if ((input.search_budget >= 0 && search_output.num_expanded >= input.search_budget) ||
+            (input.shared_budget && !input.shared_budget->charge())) {
             timeout = true;
             SPDLOG_INFO("Buget timeout - name: {:s}, exp: {:d}, gen: {:d}, budget: {:d}", input.puzzle_name,
                         search_output.num_expanded, search_output.num_generated, input.search_budget);
@@ -245,7 +289,7 @@ public:
 
             // If new state, add to queue for inference
             if (closed.find(child_node) == closed.end() && !open.contains(child_node)) {
-                inference_inputs.emplace_back(child_node.state.get_observation());
+                inference_inputs.push_back(make_inference_input(child_node.state.get_observation()));
                 inference_nodes.push_back(std::move(child_node));
             }
         }
@@ -253,8 +297,8 @@ public:
         SPDLOG_DEBUG("Open size: {:d}, Inference batched size: {:d}", open.size(), inference_inputs.size());
 
         // Batch inference
-        if (open.empty() || inference_inputs.size() >= INFERENCE_BATCH_SIZE) {
-            batch_predict();
+        if (open.empty() || inference_inputs.size() >= inference_batch_size) {
+            request_inference();
         }
     }
 
@@ -266,6 +310,28 @@ public:
         return search_output;
     }
 
+    /**
+     * Defer inference to the caller instead of querying the model directly.
+     * Once is_awaiting_inference() is set, the caller takes the queued inputs and must set the outputs before the
+     * next call to step().
+     */
+    void set_defer_inference(bool defer) {
+        defer_inference = defer;
+    }
+
+    [[nodiscard]] bool is_awaiting_inference() const {
+        return awaiting_inference;
+    }
+
+    [[nodiscard]] auto take_inference_inputs() -> std::vector<InferenceInputT> {
+        return std::exchange(inference_inputs, {});
+    }
+
+    void set_inference_outputs(std::vector<InferenceOutputT> &&predictions) {
+        process_predictions(inference_nodes, predictions);
+        awaiting_inference = false;
+    }
+
     EnvT get_open_state(std::size_t index = 0) {
         if (index >= open.size()) {
             throw std::invalid_argument("Index out of bounds");
@@ -278,17 +344,93 @@ public:
     }
 
 private:
+    // Only request the policy and heuristic, as the log policy is recomputed after mixing and the logits are unused
+    [[nodiscard]] static auto make_inference_input(Observation &&observation) -> InferenceInputT {
+        if constexpr (HasHeadMask<InferenceInputT>) {
+            using Heads = model::network::TwoHeadedConvNetHeads;
+            return {std::move(observation), Heads::POLICY | Heads::HEURISTIC};
+        } else {
+            return {std::move(observation)};
+        }
+    }
+
+    // Run inference on the queued nodes, or flag that the caller needs to run it for us
+    void request_inference() {
+        if (defer_inference) {
+            awaiting_inference = true;
+        } else if (async_inference) {
+            // Only a single batch is in flight, otherwise keep queueing until it returns
+            poll_inference(false);
+            if (!inflight_predictions.valid()) {
+                submit_inference();
+            }
+        } else {
+            batch_predict();
+        }
+    }
+
     // Batch predict inference
     void batch_predict() {
         SPDLOG_DEBUG("Running inference.");
         std::vector<InferenceOutputT> predictions = model->Inference(inference_inputs);
-        for (auto &&[child_node, prediction] : zip(inference_nodes, predictions)) {
+        process_predictions(inference_nodes, predictions);
+        inference_inputs.clear();
+    }
+
+    // Send the queued nodes off for inference without waiting on the result
+    void submit_inference() {
+        SPDLOG_DEBUG("Submitting async inference.");
+        std::swap(inflight_nodes, inference_nodes);
+        inflight_predictions = model->InferenceAsync(std::exchange(inference_inputs, {}));
+    }
+
+    // Fold in the outstanding async predictions if they are ready, or block until they are if wait is set
+    void poll_inference(bool wait) {
+        if (!inflight_predictions.valid()) {
+            return;
+        }
+        if (!wait && inflight_predictions.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
+        std::vector<InferenceOutputT> predictions = inflight_predictions.get();
+        process_predictions(inflight_nodes, predictions);
+    }
+
+    // Set the network outputs on the queued nodes and move them into open
+    void process_predictions(std::vector<NodeT> &nodes, std::vector<InferenceOutputT> &predictions) {
+        if (nodes.empty()) {
+            return;
+        }
+        // Gather into structure-of-arrays form so the policy mixing and costs run as batched kernels
+        const std::size_t batch_size = nodes.size();
+        const std::size_t num_actions = predictions.front().policy.size();
+        batch_policy.resize(batch_size * num_actions);
+        batch_log_policy.resize(batch_size * num_actions);
+        batch_log_p.resize(batch_size);
+        batch_g.resize(batch_size);
+        batch_h.resize(batch_size);
+        batch_cost.resize(batch_size);
+        for (std::size_t i = 0; i < batch_size; ++i) {
             // Net output has heuristic data member
             if constexpr (HasHeuristic<InferenceOutputT>) {
-                child_node.h = prediction.heuristic;
+                nodes[i].h = predictions[i].heuristic;
             }
-            child_node.action_log_prob = log_policy_noise(prediction.policy, MIX_EPSILON);
-            child_node.cost = detail::phs_cost(child_node.log_p, child_node.g, child_node.h);
+            assert(predictions[i].policy.size() == num_actions);
+            std::copy(predictions[i].policy.begin(), predictions[i].policy.end(),
+                      batch_policy.begin() + static_cast<std::ptrdiff_t>(i * num_actions));
+            batch_log_p[i] = nodes[i].log_p;
+            batch_g[i] = nodes[i].g;
+            batch_h[i] = nodes[i].h;
+        }
+        log_policy_noise_batch(batch_policy, num_actions, mix_epsilon, batch_log_policy);
+        phs_cost_batch(batch_log_p, batch_g, batch_h, batch_cost);
+
+        for (std::size_t i = 0; i < batch_size; ++i) {
+            auto &child_node = nodes[i];
+            // Child holds a copy of its parent's action_log_prob, so this reuses its storage
+            const auto row = batch_log_policy.begin() + static_cast<std::ptrdiff_t>(i * num_actions);
+            child_node.action_log_prob.assign(row, row + static_cast<std::ptrdiff_t>(num_actions));
+            child_node.cost = batch_cost[i];
 
             SPDLOG_DEBUG("Adding child to open: logp: {:f}, g: {:.2f}, h: {:.2f}, c: {:.2f}, low: {:s}", child_node.log_p,
                          child_node.g, child_node.h, child_node.cost, vec_to_str(child_node.action_log_prob));
@@ -296,8 +438,7 @@ private:
             open.push(std::move(child_node));
             ++search_output.num_generated;
         }
-        inference_inputs.clear();
-        inference_nodes.clear();
+        nodes.clear();
     }
 
     // Walk backwards up until the root, setting data
@@ -324,15 +465,30 @@ private:
     Status status{};                                  // Current search status
     bool timeout = false;                             // Timout flag on budget
     std::shared_ptr<PHSEvaluatorT> model;             // Policy network with optional heuristic
+    double mix_epsilon;                               // Percentage to mix with uniform policy
+    std::size_t inference_batch_size;                 // Number of nodes to queue before running inference
     SearchOutput<EnvT> search_output;                 // Output of the search algorithm, containing trajectory + stats
     std::vector<NodeT> inference_nodes;               // Nodes in queue for batch inference
     std::vector<InferenceInputT> inference_inputs;    // Corresponding input structs the network evaluator expects
     OpenListT open;                                   // Open list
     ClosedListT closed;                               // Closed list
+    bool defer_inference = false;                     // Inference is run by the caller instead of the search
+    bool awaiting_inference = false;                  // Queued nodes are waiting on the caller to run inference
+    bool async_inference;                             // Keep expanding while inference runs in the background
+    std::vector<NodeT> inflight_nodes;                // Nodes with inference currently running in the background
+    InferenceFutureT inflight_predictions;            // Background inference result
+    std::vector<double> batch_policy;                 // Reusable flattened policies of the current inference batch
+    std::vector<double> batch_log_policy;             // Reusable flattened mixed log-policies of the current batch
+    std::vector<double> batch_log_p;                  // Reusable log_p of the current batch
+    std::vector<double> batch_g;                      // Reusable g of the current batch
+    std::vector<double> batch_h;                      // Reusable h of the current batch
+    std::vector<double> batch_cost;                   // Reusable PHS costs of the current batch
 };
 
-template <PHSEnv EnvT, model::IsModelEvaluator PHSEvaluatorT>
+template <PHSEnv EnvT, model::IsInferenceEvaluator PHSEvaluatorT>
 auto search(const SearchInput<EnvT, PHSEvaluatorT> &input) -> SearchOutput<EnvT> {
+    // Lets the evaluator dispatch batches early once all active searchers are waiting on inference
+    const model::ActiveSearcherGuard searcher_guard(input.model_eval);
     YieldablePHS<EnvT, PHSEvaluatorT> step_phs(input);
     step_phs.init();
     // Iteratively search until status changes (solved or timeout)
@@ -342,6 +498,12 @@ auto search(const SearchInput<EnvT, PHSEvaluatorT> &input) -> SearchOutput<EnvT>
     return step_phs.get_search_output();
 }
 
+// Run all searches on the calling thread, sharing inference batches between them
+template <PHSEnv EnvT, model::IsInferenceEvaluator PHSEvaluatorT>
+auto search_interleaved(const std::vector<SearchInput<EnvT, PHSEvaluatorT>> &inputs) -> std::vector<SearchOutput<EnvT>> {
+    return run_interleaved<YieldablePHS<EnvT, PHSEvaluatorT>, SearchOutput<EnvT>>(inputs);
+}
+
 }    // namespace hpts::algorithm::phs
 
 #endif    // HPTS_ALGORITHM_PHS_H_
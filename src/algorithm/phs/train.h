@@ -41,7 +41,7 @@ public:
 
     void init() {
         // Start off with models in sync
-        model_eval->checkpoint_and_sync_without_optimizer(-1);
+        model_eval->sync_weights();
     }
 
     void log_status() {
@@ -100,23 +100,32 @@ public:
 
         auto device_manager = model_eval->get_device_manager();
         auto model = device_manager->Get(batch_size, 0);
+        // The cascade model (if used) learns from the same samples as the full model
+        auto cascade_device_manager = model_eval->get_cascade_device_manager();
         for (int i = 0; i < grad_steps; ++i) {
             std::shuffle(training_samples.begin(), training_samples.end(), rng);
             auto batched_input = split_to_batch(training_samples, batch_size);
             double loss = 0;
+            double cascade_loss = 0;
             for (auto& batch_item : batched_input) {
                 std::vector<LearningInputT> batch;
                 for (auto& sample_item : batch_item) {
                     batch.push_back(sample_item);
                 }
                 loss += model->Learn(batch);
+                if (cascade_device_manager != nullptr) {
+                    cascade_loss += cascade_device_manager->Get(batch_size, 0)->Learn(batch);
+                }
             }
             SPDLOG_INFO("Loss: {:f}", loss / batched_input.size());
+            if (cascade_device_manager != nullptr) {
+                SPDLOG_INFO("Cascade loss: {:f}", cascade_loss / batched_input.size());
+            }
         }
         training_samples.clear();
 
-        // Checkpoint updated model and sync other inference models
-        device_manager->checkpoint_and_sync_without_optimizer(-1);
+        // Sync other inference models in memory, checkpoints to disk are left to checkpoint() and terminate()
+        model_eval->sync_weights();
     }
 
     void checkpoint(long long int step) {
@@ -124,8 +133,9 @@ public:
     }
 
     void terminate() {
-        // save models
+        // save models, and wait for the background writer so the checkpoint is on disk before exiting
         model_eval->save_checkpoint(-1);
+        model_eval->flush_checkpoints();
     }
 
 private:
@@ -0,0 +1,218 @@
+// File: portfolio.h
+// Description: Races several search configurations on a single problem, first solution cancels the rest
+
+#ifndef HPTS_ALGORITHM_PORTFOLIO_H_
+#define HPTS_ALGORITHM_PORTFOLIO_H_
+
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "util/cpu_affinity.h"
+#include "util/shared_budget.h"
+#include "util/stop_token.h"
+
+namespace hpts::algorithm {
+
+// Portfolio inputs need to be able to redirect cancellation and budget charging per problem
+template <typename T>
+concept IsPortfolioInput = requires(T t) {
+    { t.puzzle_name } -> std::same_as<std::string &>;
+    { t.search_budget } -> std::same_as<int &>;
+    { t.stop_token } -> std::same_as<std::shared_ptr<StopToken> &>;
+    { t.shared_budget } -> std::same_as<std::shared_ptr<SharedBudget> &>;
+};
+
+template <typename T>
+concept IsPortfolioOutput = requires(T t) {
+    { t.puzzle_name } -> std::same_as<std::string &>;
+    { t.solution_found } -> std::same_as<bool &>;
+    { t.num_expanded } -> std::same_as<int &>;
+    { t.num_generated } -> std::same_as<int &>;
+};
+
+// A single configuration racing in the portfolio
+template <typename SearchInputT, typename SearchOutputT>
+struct PortfolioMember {
+    std::string name;
+    std::function<SearchOutputT(const SearchInputT &)> algorithm;
+};
+
+/**
+ * Copy the problem fields between two algorithms input types, so that differing algorithms (i.e. A* and GBFS) can be
+ * raced in the same portfolio. The model evaluator is shared if both inputs take one, other algorithm specific fields
+ * are left at their defaults.
+ */
+template <typename ToT, typename FromT>
+    requires IsPortfolioInput<ToT> && IsPortfolioInput<FromT>
+auto convert_search_input(const FromT &from) -> ToT {
+    ToT to{.puzzle_name = from.puzzle_name,
+           .state = from.state,
+           .search_budget = from.search_budget,
+           .stop_token = from.stop_token};
+    to.shared_budget = from.shared_budget;
+    if constexpr (requires { to.model_eval = from.model_eval; }) {
+        to.model_eval = from.model_eval;
+    }
+    return to;
+}
+
+/**
+ * Copy the common search output fields between two algorithms output types, so that differing algorithms
+ * (i.e. A* and GBFS) can be raced in the same portfolio.
+ */
+template <typename ToT, typename FromT>
+    requires IsPortfolioOutput<ToT> && IsPortfolioOutput<FromT>
+auto convert_search_output(FromT &&from) -> ToT {
+    ToT to;
+    to.puzzle_name = std::move(from.puzzle_name);
+    to.solution_found = from.solution_found;
+    to.solution_cost = from.solution_cost;
+    to.num_expanded = from.num_expanded;
+    to.num_generated = from.num_generated;
+    to.solution_prob = from.solution_prob;
+    to.solution_log_prob = from.solution_log_prob;
+    to.solution_path_states = std::move(from.solution_path_states);
+    to.solution_path_observations = std::move(from.solution_path_observations);
+    to.solution_path_actions = std::move(from.solution_path_actions);
+    to.solution_path_costs = std::move(from.solution_path_costs);
+    return to;
+}
+
+/**
+ * Wrap an algorithm with its own input and output types as a member, converting to and from the portfolio's types
+ * @param name Name of the member
+ * @param algorithm Search algorithm of the member
+ */
+template <typename SearchInputT, typename SearchOutputT, typename MemberInputT, typename MemberOutputT>
+auto adapt_member(std::string name, std::function<MemberOutputT(const MemberInputT &)> algorithm)
+    -> PortfolioMember<SearchInputT, SearchOutputT> {
+    return {std::move(name), [algorithm = std::move(algorithm)](const SearchInputT &input) {
+                return convert_search_output<SearchOutputT>(algorithm(convert_search_input<MemberInputT>(input)));
+            }};
+}
+
+/**
+ * Race all members on the given problem, each on its own thread.
+ * Each member gets a per-problem stop token which is signalled once any member solves the problem (or the caller's
+ * stop token is signalled), and all expansions are charged against a single budget of input.search_budget.
+ * @param input Problem instance, with the total expansion budget
+ * @param members Configurations to race
+ * @return Search output of the first member to solve, or of the last member to finish if unsolved. Expansions and
+ *         generations are summed over all members.
+ * @throw Rethrows the first exception thrown by a member, once all members have stopped
+ */
+template <typename SearchInputT, typename SearchOutputT>
+    requires IsPortfolioInput<SearchInputT> && IsPortfolioOutput<SearchOutputT>
+auto run_portfolio(const SearchInputT &input, const std::vector<PortfolioMember<SearchInputT, SearchOutputT>> &members)
+    -> SearchOutputT {
+    constexpr auto POLL_INTERVAL = std::chrono::milliseconds(10);
+    if (members.empty()) {
+        SPDLOG_ERROR("Portfolio requires at least one member.");
+        throw std::invalid_argument("Portfolio requires at least one member.");
+    }
+
+    auto problem_stop_token = std::make_shared<StopToken>();
+    auto shared_budget = std::make_shared<SharedBudget>(input.search_budget);
+    std::vector<std::optional<SearchOutputT>> results(members.size());
+    std::mutex results_m;
+    std::condition_variable results_cv;
+    std::size_t num_finished = 0;
+    std::optional<std::size_t> winner;
+    std::size_t last_finished = 0;
+    std::exception_ptr member_exception;
+
+    std::vector<std::thread> threads;
+    threads.reserve(members.size());
+    for (std::size_t i = 0; i < members.size(); ++i) {
+        threads.emplace_back([&, i]() {
+            // Members run in place of a thread pool search thread, so they share its cores
+            cpu_affinity::pin_search_thread();
+            SearchInputT member_input = input;
+            member_input.stop_token = problem_stop_token;
+            member_input.shared_budget = shared_budget;
+            std::optional<SearchOutputT> result;
+            std::exception_ptr exception;
+            try {
+                result = members[i].algorithm(member_input);
+            } catch (...) {
+                exception = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(results_m);
+            if (exception) {
+                // Stop the other members, the exception is rethrown to the caller once they finish
+                if (!member_exception) {
+                    member_exception = exception;
+                }
+                problem_stop_token->stop();
+            } else {
+                if (result->solution_found && !winner) {
+                    winner = i;
+                    problem_stop_token->stop();
+                }
+                results[i] = std::move(result);
+                last_finished = i;
+            }
+            ++num_finished;
+            results_cv.notify_one();
+        });
+    }
+
+    // Forward external stop requests to the members while waiting for them to finish
+    {
+        std::unique_lock<std::mutex> lock(results_m);
+        while (!results_cv.wait_for(lock, POLL_INTERVAL, [&]() { return num_finished == members.size(); })) {
+            if (input.stop_token->stop_requested()) {
+                problem_stop_token->stop();
+            }
+        }
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    if (member_exception) {
+        std::rethrow_exception(member_exception);
+    }
+
+    int total_expanded = 0;
+    int total_generated = 0;
+    for (const auto &result : results) {
+        total_expanded += result->num_expanded;
+        total_generated += result->num_generated;
+    }
+    SearchOutputT output = std::move(*results[winner.value_or(last_finished)]);
+    if (winner) {
+        SPDLOG_INFO("Portfolio solved - name: {:s}, member: {:s}, total exp: {:d}", input.puzzle_name,
+                    members[*winner].name, total_expanded);
+    }
+    output.num_expanded = total_expanded;
+    output.num_generated = total_generated;
+    return output;
+}
+
+/**
+ * Wrap the members into a single search function, so the portfolio can be used anywhere a search algorithm is
+ * (i.e. run_test_levels). Note that each call uses members.size() threads.
+ */
+template <typename SearchInputT, typename SearchOutputT>
+    requires IsPortfolioInput<SearchInputT> && IsPortfolioOutput<SearchOutputT>
+auto make_portfolio(std::vector<PortfolioMember<SearchInputT, SearchOutputT>> members)
+    -> std::function<SearchOutputT(const SearchInputT &)> {
+    return [members = std::move(members)](const SearchInputT &input) { return run_portfolio(input, members); };
+}
+
+}    // namespace hpts::algorithm
+
+#endif    // HPTS_ALGORITHM_PORTFOLIO_H_
@@ -10,6 +10,7 @@
 #include <concepts>
 #include <filesystem>
 #include <functional>
+#include <iterator>
 #include <random>
 
 #include "common/logging.h"
@@ -51,14 +52,14 @@ inline void export_file_run(std::vector<std::string> solution_path_state_strs, c
     export_file.close();
 }
 
+namespace detail {
+// Test loop over all problems, where run_batch runs each batch of batch_size problems in parallel
 template <typename EnvT, typename SearchInputT, typename SearchOutputT>
     requires IsTestInput<SearchInputT> && IsTestOutput<SearchOutputT, EnvT>
-void run_test_levels(const std::vector<SearchInputT> &problems, std::function<SearchOutputT(const SearchInputT &)> algorithm,
-                     int num_threads, int search_budget, double time_budget, const std::string &output_path,
-                     std::shared_ptr<StopToken> stop_token, int max_iterations = std::numeric_limits<int>::max()) {
-    // Create thread pool
-    ThreadPool<SearchInputT, SearchOutputT> pool(num_threads);
-
+void run_test_levels(const std::vector<SearchInputT> &problems,
+                     std::function<std::vector<SearchOutputT>(const std::vector<SearchInputT> &)> run_batch,
+                     std::size_t batch_size, int search_budget, double time_budget, const std::string &output_path,
+                     std::shared_ptr<StopToken> stop_token, int max_iterations) {
     int bootstrap_iter = 0;
     int total_expanded = 0;
     int total_generated = 0;
@@ -91,9 +92,9 @@ void run_test_levels(const std::vector<SearchInputT> &problems, std::function<Se
         }
 
         std::vector<SearchInputT> unsolved_problems;
-        auto batched_input = split_to_batch(outstanding_problems, num_threads);
+        auto batched_input = split_to_batch(outstanding_problems, static_cast<int>(batch_size));
         for (const auto &batch : batched_input) {
-            std::vector<SearchOutputT> results = pool.run(algorithm, batch);
+            std::vector<SearchOutputT> results = run_batch(batch);
             for (int i = 0; i < (int)results.size(); ++i) {
                 const SearchOutputT &res = results[i];
                 metrics_tracker.add_problem_row({bootstrap_iter, res.puzzle_name, res.solution_cost, res.solution_prob,
@@ -133,6 +134,47 @@ void run_test_levels(const std::vector<SearchInputT> &problems, std::function<Se
     SPDLOG_INFO("Total time: {:.2f}(s), total exp: {:d}, total gen: {:d}, total cost: {:.2f}", duration_seconds, total_expanded,
                 total_generated, total_cost);
 }
+}    // namespace detail
+
+template <typename EnvT, typename SearchInputT, typename SearchOutputT>
+    requires IsTestInput<SearchInputT> && IsTestOutput<SearchOutputT, EnvT>
+void run_test_levels(const std::vector<SearchInputT> &problems, std::function<SearchOutputT(const SearchInputT &)> algorithm,
+                     int num_threads, int search_budget, double time_budget, const std::string &output_path,
+                     std::shared_ptr<StopToken> stop_token, int max_iterations = std::numeric_limits<int>::max()) {
+    // Create thread pool
+    ThreadPool<SearchInputT, SearchOutputT> pool(num_threads);
+    auto run_batch = [&](const std::vector<SearchInputT> &batch) { return pool.run(algorithm, batch); };
+    detail::run_test_levels<EnvT, SearchInputT, SearchOutputT>(problems, run_batch, num_threads, search_budget, time_budget,
+                                                               output_path, stop_token, max_iterations);
+}
+
+/**
+ * Test runner where each thread interleaves multiple searches, i.e. using run_interleaved
+ * @param algorithm Search function which runs all the given problems and returns the outputs in the same order
+ * @param searches_per_thread Number of problems given to each call of algorithm
+ */
+template <typename EnvT, typename SearchInputT, typename SearchOutputT>
+    requires IsTestInput<SearchInputT> && IsTestOutput<SearchOutputT, EnvT>
+void run_test_levels_interleaved(const std::vector<SearchInputT> &problems,
+                                 std::function<std::vector<SearchOutputT>(const std::vector<SearchInputT> &)> algorithm,
+                                 int num_threads, int searches_per_thread, int search_budget, double time_budget,
+                                 const std::string &output_path, std::shared_ptr<StopToken> stop_token,
+                                 int max_iterations = std::numeric_limits<int>::max()) {
+    // Create thread pool, where each job is a group of problems
+    ThreadPool<std::vector<SearchInputT>, std::vector<SearchOutputT>> pool(num_threads);
+    auto run_batch = [&](const std::vector<SearchInputT> &batch) {
+        std::vector<SearchOutputT> results;
+        results.reserve(batch.size());
+        for (auto &&group_results : pool.run(algorithm, split_to_batch(batch, searches_per_thread))) {
+            results.insert(results.end(), std::make_move_iterator(group_results.begin()),
+                           std::make_move_iterator(group_results.end()));
+        }
+        return results;
+    };
+    detail::run_test_levels<EnvT, SearchInputT, SearchOutputT>(problems, run_batch, num_threads * searches_per_thread,
+                                                               search_budget, time_budget, output_path, stop_token,
+                                                               max_iterations);
+}
 
 }    // namespace hpts::algorithm
 
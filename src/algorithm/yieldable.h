@@ -5,6 +5,8 @@
 #define HPTS_ALGORITHM_YIELDABLE_H_
 
 #include <concepts>
+#include <utility>
+#include <vector>
 
 namespace hpts::algorithm {
 
@@ -25,6 +27,15 @@ concept IsYieldable = requires(T t, const T ct) {
     { t.get_status() } -> std::same_as<Status>;
 };
 
+// Concept for searches which can hand off their inference queries to the caller
+template <typename T>
+concept IsInferenceYieldable = IsYieldable<T> && requires(T t, const T ct, std::vector<typename T::InferenceOutput> outputs) {
+    { t.set_defer_inference(true) } -> std::same_as<void>;
+    { ct.is_awaiting_inference() } -> std::same_as<bool>;
+    { t.take_inference_inputs() } -> std::same_as<std::vector<typename T::InferenceInput>>;
+    { t.set_inference_outputs(std::move(outputs)) } -> std::same_as<void>;
+};
+
 }    // namespace hpts::algorithm
 
 #endif    // HPTS_ALGORITHM_YIELDABLE_H_
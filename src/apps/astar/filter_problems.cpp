@@ -6,11 +6,15 @@
 
 #include <algorithm>
 #include <filesystem>
+#include <functional>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "algorithm/astar/astar.h"
+#include "algorithm/gbfs/gbfs.h"
+#include "algorithm/portfolio.h"
 #include "common/logging.h"
 #include "common/signaller.h"
 #include "common/state_loader.h"
@@ -26,6 +30,8 @@ constexpr std::size_t INF_SIZE_T = std::numeric_limits<std::size_t>::max();
 
 // NOLINTBEGIN
 ABSL_FLAG(std::string, environment, "", "String name of the environment");
+ABSL_FLAG(std::string, algorithm, "astar",
+          "Search algorithm used to filter (astar, gbfs), or a comma separated list to race per problem");
 ABSL_FLAG(std::size_t, max_instances, INF_SIZE_T, "Maximum number of instances from the problem file");
 ABSL_FLAG(std::string, output_path, "/opt/hpts/", "Base path to store all checkpoints and metrics");
 ABSL_FLAG(std::string, problems_path, "", "Path to problems file");
@@ -34,9 +40,9 @@ ABSL_FLAG(int, search_budget, -1, "Maximum number of expanded nodes before termi
 // NOLINTEND
 
 // Create inputs to what the search algorithm expects
-template <astar::AStarEnv EnvT>
+template <typename SearchInputT, typename EnvT>
 auto create_problems(const std::vector<EnvT> &problems, int search_budget, std::shared_ptr<StopToken> stop_token) {
-    std::vector<astar::SearchInputNoModel<EnvT>> search_inputs;
+    std::vector<SearchInputT> search_inputs;
     int problem_number = -1;
     for (const auto &problem : problems) {
         search_inputs.emplace_back(absl::StrFormat("puzzle_%d", ++problem_number), problem, search_budget, stop_token);
@@ -44,16 +50,34 @@ auto create_problems(const std::vector<EnvT> &problems, int search_budget, std::
     return search_inputs;
 }
 
-template <astar::AStarEnv EnvT>
-void templated_main(const std::string &problems_path, const std::string &output_path, std::size_t max_instances,
-                    int search_budget, std::size_t num_threads) {
+// Race the algorithms on each problem, using the A* input and output types as the common types of the portfolio
+template <typename EnvT>
+auto create_portfolio(const std::vector<std::string> &algorithms) {
     using SearchInputT = astar::SearchInputNoModel<EnvT>;
     using SearchOutputT = astar::SearchOutput<EnvT>;
+    std::vector<PortfolioMember<SearchInputT, SearchOutputT>> members;
+    for (const auto &algorithm : algorithms) {
+        if (algorithm == "astar") {
+            members.push_back({algorithm, astar::search<EnvT>});
+        } else if (algorithm == "gbfs") {
+            members.push_back(adapt_member<SearchInputT, SearchOutputT, gbfs::SearchInputNoModel<EnvT>, gbfs::SearchOutput<EnvT>>(
+                algorithm, gbfs::search<EnvT>));
+        } else {
+            SPDLOG_ERROR("Unknown algorithm type: {:s}.", algorithm);
+            std::exit(1);
+        }
+    }
+    return make_portfolio(std::move(members));
+}
 
+template <typename EnvT, typename SearchInputT, typename SearchOutputT>
+void templated_main(const std::string &problems_path, const std::string &output_path, std::size_t max_instances,
+                    int search_budget, std::size_t num_threads,
+                    std::function<SearchOutputT(const SearchInputT &)> algorithm) {
     std::shared_ptr<StopToken> stop_token = signal_installer();
 
     auto [problems, problem_strs] = load_problems<EnvT>(problems_path, max_instances);
-    auto input_problems = create_problems(problems, search_budget, stop_token);
+    auto input_problems = create_problems<SearchInputT>(problems, search_budget, stop_token);
 
     // Run search over problems
     ThreadPool<SearchInputT, SearchOutputT> pool(num_threads);
@@ -63,7 +87,7 @@ void templated_main(const std::string &problems_path, const std::string &output_
     std::size_t idx = 0;
     
     for (const auto & batch : batched_input) {
-        std::vector<SearchOutputT> results = pool.run(astar::search<EnvT>, batch);
+        std::vector<SearchOutputT> results = pool.run(algorithm, batch);
         for (auto && res : results) {
             if (res.solution_found) {
                 f << problem_strs[idx] << std::endl;
@@ -83,18 +107,35 @@ int main(int argc, char **argv) {
     const std::string output_path = absl::GetFlag(FLAGS_output_path);
     const std::string problems_path = absl::GetFlag(FLAGS_problems_path);
     const std::string environment = absl::GetFlag(FLAGS_environment);
+    const std::string algorithm = absl::GetFlag(FLAGS_algorithm);
     std::size_t max_instances = absl::GetFlag(FLAGS_max_instances);
     int search_budget = absl::GetFlag(FLAGS_search_budget);
     std::size_t num_threads = absl::GetFlag(FLAGS_num_threads);
 
     hpts::init_loggers(output_path, true);
 
-    if (environment == env::bw::BoxWorldBaseState::name) {
-        templated_main<env::bw::BoxWorldBaseState>(problems_path, output_path, max_instances, search_budget, num_threads);
-    } else {
+    using EnvT = env::bw::BoxWorldBaseState;
+    if (environment != EnvT::name) {
         SPDLOG_ERROR("Unknown environment type: {:s}.", environment);
         std::exit(1);
     }
 
+    const std::vector<std::string> algorithms = absl::StrSplit(algorithm, ',');
+    if (algorithms.size() > 1) {
+        // Each portfolio member runs on its own thread, so split the search threads between them
+        templated_main<EnvT, astar::SearchInputNoModel<EnvT>, astar::SearchOutput<EnvT>>(
+            problems_path, output_path, max_instances, search_budget,
+            std::max(num_threads / algorithms.size(), static_cast<std::size_t>(1)), create_portfolio<EnvT>(algorithms));
+    } else if (algorithm == "astar") {
+        templated_main<EnvT, astar::SearchInputNoModel<EnvT>, astar::SearchOutput<EnvT>>(
+            problems_path, output_path, max_instances, search_budget, num_threads, astar::search<EnvT>);
+    } else if (algorithm == "gbfs") {
+        templated_main<EnvT, gbfs::SearchInputNoModel<EnvT>, gbfs::SearchOutput<EnvT>>(
+            problems_path, output_path, max_instances, search_budget, num_threads, gbfs::search<EnvT>);
+    } else {
+        SPDLOG_ERROR("Unknown algorithm type: {:s}.", algorithm);
+        std::exit(1);
+    }
+
     hpts::close_loggers();
 }
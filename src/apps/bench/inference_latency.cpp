@@ -0,0 +1,153 @@
+#include <absl/flags/flag.h>
+#include <absl/flags/parse.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "common/logging.h"
+#include "common/observation.h"
+#include "common/torch_init.h"
+#include "model/policy_convnet/policy_convnet_wrapper.h"
+#include "model/twoheaded_convnet/twoheaded_convnet_wrapper.h"
+
+using namespace hpts;
+using namespace hpts::model;
+
+// NOLINTBEGIN
+ABSL_FLAG(int, seed, 0, "Seed for all sources of RNG");
+ABSL_FLAG(std::string, output_path, "/opt/hpts/", "Base path to store the logs");
+ABSL_FLAG(std::string, model_type, "twoheaded", "Model type to benchmark [policy, twoheaded]");
+ABSL_FLAG(std::vector<std::string>, devices, std::vector<std::string>({"cpu", "cpu-mkldnn"}),
+          "Comma separated list of devices to compare (e.g. cpu,cpu-mkldnn)");
+ABSL_FLAG(std::vector<std::string>, batch_sizes, std::vector<std::string>({"4", "8", "16", "32", "64", "128", "256"}),
+          "Comma separated list of inference batch sizes to time");
+ABSL_FLAG(int, channels, 16, "Number of channels of the random observations");
+ABSL_FLAG(int, height, 10, "Height of the random observations");
+ABSL_FLAG(int, width, 10, "Width of the random observations");
+ABSL_FLAG(double, density, 0.1, "Fraction of observation entries set to 1");
+ABSL_FLAG(int, num_actions, 4, "Number of actions of the policy output");
+ABSL_FLAG(int, resnet_channels, 128, "Number of channels per resnet block");
+ABSL_FLAG(int, resnet_blocks, 4, "Number of resnet blocks");
+ABSL_FLAG(int, policy_reduced_channels, 2, "Number of channels to reduce to in the policy head");
+ABSL_FLAG(int, heuristic_reduced_channels, 2, "Number of channels to reduce to in the heuristic head");
+ABSL_FLAG(std::vector<std::string>, policy_layers, std::vector<std::string>({"128"}),
+          "Comma separated list of hidden layer sizes for policy head");
+ABSL_FLAG(std::vector<std::string>, heuristic_layers, std::vector<std::string>({"128"}),
+          "Comma separated list of hidden layer sizes for heuristic head");
+ABSL_FLAG(bool, inference_bf16, false, "Whether inference runs on a bfloat16 copy of the network");
+ABSL_FLAG(int, warmup_iterations, 10, "Untimed inference calls per device and batch size");
+ABSL_FLAG(int, iterations, 100, "Timed inference calls per device and batch size");
+ABSL_FLAG(int, torch_intra_op_threads, 0, "Number of libtorch intra-op threads, <= 0 for the libtorch default");
+ABSL_FLAG(int, torch_inter_op_threads, 0, "Number of libtorch inter-op threads, <= 0 for the libtorch default");
+// NOLINTEND
+
+namespace {
+
+auto to_int_vector(const std::vector<std::string>& items) -> std::vector<int> {
+    std::vector<int> values;
+    for (const auto& item : items) {
+        values.push_back(std::stoi(item));
+    }
+    return values;
+}
+
+template <typename T>
+auto make_net_config(const ObservationShape& observation_shape) {
+    if constexpr (std::is_base_of_v<wrapper::TwoHeadedConvNetWrapperBase, T>) {
+        return wrapper::TwoHeadedConvNetConfig{observation_shape,
+                                               absl::GetFlag(FLAGS_num_actions),
+                                               absl::GetFlag(FLAGS_resnet_channels),
+                                               absl::GetFlag(FLAGS_resnet_blocks),
+                                               absl::GetFlag(FLAGS_policy_reduced_channels),
+                                               absl::GetFlag(FLAGS_heuristic_reduced_channels),
+                                               to_int_vector(absl::GetFlag(FLAGS_policy_layers)),
+                                               to_int_vector(absl::GetFlag(FLAGS_heuristic_layers)),
+                                               false,
+                                               absl::GetFlag(FLAGS_inference_bf16)};
+    } else {
+        return wrapper::PolicyConvNetConfig{observation_shape,
+                                            absl::GetFlag(FLAGS_num_actions),
+                                            absl::GetFlag(FLAGS_resnet_channels),
+                                            absl::GetFlag(FLAGS_resnet_blocks),
+                                            absl::GetFlag(FLAGS_policy_reduced_channels),
+                                            to_int_vector(absl::GetFlag(FLAGS_policy_layers)),
+                                            false,
+                                            absl::GetFlag(FLAGS_inference_bf16)};
+    }
+}
+
+// Time the full Inference call (packing, forward pass and output copies) per batch, as seen by the searches
+template <typename ModelWrapperT>
+void run_benchmark() {
+    using InferenceInputT = typename ModelWrapperT::InferenceInput;
+    const ObservationShape observation_shape(absl::GetFlag(FLAGS_channels), absl::GetFlag(FLAGS_height),
+                                             absl::GetFlag(FLAGS_width));
+    const std::vector<int> batch_sizes = to_int_vector(absl::GetFlag(FLAGS_batch_sizes));
+    const int max_batch_size = *std::max_element(batch_sizes.begin(), batch_sizes.end());
+    const int warmup_iterations = absl::GetFlag(FLAGS_warmup_iterations);
+    const int iterations = std::max(absl::GetFlag(FLAGS_iterations), 1);
+
+    std::mt19937 rng(static_cast<std::mt19937::result_type>(absl::GetFlag(FLAGS_seed)));
+    std::bernoulli_distribution active(absl::GetFlag(FLAGS_density));
+    std::vector<InferenceInputT> inputs;
+    for (int i = 0; i < max_batch_size; ++i) {
+        Observation observation(static_cast<std::size_t>(observation_shape.flat_size()));
+        std::generate(observation.begin(), observation.end(), [&]() { return active(rng) ? 1.0F : 0.0F; });
+        inputs.push_back({std::move(observation)});
+    }
+
+    for (const auto& device : absl::GetFlag(FLAGS_devices)) {
+        ModelWrapperT model(make_net_config<ModelWrapperT>(observation_shape), 0, 0, device, absl::GetFlag(FLAGS_output_path));
+        for (const auto& batch_size : batch_sizes) {
+            std::vector<InferenceInputT> batch(inputs.begin(), inputs.begin() + batch_size);
+            for (int i = 0; i < warmup_iterations; ++i) {
+                (void)model.Inference(batch);
+            }
+            std::vector<double> latencies;
+            for (int i = 0; i < iterations; ++i) {
+                const auto start = std::chrono::steady_clock::now();
+                (void)model.Inference(batch);
+                latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+            }
+            std::sort(latencies.begin(), latencies.end());
+            double mean = 0;
+            for (const auto& latency : latencies) {
+                mean += latency / static_cast<double>(latencies.size());
+            }
+            SPDLOG_INFO("device: {:s}, batch: {:d}, mean: {:.1f}us, p50: {:.1f}us, p90: {:.1f}us, per input: {:.2f}us",
+                        device, batch_size, mean, latencies[latencies.size() / 2], latencies[latencies.size() * 9 / 10],
+                        mean / batch_size);
+        }
+    }
+}
+
+}    // namespace
+
+int main(int argc, char** argv) {
+    absl::ParseCommandLine(argc, argv);
+    const std::string output_path = absl::GetFlag(FLAGS_output_path);
+    const std::string model_type = absl::GetFlag(FLAGS_model_type);
+
+    std::filesystem::create_directories(output_path);
+    hpts::init_torch(absl::GetFlag(FLAGS_seed));
+    hpts::init_loggers(output_path, false, "_inference_latency");
+    hpts::log_flags(argc, argv);
+    hpts::init_torch_threads(absl::GetFlag(FLAGS_torch_intra_op_threads), absl::GetFlag(FLAGS_torch_inter_op_threads));
+
+    if (model_type == wrapper::PolicyConvNetWrapperBase::ModelType) {
+        run_benchmark<wrapper::PolicyConvNetWrapperLevin>();
+    } else if (model_type == wrapper::TwoHeadedConvNetWrapperBase::ModelType) {
+        run_benchmark<wrapper::TwoHeadedConvNetWrapperLevin>();
+    } else {
+        SPDLOG_ERROR("Unknown model type: {:s}.", model_type);
+        std::exit(1);
+    }
+
+    hpts::close_loggers();
+}
@@ -0,0 +1,147 @@
+#include <absl/flags/flag.h>
+#include <absl/flags/parse.h>
+#include <absl/strings/str_format.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "algorithm/phs/phs.h"
+#include "common/logging.h"
+#include "common/state_loader.h"
+#include "env/boxworld/boxworld_base.h"
+#include "env/craftworld/craftworld_base.h"
+#include "env/rnd/rnd_base.h"
+#include "env/rnd/rnd_simple.h"
+#include "env/sokoban/sokoban_base.h"
+#include "model/replay_evaluator.h"
+#include "util/stop_token.h"
+#include "util/thread_pool.h"
+
+using namespace hpts;
+using namespace hpts::model;
+using namespace hpts::algorithm;
+using namespace hpts::env;
+
+constexpr std::size_t INF_SIZE_T = std::numeric_limits<std::size_t>::max();
+
+// NOLINTBEGIN
+ABSL_FLAG(std::string, environment, "", "String name of the environment");
+ABSL_FLAG(std::string, model_type, "twoheaded", "Model type of the recorded run [policy, twoheaded]");
+ABSL_FLAG(std::string, problems_path, "", "Path to problems file, the same as the recorded run");
+ABSL_FLAG(std::size_t, max_instances, INF_SIZE_T, "Maximum number of instances from the problem file");
+ABSL_FLAG(std::string, record_path, "",
+          "Path to the inference record saved by phs with --inference_record_path, without async inference or portfolio");
+ABSL_FLAG(std::string, output_path, "/opt/hpts/", "Base path to store the logs");
+ABSL_FLAG(int, search_budget, -1, "Maximum number of expanded nodes before termination, the same as the recorded run");
+ABSL_FLAG(std::size_t, inference_batch_size, 32,
+          "Number of search expansions to batch per inference query, the same as the recorded run");
+ABSL_FLAG(std::size_t, block_allocation_size, 2000, "Size used for each block for node allocation");
+ABSL_FLAG(double, mix_epsilon, 0, "Percentage to mix with uniform policy, the same as the recorded run");
+ABSL_FLAG(std::size_t, num_threads_search, 1, "Number of threads to run in the search thread pool");
+ABSL_FLAG(int, repeats, 3, "Number of timed passes over all problems");
+// NOLINTEND
+
+namespace {
+
+// Time full passes of PHS over the problems, with every inference request served from the record
+template <env::SimpleEnv EnvT, typename ModelWrapperT>
+void templated_main() {
+    using ReplayEvaluatorT = ReplayEvaluator<ModelWrapperT>;
+    using SearchInputT = phs::SearchInput<EnvT, ReplayEvaluatorT>;
+    using SearchOutputT = phs::SearchOutput<EnvT>;
+
+    auto [problems, _] = load_problems<EnvT>(absl::GetFlag(FLAGS_problems_path), absl::GetFlag(FLAGS_max_instances));
+    const auto model_eval = std::make_shared<ReplayEvaluatorT>(absl::GetFlag(FLAGS_record_path));
+    model_eval->print();
+
+    phs::INFERENCE_BATCH_SIZE = absl::GetFlag(FLAGS_inference_batch_size);
+    phs::BLOCK_ALLOCATION_SIZE = absl::GetFlag(FLAGS_block_allocation_size);
+    phs::MIX_EPSILON = absl::GetFlag(FLAGS_mix_epsilon);
+    // Records are only made without async inference, whose expansion order depends on inference timing
+    phs::ASYNC_INFERENCE = false;
+
+    const auto stop_token = std::make_shared<StopToken>();
+    std::vector<SearchInputT> search_inputs;
+    int problem_number = -1;
+    for (const auto& problem : problems) {
+        search_inputs.emplace_back(absl::StrFormat("puzzle_%d", ++problem_number), problem, absl::GetFlag(FLAGS_search_budget),
+                                   stop_token, model_eval);
+    }
+
+    ThreadPool<SearchInputT, SearchOutputT> pool(absl::GetFlag(FLAGS_num_threads_search));
+    long long int first_expanded = -1;
+    double best_rate = 0;
+    for (int repeat = 0; repeat < absl::GetFlag(FLAGS_repeats); ++repeat) {
+        const auto start = std::chrono::steady_clock::now();
+        const auto results = pool.run(phs::search<EnvT, ReplayEvaluatorT>, search_inputs);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        long long int expanded = 0;
+        long long int generated = 0;
+        int solved = 0;
+        for (const auto& result : results) {
+            expanded += result.num_expanded;
+            generated += result.num_generated;
+            solved += static_cast<int>(result.solution_found);
+        }
+        // Replayed searches are deterministic, so differing work between passes means the search itself changed
+        if (first_expanded >= 0 && expanded != first_expanded) {
+            SPDLOG_WARN("Pass {:d} expanded {:d} nodes, but the first pass expanded {:d}.", repeat, expanded, first_expanded);
+        }
+        first_expanded = first_expanded < 0 ? expanded : first_expanded;
+        best_rate = std::max(best_rate, static_cast<double>(expanded) / seconds);
+        SPDLOG_INFO("Pass {:d} - solved: {:d}/{:d}, expanded: {:d}, generated: {:d}, time: {:.3f}s, expanded/s: {:.0f}, "
+                    "generated/s: {:.0f}",
+                    repeat, solved, results.size(), expanded, generated, seconds, static_cast<double>(expanded) / seconds,
+                    static_cast<double>(generated) / seconds);
+    }
+    SPDLOG_INFO("Best expanded/s: {:.0f}", best_rate);
+}
+
+// Replayed outputs only depend on the model type, so the loss type of the recorded run doesn't matter
+template <env::SimpleEnv EnvT>
+void templated_model_selection(const std::string& model_type) {
+    if (model_type == wrapper::PolicyConvNetWrapperBase::ModelType) {
+        templated_main<EnvT, wrapper::PolicyConvNetWrapperLevin>();
+    } else if (model_type == wrapper::TwoHeadedConvNetWrapperBase::ModelType) {
+        templated_main<EnvT, wrapper::TwoHeadedConvNetWrapperLevin>();
+    } else {
+        SPDLOG_ERROR("Unknown model type: {:s}.", model_type);
+        std::exit(1);
+    }
+}
+
+}    // namespace
+
+int main(int argc, char** argv) {
+    absl::ParseCommandLine(argc, argv);
+    const std::string output_path = absl::GetFlag(FLAGS_output_path);
+    const std::string environment = absl::GetFlag(FLAGS_environment);
+    const std::string model_type = absl::GetFlag(FLAGS_model_type);
+
+    std::filesystem::create_directories(output_path);
+    hpts::init_loggers(output_path, false, "_search_replay");
+    hpts::log_flags(argc, argv);
+
+    if (environment == rnd::RNDBaseState::name) {
+        templated_model_selection<rnd::RNDBaseState>(model_type);
+    } else if (environment == rnd::RNDSimpleState::name) {
+        templated_model_selection<rnd::RNDSimpleState>(model_type);
+    } else if (environment == sokoban::SokobanBaseState::name) {
+        templated_model_selection<sokoban::SokobanBaseState>(model_type);
+    } else if (environment == cw::CraftWorldBaseState::name) {
+        templated_model_selection<cw::CraftWorldBaseState>(model_type);
+    } else if (environment == bw::BoxWorldBaseState::name) {
+        templated_model_selection<bw::BoxWorldBaseState>(model_type);
+    } else {
+        SPDLOG_ERROR("Unknown environment type: {:s}.", environment);
+        std::exit(1);
+    }
+
+    hpts::close_loggers();
+}
@@ -0,0 +1,265 @@
+#include <absl/flags/flag.h>
+#include <absl/flags/parse.h>
+#include <absl/strings/str_format.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
+
+#include "common/logging.h"
+#include "common/observation.h"
+#include "common/state_loader.h"
+#include "common/torch_init.h"
+#include "env/boxworld/boxworld_base.h"
+#include "env/craftworld/craftworld_base.h"
+#include "env/rnd/rnd_base.h"
+#include "env/rnd/rnd_simple.h"
+#include "env/simple_env.h"
+#include "env/sokoban/sokoban_base.h"
+#include "model/checkpoint_writer.h"
+#include "model/policy_convnet/policy_convnet_wrapper.h"
+#include "model/twoheaded_convnet/twoheaded_convnet_wrapper.h"
+#include "util/utility.h"
+
+using namespace hpts;
+using namespace hpts::model;
+using namespace hpts::env;
+
+constexpr std::size_t INF_SIZE_T = std::numeric_limits<std::size_t>::max();
+
+// NOLINTBEGIN
+ABSL_FLAG(int, seed, 0, "Seed for all sources of RNG");
+ABSL_FLAG(std::string, environment, "", "String name of the environment");
+ABSL_FLAG(std::string, model_type, "twoheaded", "Model type of the teacher and student [policy, twoheaded]");
+ABSL_FLAG(std::string, problems_path, "", "Path to problems file the distillation observations are collected from");
+ABSL_FLAG(std::size_t, max_instances, INF_SIZE_T, "Maximum number of instances from the problem file");
+ABSL_FLAG(std::string, output_path, "/opt/hpts/", "Base path to store the student checkpoint and logs");
+ABSL_FLAG(std::string, device, "cpu", "Device to run the teacher and train the student on");
+ABSL_FLAG(std::string, teacher_checkpoint, "", "Path to the teacher checkpoint, without the .pt extension");
+ABSL_FLAG(int, teacher_resnet_channels, 128, "Number of channels per resnet block of the teacher");
+ABSL_FLAG(int, teacher_resnet_blocks, 4, "Number of resnet blocks of the teacher");
+ABSL_FLAG(int, student_resnet_channels, 32, "Number of channels per resnet block of the student");
+ABSL_FLAG(int, student_resnet_blocks, 1, "Number of resnet blocks of the student");
+ABSL_FLAG(bool, compress, false,
+          "Initialize the student by compressing the teacher, keeping the teacher resnet sizes over the student ones");
+ABSL_FLAG(int, resnet_bottleneck_channels, 0, "Channels between the resnet block convolutions of the student, 0 for none");
+ABSL_FLAG(int, mlp_rank, 0, "Rank the MLP layers of the student are factored through, 0 for none");
+ABSL_FLAG(int, policy_reduced_channels, 2, "Number of channels to reduce to in the policy head, shared by both models");
+ABSL_FLAG(int, heuristic_reduced_channels, 2, "Number of channels to reduce to in the heuristic head, shared by both models");
+ABSL_FLAG(std::vector<std::string>, policy_layers, std::vector<std::string>({"128"}),
+          "Comma separated list of hidden layer sizes for policy head, shared by both models");
+ABSL_FLAG(std::vector<std::string>, heuristic_layers, std::vector<std::string>({"128"}),
+          "Comma separated list of hidden layer sizes for heuristic head, shared by both models");
+ABSL_FLAG(bool, use_batch_norm, false, "Flag to use batch norm, shared by both models");
+ABSL_FLAG(std::size_t, rollouts_per_problem, 8, "Number of random walks started from each problem to collect observations");
+ABSL_FLAG(std::size_t, rollout_depth, 32, "Maximum number of actions taken per random walk");
+ABSL_FLAG(std::size_t, inference_batch_size, 256, "Batch size used when querying the teacher for soft targets");
+ABSL_FLAG(std::size_t, learning_batch_size, 256, "Batch size used for student updates");
+ABSL_FLAG(std::size_t, num_epochs, 10, "Number of passes over the collected observations, 0 to only compress");
+ABSL_FLAG(double, learning_rate, 3e-4, "The learning rate for the student");
+ABSL_FLAG(double, weight_decay, 1e-4, "L2 weight decay regularization for the student");
+// NOLINTEND
+
+namespace {
+
+auto to_int_vector(const std::vector<std::string>& items) -> std::vector<int> {
+    std::vector<int> values;
+    for (const auto& item : items) {
+        values.push_back(std::stoi(item));
+    }
+    return values;
+}
+
+// Net config for either model type, only the trunk size and compression differ between the teacher and the student
+template <typename T>
+auto make_net_config(const ObservationShape& observation_shape, int num_actions, int resnet_channels, int resnet_blocks,
+                     int resnet_bottleneck_channels = 0, int mlp_rank = 0) {
+    if constexpr (std::is_base_of_v<wrapper::TwoHeadedConvNetWrapperBase, T>) {
+        return wrapper::TwoHeadedConvNetConfig{observation_shape,
+                                               num_actions,
+                                               resnet_channels,
+                                               resnet_blocks,
+                                               absl::GetFlag(FLAGS_policy_reduced_channels),
+                                               absl::GetFlag(FLAGS_heuristic_reduced_channels),
+                                               to_int_vector(absl::GetFlag(FLAGS_policy_layers)),
+                                               to_int_vector(absl::GetFlag(FLAGS_heuristic_layers)),
+                                               absl::GetFlag(FLAGS_use_batch_norm),
+                                               false,
+                                               0,
+                                               resnet_bottleneck_channels,
+                                               mlp_rank};
+    } else {
+        return wrapper::PolicyConvNetConfig{observation_shape,
+                                            num_actions,
+                                            resnet_channels,
+                                            resnet_blocks,
+                                            absl::GetFlag(FLAGS_policy_reduced_channels),
+                                            to_int_vector(absl::GetFlag(FLAGS_policy_layers)),
+                                            absl::GetFlag(FLAGS_use_batch_norm),
+                                            false,
+                                            0,
+                                            resnet_bottleneck_channels,
+                                            mlp_rank};
+    }
+}
+
+// Collect unique observations by random walks from each problem, covering states the searches reach from the start
+template <SimpleEnv EnvT>
+auto collect_observations(const std::vector<EnvT>& problems, std::size_t rollouts_per_problem, std::size_t rollout_depth,
+                          std::mt19937& rng) -> std::vector<Observation> {
+    std::vector<Observation> observations;
+    std::unordered_set<uint64_t> seen;
+    for (const auto& problem : problems) {
+        for (std::size_t rollout = 0; rollout < rollouts_per_problem; ++rollout) {
+            EnvT state = problem;
+            for (std::size_t depth = 0; depth <= rollout_depth; ++depth) {
+                if (seen.insert(state.get_hash()).second) {
+                    observations.push_back(state.get_observation());
+                }
+                const auto& actions = state.child_actions();
+                if (state.is_solution() || state.is_terminal() || actions.empty()) {
+                    break;
+                }
+                std::uniform_int_distribution<std::size_t> dist(0, actions.size() - 1);
+                state.apply_action(actions[dist(rng)]);
+            }
+        }
+    }
+    return observations;
+}
+
+template <SimpleEnv EnvT, typename ModelWrapperT>
+void templated_main() {
+    using LearningInputT = typename ModelWrapperT::LearningInput;
+    using InferenceInputT = typename ModelWrapperT::InferenceInput;
+    const std::string output_path = absl::GetFlag(FLAGS_output_path);
+    const std::string device = absl::GetFlag(FLAGS_device);
+    const std::size_t inference_batch_size = std::max(absl::GetFlag(FLAGS_inference_batch_size), static_cast<std::size_t>(1));
+    const std::size_t learning_batch_size = std::max(absl::GetFlag(FLAGS_learning_batch_size), static_cast<std::size_t>(1));
+    std::mt19937 rng(static_cast<std::mt19937::result_type>(absl::GetFlag(FLAGS_seed)));
+
+    auto [problems, _] = load_problems<EnvT>(absl::GetFlag(FLAGS_problems_path), absl::GetFlag(FLAGS_max_instances));
+    if (problems.empty()) {
+        SPDLOG_ERROR("No problems loaded from {:s}.", absl::GetFlag(FLAGS_problems_path));
+        std::exit(1);
+    }
+    const ObservationShape observation_shape = problems[0].observation_shape();
+    const bool compress = absl::GetFlag(FLAGS_compress);
+    const std::size_t num_epochs = absl::GetFlag(FLAGS_num_epochs);
+    if (compress && absl::GetFlag(FLAGS_resnet_bottleneck_channels) > absl::GetFlag(FLAGS_teacher_resnet_channels)) {
+        SPDLOG_ERROR("Bottleneck channels {:d} must not exceed the teacher resnet channels {:d}.",
+                     absl::GetFlag(FLAGS_resnet_bottleneck_channels), absl::GetFlag(FLAGS_teacher_resnet_channels));
+        std::exit(1);
+    }
+
+    ModelWrapperT teacher(make_net_config<ModelWrapperT>(observation_shape, EnvT::num_actions,
+                                                         absl::GetFlag(FLAGS_teacher_resnet_channels),
+                                                         absl::GetFlag(FLAGS_teacher_resnet_blocks)),
+                          0, 0, device, output_path);
+    teacher.LoadCheckpointWithoutOptimizer(absl::GetFlag(FLAGS_teacher_checkpoint));
+
+    // A compressed student keeps the teacher trunk, pruned and factored from the teacher weights
+    ModelWrapperT student(
+        make_net_config<ModelWrapperT>(
+            observation_shape, EnvT::num_actions,
+            compress ? absl::GetFlag(FLAGS_teacher_resnet_channels) : absl::GetFlag(FLAGS_student_resnet_channels),
+            compress ? absl::GetFlag(FLAGS_teacher_resnet_blocks) : absl::GetFlag(FLAGS_student_resnet_blocks),
+            absl::GetFlag(FLAGS_resnet_bottleneck_channels), absl::GetFlag(FLAGS_mlp_rank)),
+        absl::GetFlag(FLAGS_learning_rate), absl::GetFlag(FLAGS_weight_decay), device, output_path);
+    if (compress) {
+        student.CompressFrom(teacher);
+    }
+    teacher.print();
+    student.print();
+
+    // Soft targets from the teacher, computed once as the teacher is frozen
+    std::vector<LearningInputT> targets;
+    if (num_epochs > 0) {
+        const std::vector<Observation> observations = collect_observations(
+            problems, absl::GetFlag(FLAGS_rollouts_per_problem), absl::GetFlag(FLAGS_rollout_depth), rng);
+        SPDLOG_INFO("Collected {:d} unique observations from {:d} problems.", observations.size(), problems.size());
+        targets.reserve(observations.size());
+        for (std::size_t start = 0; start < observations.size(); start += inference_batch_size) {
+            const std::size_t end = std::min(start + inference_batch_size, observations.size());
+            std::vector<InferenceInputT> inference_inputs;
+            for (std::size_t i = start; i < end; ++i) {
+                inference_inputs.push_back({observations[i]});
+            }
+            const auto inference_outputs = teacher.Inference(inference_inputs);
+            for (std::size_t i = start; i < end; ++i) {
+                const auto& output = inference_outputs[i - start];
+                std::vector<float> target_policy(output.policy.begin(), output.policy.end());
+                if constexpr (std::is_base_of_v<wrapper::TwoHeadedConvNetWrapperBase, ModelWrapperT>) {
+                    targets.push_back({observations[i], std::move(target_policy), output.heuristic});
+                } else {
+                    targets.push_back({observations[i], std::move(target_policy)});
+                }
+            }
+        }
+    }
+
+    for (std::size_t epoch = 0; epoch < num_epochs; ++epoch) {
+        std::shuffle(targets.begin(), targets.end(), rng);
+        double total_loss = 0;
+        std::size_t num_batches = 0;
+        for (auto&& batch : split_to_batch(targets, static_cast<int>(learning_batch_size))) {
+            total_loss += student.Learn(batch);
+            ++num_batches;
+        }
+        num_batches = std::max(num_batches, static_cast<std::size_t>(1));
+        SPDLOG_INFO("Epoch {:d} - loss: {:.6f}", epoch, total_loss / static_cast<double>(num_batches));
+    }
+
+    // Saved as the default checkpoint so the search apps load it with the student sizes and --checkpoint_to_load=-1
+    // (compressed students also need --resnet_bottleneck_channels and --mlp_rank)
+    student.SaveCheckpointWithoutOptimizer();
+    checkpoint_writer::flush();
+}
+
+template <SimpleEnv EnvT>
+void templated_model_selection(const std::string& model_type) {
+    if (model_type == wrapper::PolicyConvNetWrapperBase::ModelType) {
+        templated_main<EnvT, wrapper::PolicyConvNetWrapperDistill>();
+    } else if (model_type == wrapper::TwoHeadedConvNetWrapperBase::ModelType) {
+        templated_main<EnvT, wrapper::TwoHeadedConvNetWrapperDistill>();
+    } else {
+        SPDLOG_ERROR("Unknown model type: {:s}.", model_type);
+        std::exit(1);
+    }
+}
+
+}    // namespace
+
+int main(int argc, char** argv) {
+    absl::ParseCommandLine(argc, argv);
+    const std::string output_path = absl::GetFlag(FLAGS_output_path);
+    const std::string environment = absl::GetFlag(FLAGS_environment);
+    const std::string model_type = absl::GetFlag(FLAGS_model_type);
+
+    std::filesystem::create_directories(output_path);
+    hpts::init_torch(absl::GetFlag(FLAGS_seed));
+    hpts::init_loggers(output_path, false, "_distill");
+    hpts::log_flags(argc, argv);
+
+    if (environment == rnd::RNDBaseState::name) {
+        templated_model_selection<rnd::RNDBaseState>(model_type);
+    } else if (environment == rnd::RNDSimpleState::name) {
+        templated_model_selection<rnd::RNDSimpleState>(model_type);
+    } else if (environment == sokoban::SokobanBaseState::name) {
+        templated_model_selection<sokoban::SokobanBaseState>(model_type);
+    } else if (environment == cw::CraftWorldBaseState::name) {
+        templated_model_selection<cw::CraftWorldBaseState>(model_type);
+    } else if (environment == bw::BoxWorldBaseState::name) {
+        templated_model_selection<bw::BoxWorldBaseState>(model_type);
+    } else {
+        SPDLOG_ERROR("Unknown environment type: {:s}.", environment);
+        std::exit(1);
+    }
+
+    hpts::close_loggers();
+}
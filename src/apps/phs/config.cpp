@@ -23,17 +23,38 @@ ABSL_FLAG(std::size_t, num_train, INF_SIZE_T, "Number of instances of the max to
 ABSL_FLAG(std::size_t, num_validate, INF_SIZE_T, "Number of instances of the max to use for validation");
 ABSL_FLAG(double, validation_solved_ratio, 1, "Percentage of validation set to solve before checkpointing");
 ABSL_FLAG(std::string, output_path, "/opt/hpts/", "Base path to store all checkpoints and metrics");
-ABSL_FLAG(std::string, devices, "cpu", "Comma separated list of devices to use to train and run inference (e.g. cuda:0)");
+ABSL_FLAG(std::string, devices, "cpu",
+          "Comma separated list of devices to use to train and run inference (e.g. cuda:0, or cpu:0-7,cpu:8-15 for pinned "
+          "CPU replicas, or cpu-mkldnn[:cores] for channels-last oneDNN CPU inference)");
 ABSL_FLAG(int, search_budget, -1, "Maximum number of expanded nodes before termination");
 ABSL_FLAG(double, time_budget, INF_D, "Budget in seconds before terminating training/testing procedure");
 ABSL_FLAG(int, max_iterations, INF_I, "Budget in number of iterations before terminating training/testing procedure");
 ABSL_FLAG(long long int, checkpoint_expansions_interval, INF_LLI, "Interval in number of expansions to checkpoint the model");
 ABSL_FLAG(long long int, checkpoint_to_load, -1, "Checkpoint number to load, used in testing");
 ABSL_FLAG(std::size_t, num_threads_search, 1, "Number of threads to run in the search thread pool");
+ABSL_FLAG(std::string, search_cores, "", "Core list (e.g. 16-31) to pin search threads to, empty for no pinning");
+ABSL_FLAG(int, torch_intra_op_threads, 0, "Number of libtorch intra-op threads, <= 0 for the libtorch default");
+ABSL_FLAG(int, torch_inter_op_threads, 0, "Number of libtorch inter-op threads, <= 0 for the libtorch default");
+ABSL_FLAG(std::size_t, searches_per_thread, 1, "Number of searches each thread interleaves, sharing inference batches");
 ABSL_FLAG(std::size_t, bootstrap_batch_multiplier, 1, "Multiple of jobs used as a batch to train on");
 ABSL_FLAG(std::size_t, inference_batch_size, 32, "Number of search expansions to batch per inference query");
+ABSL_FLAG(bool, async_inference, false, "Whether searches keep expanding while their inference batch is running");
+ABSL_FLAG(std::size_t, inference_max_batch_size, 1024, "Maximum number of inputs the evaluator batches across searches");
+ABSL_FLAG(int, inference_max_wait_us, 1000, "Maximum microseconds the evaluator waits for more requests to batch");
+ABSL_FLAG(bool, adaptive_inference, false, "Whether the evaluator tunes its batch size and wait time (up to the maximums)");
+ABSL_FLAG(int, inference_latency_cap_us, 0, "Mean inference request latency in microseconds the tuner keeps under, 0 for none");
+ABSL_FLAG(std::size_t, inference_tuner_window, 64, "Number of inference batches the tuner measures per decision");
+ABSL_FLAG(std::string, inference_record_path, "",
+          "Path to record all inference outputs to in test mode, for search_replay (requires no async_inference or portfolio)");
+ABSL_FLAG(int, cascade_resnet_blocks, 0, "Resnet blocks of the small cascade model run before the full model, 0 to disable");
+ABSL_FLAG(int, cascade_resnet_channels, 0, "Resnet channels of the small cascade model, 0 to use resnet_channels");
+ABSL_FLAG(double, cascade_entropy_threshold, 0.5, "Cascade policy entropy (nats) above which the full model is used");
 ABSL_FLAG(std::size_t, block_allocation_size, 2000, "Size used for each block for node allocation");
 ABSL_FLAG(double, mix_epsilon, 0, "Percentage to mix with uniform policy");
+ABSL_FLAG(std::vector<std::string>, portfolio_mix_epsilons, std::vector<std::string>({}),
+          "Comma separated list of mix epsilons to race per problem in test mode");
+ABSL_FLAG(std::vector<std::string>, portfolio_inference_batch_sizes, std::vector<std::string>({}),
+          "Comma separated list of inference batch sizes to race per problem in test mode");
 ABSL_FLAG(std::size_t, learning_batch_size, 256, "Batch size used for model updates");
 ABSL_FLAG(std::size_t, buffer_capacity, 10000, "Max size for the learning buffer");
 // Model and learning flags
@@ -53,6 +74,11 @@ ABSL_FLAG(std::string, loss_type, "policy_gradient", "Loss type, one of [levin,
 ABSL_FLAG(double, base_reward, 1.0, "Base reward for policy gradient loss function");
 ABSL_FLAG(double, discount, 0.997, "Discount factor for policy gradient loss function");
 ABSL_FLAG(bool, batch_norm, false, "Whether to use batch norm in the ResNet architecture");
+ABSL_FLAG(bool, inference_bf16, false, "Whether search-time inference runs on a bfloat16 copy of the network");
+ABSL_FLAG(int, sparse_input_planes, 0,
+          "Max active channels per cell to send binary inference inputs as channel indices, 0 to send the dense planes");
+ABSL_FLAG(int, resnet_bottleneck_channels, 0, "Channels between the resnet block convolutions of a pruned model, 0 for none");
+ABSL_FLAG(int, mlp_rank, 0, "Rank the MLP layers of a compressed model are factored through, 0 for none");
 // NOLINTEND
 
 namespace hpts {
@@ -84,10 +110,26 @@ std::ostream &operator<<(std::ostream &os, const Config &config) {
                               : std::to_string(config.checkpoint_expansions_intervial));
     os << absl::StrFormat("\tcheckpoint_to_load: %d\n", config.checkpoint_to_load);
     os << absl::StrFormat("\tnum_threads_search: %d\n", config.num_threads_search);
+    os << absl::StrFormat("\tsearch_cores: %s\n", config.search_cores);
+    os << absl::StrFormat("\ttorch_intra_op_threads: %d\n", config.torch_intra_op_threads);
+    os << absl::StrFormat("\ttorch_inter_op_threads: %d\n", config.torch_inter_op_threads);
+    os << absl::StrFormat("\tsearches_per_thread: %d\n", config.searches_per_thread);
     os << absl::StrFormat("\tbootstrap_batch_multiplier: %d\n", config.bootstrap_batch_multiplier);
     os << absl::StrFormat("\tinference_batch_size: %d\n", config.inference_batch_size);
+    os << absl::StrFormat("\tasync_inference: %d\n", config.async_inference);
+    os << absl::StrFormat("\tinference_max_batch_size: %d\n", config.inference_max_batch_size);
+    os << absl::StrFormat("\tinference_max_wait_us: %d\n", config.inference_max_wait_us);
+    os << absl::StrFormat("\tadaptive_inference: %d\n", config.adaptive_inference);
+    os << absl::StrFormat("\tinference_latency_cap_us: %d\n", config.inference_latency_cap_us);
+    os << absl::StrFormat("\tinference_tuner_window: %d\n", config.inference_tuner_window);
+    os << absl::StrFormat("\tinference_record_path: %s\n", config.inference_record_path);
+    os << absl::StrFormat("\tcascade_resnet_blocks: %d\n", config.cascade_resnet_blocks);
+    os << absl::StrFormat("\tcascade_resnet_channels: %d\n", config.cascade_resnet_channels);
+    os << absl::StrFormat("\tcascade_entropy_threshold: %f\n", config.cascade_entropy_threshold);
     os << absl::StrFormat("\tblock_allocation_size: %d\n", config.block_allocation_size);
     os << absl::StrFormat("\tmix_epsilon: %f\n", config.mix_epsilon);
+    os << absl::StrFormat("\tportfolio_mix_epsilons: %s\n", vec_to_str(config.portfolio_mix_epsilons));
+    os << absl::StrFormat("\tportfolio_inference_batch_sizes: %s\n", vec_to_str(config.portfolio_inference_batch_sizes));
     os << absl::StrFormat("\tlearning_batch_size: %d\n", config.learning_batch_size);
     os << absl::StrFormat("\tbuffer_capacity: %d\n", config.buffer_capacity);
 
@@ -105,6 +147,10 @@ std::ostream &operator<<(std::ostream &os, const Config &config) {
     os << absl::StrFormat("\tbase_reward: %f\n", config.base_reward);
     os << absl::StrFormat("\tdiscount: %f\n", config.discount);
     os << absl::StrFormat("\tbatch_norm: %d\n", config.use_batch_norm);
+    os << absl::StrFormat("\tinference_bf16: %d\n", config.inference_bf16);
+    os << absl::StrFormat("\tsparse_input_planes: %d\n", config.sparse_input_planes);
+    os << absl::StrFormat("\tresnet_bottleneck_channels: %d\n", config.resnet_bottleneck_channels);
+    os << absl::StrFormat("\tmlp_rank: %d\n", config.mlp_rank);
     return os;
 }
 
@@ -127,10 +173,32 @@ Config parse_flags(int argc, char **argv) {
     config.checkpoint_to_load = absl::GetFlag(FLAGS_checkpoint_to_load);
     config.time_budget = std::min(absl::GetFlag(FLAGS_time_budget), MAX_TIME);
     config.num_threads_search = absl::GetFlag(FLAGS_num_threads_search);
+    config.search_cores = absl::GetFlag(FLAGS_search_cores);
+    config.torch_intra_op_threads = absl::GetFlag(FLAGS_torch_intra_op_threads);
+    config.torch_inter_op_threads = absl::GetFlag(FLAGS_torch_inter_op_threads);
+    config.searches_per_thread = std::max(absl::GetFlag(FLAGS_searches_per_thread), static_cast<std::size_t>(1));
     config.bootstrap_batch_multiplier = absl::GetFlag(FLAGS_bootstrap_batch_multiplier);
     config.inference_batch_size = absl::GetFlag(FLAGS_inference_batch_size);
+    config.async_inference = absl::GetFlag(FLAGS_async_inference);
+    config.inference_max_batch_size = absl::GetFlag(FLAGS_inference_max_batch_size);
+    config.inference_max_wait_us = absl::GetFlag(FLAGS_inference_max_wait_us);
+    config.adaptive_inference = absl::GetFlag(FLAGS_adaptive_inference);
+    config.inference_latency_cap_us = absl::GetFlag(FLAGS_inference_latency_cap_us);
+    config.inference_tuner_window = absl::GetFlag(FLAGS_inference_tuner_window);
+    config.inference_record_path = absl::GetFlag(FLAGS_inference_record_path);
+    config.cascade_resnet_blocks = absl::GetFlag(FLAGS_cascade_resnet_blocks);
+    config.cascade_resnet_channels = absl::GetFlag(FLAGS_cascade_resnet_channels);
+    config.cascade_entropy_threshold = absl::GetFlag(FLAGS_cascade_entropy_threshold);
     config.block_allocation_size = absl::GetFlag(FLAGS_block_allocation_size);
     config.mix_epsilon = absl::GetFlag(FLAGS_mix_epsilon);
+    config.portfolio_mix_epsilons.clear();
+    for (const auto &r : absl::GetFlag(FLAGS_portfolio_mix_epsilons)) {
+        config.portfolio_mix_epsilons.push_back(std::stod(r));
+    }
+    config.portfolio_inference_batch_sizes.clear();
+    for (const auto &r : absl::GetFlag(FLAGS_portfolio_inference_batch_sizes)) {
+        config.portfolio_inference_batch_sizes.push_back(std::stoul(r));
+    }
     config.learning_batch_size = absl::GetFlag(FLAGS_learning_batch_size);
     config.buffer_capacity = absl::GetFlag(FLAGS_buffer_capacity);
 
@@ -154,6 +222,10 @@ Config parse_flags(int argc, char **argv) {
     config.base_reward = absl::GetFlag(FLAGS_base_reward);
     config.discount = absl::GetFlag(FLAGS_discount);
     config.use_batch_norm = absl::GetFlag(FLAGS_batch_norm);
+    config.inference_bf16 = absl::GetFlag(FLAGS_inference_bf16);
+    config.sparse_input_planes = absl::GetFlag(FLAGS_sparse_input_planes);
+    config.resnet_bottleneck_channels = absl::GetFlag(FLAGS_resnet_bottleneck_channels);
+    config.mlp_rank = absl::GetFlag(FLAGS_mlp_rank);
     return config;
 }
 
@@ -26,10 +26,26 @@ struct Config {
     long long int checkpoint_expansions_intervial;
     long long int checkpoint_to_load;
     std::size_t num_threads_search;
+    std::string search_cores;
+    int torch_intra_op_threads;
+    int torch_inter_op_threads;
+    std::size_t searches_per_thread;
     std::size_t bootstrap_batch_multiplier = 1;
     std::size_t inference_batch_size;
+    bool async_inference;
+    std::size_t inference_max_batch_size;
+    int inference_max_wait_us;
+    bool adaptive_inference;
+    int inference_latency_cap_us;
+    std::size_t inference_tuner_window;
+    std::string inference_record_path;
+    int cascade_resnet_blocks;
+    int cascade_resnet_channels;
+    double cascade_entropy_threshold;
     std::size_t block_allocation_size;
     double mix_epsilon;
+    std::vector<double> portfolio_mix_epsilons;
+    std::vector<std::size_t> portfolio_inference_batch_sizes;
     std::size_t learning_batch_size;
     std::size_t buffer_capacity;
     std::size_t grad_steps;
@@ -46,6 +62,10 @@ struct Config {
     double base_reward;
     double discount;
     bool use_batch_norm;
+    bool inference_bf16;
+    int sparse_input_planes;
+    int resnet_bottleneck_channels;
+    int mlp_rank;
 };
 
 std::ostream &operator<<(std::ostream &os, const Config &config);
@@ -1,12 +1,15 @@
+#include <absl/time/time.h>
 #include <spdlog/spdlog.h>
 
 #include <filesystem>
+#include <functional>
 #include <iostream>
 #include <sstream>
 #include <string>
 
 #include "algorithm/phs/phs.h"
 #include "algorithm/phs/train.h"
+#include "algorithm/portfolio.h"
 #include "algorithm/test_runner.h"
 #include "algorithm/train_bootstrap.h"
 #include "apps/phs/config.h"
@@ -19,6 +22,7 @@
 #include "env/rnd/rnd_base.h"
 #include "env/rnd/rnd_simple.h"
 #include "env/sokoban/sokoban_base.h"
+#include "util/cpu_affinity.h"
 #include "util/utility.h"
 
 using namespace hpts;
@@ -26,6 +30,10 @@ using namespace hpts::model;
 using namespace hpts::algorithm;
 using namespace hpts::env;
 
+namespace {
+const std::string CASCADE_CHECKPOINT_NAME = "cascade";    // Checkpoints of the cascade model are saved as cascade-*
+}    // namespace
+
 // Create inputs to what the search algorithm expects
 template <env::SimpleEnv EnvT, typename ModelEvaluatorT>
 auto create_problems(const std::vector<EnvT>& problems, int search_budget, std::shared_ptr<StopToken> stop_token,
@@ -39,30 +47,97 @@ auto create_problems(const std::vector<EnvT>& problems, int search_budget, std::
     return search_inputs;
 }
 
+// Each combination of mix epsilon and inference batch size races as its own portfolio member
+auto portfolio_size(const Config& config) -> std::size_t {
+    return std::max(config.portfolio_mix_epsilons.size(), static_cast<std::size_t>(1)) *
+           std::max(config.portfolio_inference_batch_sizes.size(), static_cast<std::size_t>(1));
+}
+
+template <typename SearchInputT, typename SearchOutputT>
+auto create_portfolio(const Config& config) {
+    std::vector<double> mix_epsilons = config.portfolio_mix_epsilons;
+    std::vector<std::size_t> inference_batch_sizes = config.portfolio_inference_batch_sizes;
+    if (mix_epsilons.empty()) {
+        mix_epsilons.push_back(config.mix_epsilon);
+    }
+    if (inference_batch_sizes.empty()) {
+        inference_batch_sizes.push_back(config.inference_batch_size);
+    }
+    std::vector<PortfolioMember<SearchInputT, SearchOutputT>> members;
+    for (const auto& mix_epsilon : mix_epsilons) {
+        for (const auto& inference_batch_size : inference_batch_sizes) {
+            members.push_back({absl::StrFormat("phs(eps=%f, batch=%d)", mix_epsilon, inference_batch_size),
+                               [=](const SearchInputT& input) {
+                                   SearchInputT member_input = input;
+                                   member_input.mix_epsilon = mix_epsilon;
+                                   member_input.inference_batch_size = inference_batch_size;
+                                   return phs::search(member_input);
+                               }});
+        }
+    }
+    return make_portfolio(std::move(members));
+}
+
 // Initialize model evaluators
 template <typename T>
 auto init_model_evaluator(const Config& config, int num_actions, const ObservationShape& observation_shape) = delete;
 
+// Create the evaluator with a model on each device, along with the smaller cascade model if one is configured
+template <typename T, typename NetConfigT>
+auto make_model_evaluator(const Config& config, NetConfigT net_config) -> std::shared_ptr<ModelEvaluator<T>> {
+    const auto make_device_manager = [&](const NetConfigT& device_net_config, const std::string& checkpoint_base_name) {
+        std::unique_ptr<DeviceManager<T>> device_manager = std::make_unique<DeviceManager<T>>();
+        for (const absl::string_view& device : absl::StrSplit(config.devices, ',')) {
+            device_manager->AddDevice(std::make_unique<T>(device_net_config, config.learning_rate, config.weight_decay,
+                                                          std::string(device), config.output_path, checkpoint_base_name));
+        }
+        return device_manager;
+    };
+    std::unique_ptr<DeviceManager<T>> device_manager = make_device_manager(net_config, "");
+    std::unique_ptr<DeviceManager<T>> cascade_device_manager;
+    if (config.cascade_resnet_blocks > 0) {
+        net_config.resnet_blocks = config.cascade_resnet_blocks;
+        net_config.resnet_channels = config.cascade_resnet_channels > 0 ? config.cascade_resnet_channels : config.resnet_channels;
+        // The cascade model is trained from scratch, so it is never a compressed model
+        net_config.resnet_bottleneck_channels = 0;
+        net_config.mlp_rank = 0;
+        cascade_device_manager = make_device_manager(net_config, CASCADE_CHECKPOINT_NAME);
+    }
+    std::unique_ptr<InferenceTuner> inference_tuner;
+    if (config.adaptive_inference) {
+        inference_tuner = std::make_unique<InferenceTuner>(config.inference_max_batch_size,
+                                                           absl::Microseconds(config.inference_max_wait_us),
+                                                           absl::Microseconds(config.inference_latency_cap_us),
+                                                           config.inference_tuner_window);
+    }
+    return std::make_shared<ModelEvaluator<T>>(std::move(device_manager), static_cast<int>(config.num_threads_search),
+                                               config.inference_max_batch_size,
+                                               absl::Microseconds(config.inference_max_wait_us),
+                                               std::move(cascade_device_manager), config.cascade_entropy_threshold,
+                                               std::move(inference_tuner));
+}
+
 template <typename T>
     requires std::is_base_of_v<wrapper::PolicyConvNetWrapperBase, T>
 auto init_model_evaluator(const Config& config, int num_actions, const ObservationShape& observation_shape) {
-    std::unique_ptr<DeviceManager<T>> device_manager = std::make_unique<DeviceManager<T>>();
-    const wrapper::PolicyConvNetConfig net_config{
-        observation_shape,    num_actions,          config.resnet_channels, config.resnet_blocks, config.policy_reduced_channels,
-        config.policy_layers, config.use_batch_norm};
-    for (const absl::string_view& device : absl::StrSplit(config.devices, ',')) {
-        device_manager->AddDevice(
-            std::make_unique<T>(net_config, config.learning_rate, config.weight_decay, std::string(device), config.output_path));
-    }
-    // Put this in return type
-    return std::make_shared<ModelEvaluator<T>>(std::move(device_manager), 1);
+    const wrapper::PolicyConvNetConfig net_config{observation_shape,
+                                                  num_actions,
+                                                  config.resnet_channels,
+                                                  config.resnet_blocks,
+                                                  config.policy_reduced_channels,
+                                                  config.policy_layers,
+                                                  config.use_batch_norm,
+                                                  config.inference_bf16,
+                                                  config.sparse_input_planes,
+                                                  config.resnet_bottleneck_channels,
+                                                  config.mlp_rank};
+    return make_model_evaluator<T>(config, net_config);
 }
 
 template <typename T>
     requires std::is_base_of_v<wrapper::TwoHeadedConvNetWrapperBase, T>
 std::shared_ptr<ModelEvaluator<T>> init_model_evaluator(const Config& config, int num_actions,
                                                         const ObservationShape& observation_shape) {
-    std::unique_ptr<DeviceManager<T>> device_manager = std::make_unique<DeviceManager<T>>();
     const wrapper::TwoHeadedConvNetConfig net_config{observation_shape,
                                                      num_actions,
                                                      config.resnet_channels,
@@ -71,13 +146,12 @@ std::shared_ptr<ModelEvaluator<T>> init_model_evaluator(const Config& config, in
                                                      config.heuristic_reduced_channels,
                                                      config.policy_layers,
                                                      config.heuristic_layers,
-                                                     config.use_batch_norm};
-    for (const absl::string_view& device : absl::StrSplit(config.devices, ',')) {
-        device_manager->AddDevice(
-            std::make_unique<T>(net_config, config.learning_rate, config.weight_decay, std::string(device), config.output_path));
-    }
-    // Put this in return type
-    return std::make_shared<ModelEvaluator<T>>(std::move(device_manager), 1);
+                                                     config.use_batch_norm,
+                                                     config.inference_bf16,
+                                                     config.sparse_input_planes,
+                                                     config.resnet_bottleneck_channels,
+                                                     config.mlp_rank};
+    return make_model_evaluator<T>(config, net_config);
 }
 
 template <env::SimpleEnv EnvT, typename ModelWrapperT>
@@ -96,6 +170,7 @@ void templated_main(const Config& config) {
     phs::INFERENCE_BATCH_SIZE = config.inference_batch_size;
     phs::BLOCK_ALLOCATION_SIZE = config.block_allocation_size;
     phs::MIX_EPSILON = config.mix_epsilon;
+    phs::ASYNC_INFERENCE = config.async_inference;
     if (config.mode == "train") {
         const auto split_problems = split_train_validate(problems, config.num_train, config.num_validate, config.seed);
         auto problems_train = create_problems(split_problems.first, config.search_budget, stop_token, model_eval);
@@ -116,9 +191,34 @@ void templated_main(const Config& config) {
     } else if (config.mode == "test") {
         auto input_problems = create_problems(problems, config.search_budget, stop_token, model_eval);
         model_eval->load_without_optimizer(config.checkpoint_to_load);
-        run_test_levels<EnvT, SearchInputT, SearchOutputT>(input_problems, phs::search<EnvT, ModelEvaluatorT>,
-                                                           config.num_threads_search, config.search_budget, config.time_budget,
-                                                           config.output_path, stop_token, config.max_iterations);
+        if (!config.inference_record_path.empty()) {
+            // Async searches expand in an order which depends on inference timing, so their record can't be replayed
+            if (config.async_inference) {
+                SPDLOG_ERROR("Inference can't be recorded with async_inference, as the replay runs synchronous searches.");
+                std::exit(1);
+            }
+            // The winning member, and where the losing members stop, also depend on timing
+            if (!config.portfolio_mix_epsilons.empty() || !config.portfolio_inference_batch_sizes.empty()) {
+                SPDLOG_ERROR("Inference can't be recorded with a portfolio, as the replay runs a single search per problem.");
+                std::exit(1);
+            }
+            model_eval->record_inference(config.inference_record_path);
+        }
+        std::function<SearchOutputT(const SearchInputT&)> algorithm = phs::search<EnvT, ModelEvaluatorT>;
+        std::size_t num_threads = config.num_threads_search;
+        if (!config.portfolio_mix_epsilons.empty() || !config.portfolio_inference_batch_sizes.empty()) {
+            algorithm = create_portfolio<SearchInputT, SearchOutputT>(config);
+            num_threads = std::max(num_threads / portfolio_size(config), static_cast<std::size_t>(1));
+        } else if (config.searches_per_thread > 1) {
+            run_test_levels_interleaved<EnvT, SearchInputT, SearchOutputT>(
+                input_problems, phs::search_interleaved<EnvT, ModelEvaluatorT>, config.num_threads_search,
+                config.searches_per_thread, config.search_budget, config.time_budget, config.output_path, stop_token,
+                config.max_iterations);
+            return;
+        }
+        run_test_levels<EnvT, SearchInputT, SearchOutputT>(input_problems, algorithm, num_threads, config.search_budget,
+                                                           config.time_budget, config.output_path, stop_token,
+                                                           config.max_iterations);
     } else {
         SPDLOG_ERROR("Unknown mode type: {:s}.", config.mode);
         std::exit(1);
@@ -165,6 +265,10 @@ int main(int argc, char** argv) {
     // Dump invocation of program
     hpts::log_flags(argc, argv);
 
+    // Size torch thread pools explicitly so search threads and inference workers don't oversubscribe the cores
+    hpts::init_torch_threads(config.torch_intra_op_threads, config.torch_inter_op_threads);
+    hpts::cpu_affinity::set_search_cores(hpts::cpu_affinity::parse_core_list(config.search_cores));
+
     SPDLOG_INFO("Configuration used:");
     std::stringstream ss;
     ss << config;
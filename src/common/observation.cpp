@@ -0,0 +1,72 @@
+// File: observation.cpp
+// Description: A common observation type
+
+#include "common/observation.h"
+
+#include <cstring>
+
+namespace hpts {
+
+namespace {
+
+constexpr std::size_t BITS_PER_BYTE = 8;
+
+// Float values of each bit of every possible byte, so a byte unpacks with a single 32 byte copy
+constexpr auto make_unpack_table() {
+    std::array<std::array<float, BITS_PER_BYTE>, 256> table{};
+    for (std::size_t byte = 0; byte < table.size(); ++byte) {
+        for (std::size_t bit = 0; bit < BITS_PER_BYTE; ++bit) {
+            table[byte][bit] = static_cast<float>((byte >> bit) & 1);    // NOLINT (*-constant-array-index)
+        }
+    }
+    return table;
+}
+constexpr auto UNPACK_TABLE = make_unpack_table();
+
+auto is_binary(const Observation &observation) -> bool {
+    for (const auto &value : observation) {
+        if (value != 0 && value != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}    // namespace
+
+PackedObservation::PackedObservation(const Observation &observation) : size_(observation.size()) {
+    if (!is_binary(observation)) {
+        values_ = observation;
+        return;
+    }
+    bits_.assign((size_ + BITS_PER_BYTE - 1) / BITS_PER_BYTE, 0);
+    for (std::size_t i = 0; i < size_; ++i) {
+        if (observation[i] != 0) {
+            bits_[i / BITS_PER_BYTE] |= static_cast<uint8_t>(1 << (i % BITS_PER_BYTE));
+        }
+    }
+}
+
+void PackedObservation::unpack(float *dst) const {
+    if (!is_packed()) {
+        std::memcpy(dst, values_.data(), size_ * sizeof(float));
+        return;
+    }
+    const std::size_t full_bytes = size_ / BITS_PER_BYTE;
+    for (std::size_t i = 0; i < full_bytes; ++i) {
+        std::memcpy(dst, UNPACK_TABLE[bits_[i]].data(), BITS_PER_BYTE * sizeof(float));    // NOLINT (*-constant-array-index)
+        dst += BITS_PER_BYTE;                                                              // NOLINT (*-pointer-arithmetic)
+    }
+    const std::size_t remainder = size_ % BITS_PER_BYTE;
+    if (remainder > 0) {
+        std::memcpy(dst, UNPACK_TABLE[bits_[full_bytes]].data(), remainder * sizeof(float));    // NOLINT (*-constant-array-index)
+    }
+}
+
+auto PackedObservation::unpack() const -> Observation {
+    Observation observation(size_);
+    unpack(observation.data());
+    return observation;
+}
+
+}    // namespace hpts
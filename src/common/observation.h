@@ -5,6 +5,8 @@
 #define HPTS_COMMON_OBSERVATION_H_
 
 #include <array>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 namespace hpts {
@@ -35,6 +37,48 @@ struct ObservationShape {
     }
 };
 
+/**
+ * Compact storage for observations kept around after search (solution paths, learning inputs, replay buffers).
+ * Binary observations are stored as 1 bit per value, and are unpacked into float staging buffers when a batch is
+ * assembled. Observations holding any other value are stored as is, so packing is always lossless.
+ */
+class PackedObservation {
+public:
+    PackedObservation() = default;
+    PackedObservation(const Observation &observation);    // NOLINT (*-explicit-constructor)
+
+    /**
+     * Write the observation values into the destination buffer
+     * @param dst Destination, which must hold size() floats
+     */
+    void unpack(float *dst) const;
+
+    /**
+     * Get the unpacked observation
+     * @return Observation with the original values
+     */
+    [[nodiscard]] auto unpack() const -> Observation;
+
+    /**
+     * Get the number of observation values
+     */
+    [[nodiscard]] auto size() const noexcept -> std::size_t {
+        return size_;
+    }
+
+    /**
+     * Check if the observation is stored as bits
+     */
+    [[nodiscard]] auto is_packed() const noexcept -> bool {
+        return values_.empty() && size_ > 0;
+    }
+
+private:
+    std::size_t size_ = 0;
+    std::vector<uint8_t> bits_;    // Values in order, least significant bit first
+    Observation values_;           // Fallback for non-binary observations
+};
+
 }    // namespace hpts
 
 #endif    // HPTS_COMMON_OBSERVATION_H_
@@ -2,6 +2,7 @@
 // Description: Logging setup
 
 // NOLINTBEGIN
+#include <spdlog/spdlog.h>
 #include <torch/torch.h>
 // NOLINTEND
 
@@ -16,6 +17,18 @@ void init_torch(int seed) {
     torch::globalContext().setDeterministicAlgorithms(true, false);
 }
 
+void init_torch_threads(int intra_op_threads, int inter_op_threads) {
+    if (intra_op_threads > 0) {
+        torch::set_num_threads(intra_op_threads);
+    }
+    // Inter-op pool can only be sized before its first use
+    if (inter_op_threads > 0) {
+        torch::set_num_interop_threads(inter_op_threads);
+    }
+    SPDLOG_INFO("Torch threads - intra-op: {:d}, inter-op: {:d}", torch::get_num_threads(),
+                torch::get_num_interop_threads());
+}
+
 void reset_seed(int seed) {
     torch::manual_seed(seed);
     torch::cuda::manual_seed_all(seed);
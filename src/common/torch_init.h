@@ -12,6 +12,13 @@ namespace hpts {
  */
 void init_torch(int seed);
 
+/**
+ * Set the number of threads libtorch uses, should be called once before any inference or learning
+ * @param intra_op_threads Threads used within a single op (i.e. a conv forward pass), <= 0 keeps the libtorch default
+ * @param inter_op_threads Threads used to run independent ops in parallel, <= 0 keeps the libtorch default
+ */
+void init_torch_threads(int intra_op_threads, int inter_op_threads);
+
 /**
  * Reset the state of the torch seed
  * @param seed The seed to initialize torch rngs
@@ -3,18 +3,47 @@
 
 #include "model/base_model_wrapper.h"
 
+#include <string_view>
+
 // NOLINTBEGIN
+#include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
 // NOLINTEND
 
+#include "util/cpu_affinity.h"
+
 namespace hpts::model {
 
+namespace {
+constexpr std::string_view CPU_REPLICA_PREFIX = "cpu:";
+constexpr std::string_view CPU_MKLDNN_DEVICE = "cpu-mkldnn";
+
+// cpu-mkldnn (optionally with a core list, i.e. cpu-mkldnn:0-7) is a CPU device running inference in channels-last
+auto is_cpu_mkldnn(const std::string& device) -> bool {
+    return absl::StartsWith(device, CPU_MKLDNN_DEVICE);
+}
+
+// Device with the backend option stripped, which is then a plain torch device or CPU replica
+auto base_device(const std::string& device) -> std::string {
+    return is_cpu_mkldnn(device) ? absl::StrCat("cpu", device.substr(CPU_MKLDNN_DEVICE.size())) : device;
+}
+
+// CPU devices can carry a core list (i.e. cpu:0-7), which makes them a model replica pinned to those cores
+auto is_cpu_replica(const std::string& device) -> bool {
+    return absl::StartsWith(device, CPU_REPLICA_PREFIX);
+}
+}    // namespace
+
 BaseModelWrapper::BaseModelWrapper(const std::string& device, const std::string& output_path,
                                    const std::string& checkpoint_base_name)
     : device_(device),
       path_(absl::StrCat(output_path, "/checkpoints/")),
       checkpoint_base_name_(checkpoint_base_name.empty() ? checkpoint_base_name : absl::StrCat(checkpoint_base_name, "-")),
-      torch_device_(device) {}
+      torch_device_(is_cpu_replica(base_device(device)) ? torch::Device(torch::kCPU) : torch::Device(base_device(device))),
+      cpu_cores_(is_cpu_replica(base_device(device))
+                     ? cpu_affinity::parse_core_list(base_device(device).substr(CPU_REPLICA_PREFIX.size()))
+                     : std::vector<int>{}),
+      channels_last_(is_cpu_mkldnn(device)) {}
 
 void BaseModelWrapper::LoadCheckpoint(long long int step) {
     LoadCheckpoint(absl::StrCat(path_, checkpoint_base_name_, "checkpoint-", step));
@@ -32,4 +61,16 @@ auto BaseModelWrapper::get_device() -> torch::Device {
     return torch_device_;
 }
 
+auto BaseModelWrapper::CpuCores() const -> const std::vector<int>& {
+    return cpu_cores_;
+}
+
+auto BaseModelWrapper::ChannelsLast() const -> bool {
+    return channels_last_;
+}
+
+auto BaseModelWrapper::Modules() -> std::vector<std::shared_ptr<torch::nn::Module>> {
+    return {};
+}
+
 }    // namespace hpts::model
@@ -10,7 +10,9 @@
 
 #include <any>
 #include <concepts>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "util/concepts.h"
 
@@ -82,12 +84,32 @@ public:
      */
     [[nodiscard]] virtual auto get_device() -> torch::Device;
 
+    /**
+     * Return the cores the model is pinned to, for CPU devices given with a core list (i.e. cpu:0-7)
+     * @return Cores to run inference on, empty if not pinned
+     */
+    [[nodiscard]] auto CpuCores() const -> const std::vector<int>&;
+
+    /**
+     * Return whether inference runs with channels-last weights and inputs, for cpu-mkldnn devices
+     * @return True if the inference copy and inputs are in channels-last layout
+     */
+    [[nodiscard]] auto ChannelsLast() const -> bool;
+
+    /**
+     * Return the underlying networks, used to copy weights between replicas in memory
+     * @return Networks of the model in a fixed order, empty if the model doesn't support in-memory syncing
+     */
+    [[nodiscard]] virtual auto Modules() -> std::vector<std::shared_ptr<torch::nn::Module>>;
+
 protected:
     // NOLINTBEGIN (*-non-private-member-variables-in-classes)
     std::string device_;
     std::string path_;
     std::string checkpoint_base_name_;
     torch::Device torch_device_;
+    std::vector<int> cpu_cores_;
+    bool channels_last_;
     // NOLINTEND (*-non-private-member-variables-in-classes)
 };
 
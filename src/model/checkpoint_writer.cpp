@@ -0,0 +1,120 @@
+// File: checkpoint_writer.cpp
+// Description: Writes serialized checkpoints to disk from a background thread
+
+#include "model/checkpoint_writer.h"
+
+// NOLINTBEGIN
+#include <absl/strings/str_cat.h>
+// NOLINTEND
+
+#include <spdlog/spdlog.h>
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace hpts::model::checkpoint_writer {
+
+namespace {
+constexpr std::size_t MAX_QUEUED_WRITES = 16;
+
+void write_file(const std::string &path, const std::string &data) {
+    const std::string tmp_path = absl::StrCat(path, ".tmp");
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!file) {
+            SPDLOG_ERROR("Unable to write checkpoint {:s}", tmp_path);
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path, ec);
+    if (ec) {
+        SPDLOG_ERROR("Unable to move checkpoint {:s} to {:s}: {:s}", tmp_path, path, ec.message());
+    }
+}
+
+// Single background thread which drains queued writes in order, started on first use
+class Writer {
+public:
+    Writer() = default;
+    Writer(const Writer &) = delete;
+    Writer(Writer &&) = delete;
+    Writer &operator=(const Writer &) = delete;
+    Writer &operator=(Writer &&) = delete;
+
+    // Queued writes are still drained before the thread stops
+    ~Writer() {
+        {
+            const std::lock_guard<std::mutex> lock(m_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    void write(std::string path, std::string data) {
+        std::unique_lock<std::mutex> lock(m_);
+        if (!thread_.joinable()) {
+            thread_ = std::thread([this]() { this->run(); });
+        }
+        cv_.wait(lock, [&]() { return queue_.size() < MAX_QUEUED_WRITES; });
+        queue_.emplace_back(std::move(path), std::move(data));
+        cv_.notify_all();
+    }
+
+    void flush() {
+        std::unique_lock<std::mutex> lock(m_);
+        cv_.wait(lock, [&]() { return queue_.empty() && !writing_; });
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(m_);
+        while (true) {
+            cv_.wait(lock, [&]() { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                break;
+            }
+            auto [path, data] = std::move(queue_.front());
+            queue_.pop_front();
+            writing_ = true;
+            cv_.notify_all();
+            lock.unlock();
+            write_file(path, data);
+            lock.lock();
+            writing_ = false;
+            cv_.notify_all();
+        }
+    }
+
+    std::mutex m_;
+    std::condition_variable cv_;                               // Shared by the writer, queuing threads and flushing threads
+    std::deque<std::pair<std::string, std::string>> queue_;    // Queued (path, data) writes
+    bool writing_ = false;                                     // Whether the writer is currently writing a popped item
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+auto writer() -> Writer & {
+    static Writer writer;
+    return writer;
+}
+}    // namespace
+
+void write(const std::string &path, std::string data) {
+    writer().write(path, std::move(data));
+}
+
+void flush() {
+    writer().flush();
+}
+
+}    // namespace hpts::model::checkpoint_writer
@@ -0,0 +1,44 @@
+// File: checkpoint_writer.h
+// Description: Writes serialized checkpoints to disk from a background thread
+
+#ifndef HPTS_MODEL_CHECKPOINT_WRITER_H_
+#define HPTS_MODEL_CHECKPOINT_WRITER_H_
+
+// NOLINTBEGIN
+#include <torch/torch.h>
+// NOLINTEND
+
+#include <sstream>
+#include <string>
+
+namespace hpts::model::checkpoint_writer {
+
+/**
+ * Queue serialized data to be written to the given path by the background writer
+ * The data is first written to a temporary file which is then renamed, so a checkpoint file is never partially written
+ * @note Blocks if too many writes are already queued
+ * @param path The checkpoint path
+ * @param data The serialized checkpoint
+ */
+void write(const std::string &path, std::string data);
+
+/**
+ * Block until all queued checkpoints are written to disk, needed before loading a checkpoint or exiting
+ */
+void flush();
+
+/**
+ * Snapshot the value (i.e. a module or optimizer) into memory, and queue it to be written to the given path
+ * @param value The value to checkpoint
+ * @param path The checkpoint path
+ */
+template <typename T>
+void save(const T &value, const std::string &path) {
+    std::ostringstream stream;
+    torch::save(value, stream);
+    write(path, std::move(stream).str());
+}
+
+}    // namespace hpts::model::checkpoint_writer
+
+#endif    // HPTS_MODEL_CHECKPOINT_WRITER_H_
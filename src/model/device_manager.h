@@ -21,11 +21,14 @@
 #include <absl/strings/str_split.h>
 #include <absl/synchronization/mutex.h>
 
+#include <cassert>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include "model/base_model_wrapper.h"
+#include "model/torch_util.h"
 
 namespace hpts::model {
 
@@ -121,6 +124,31 @@ public:
         }
     }
 
+    // Copy the weights of the given device to all other devices in memory, independent of checkpointing to disk
+    // Devices already holding the current weight version are skipped, models without in-memory support sync through disk
+    void sync_weights(int device_id = 0) {
+        auto src_modules = this->Get(0, device_id)->Modules();
+        if (src_modules.empty()) {
+            checkpoint_and_sync_without_optimizer(-1, device_id);
+            return;
+        }
+        int64_t version = 0;
+        for (const auto& module : src_modules) {
+            version += module_state_version(*module);
+        }
+        for (int i = 0; i < static_cast<int>(this->Count()); ++i) {
+            if (i == device_id || devices[i].synced_version == version) {
+                continue;
+            }
+            auto dst_modules = this->Get(0, i)->Modules();
+            assert(dst_modules.size() == src_modules.size());
+            for (std::size_t j = 0; j < src_modules.size(); ++j) {
+                copy_module_state(*src_modules[j], *dst_modules[j]);
+            }
+            devices[i].synced_version = version;
+        }
+    }
+
     // Load all models to a given checkpoint step
     void load_all(long long int step) {
         for (int i = 0; i < static_cast<int>(this->Count()); ++i) {
@@ -142,6 +170,7 @@ private:
     struct Device {
         std::unique_ptr<ModelWrapperT> model;
         int requests = 0;
+        int64_t synced_version = -1;    // Weight version last copied in by sync_weights
     };
 
     bool learning_ = false;
@@ -36,9 +36,16 @@ torch::Tensor HeuristicConvNetImpl::forward(torch::Tensor x) {
 
     // Reduce and mlp
     torch::Tensor heuristic = conv1x1_heuristic_->forward(output);
-    heuristic = heuristic.view({-1, heuristic_mlp_input_size_});
+    heuristic = heuristic.reshape({-1, heuristic_mlp_input_size_});
     heuristic = heuristic_mlp_->forward(heuristic);
     return heuristic;
 }
 
+void HeuristicConvNetImpl::fuse_batchnorm() {
+    resnet_head_->fuse_batchnorm();
+    for (int i = 0; i < (int)resnet_layers_->size(); ++i) {
+        resnet_layers_[i]->as<ResidualBlock>()->fuse_batchnorm();
+    }
+}
+
 }    // namespace hpts::model::network
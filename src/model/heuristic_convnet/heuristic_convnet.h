@@ -29,6 +29,8 @@ public:
     HeuristicConvNetImpl(const ObservationShape &observation_shape, int resnet_channels, int resnet_blocks,
                          int heuristic_channels, const std::vector<int> &heuristic_mlp_layers, bool use_batchnorm);
     [[nodiscard]] auto forward(torch::Tensor x) -> torch::Tensor;
+    // Fold batchnorm into the resnet convolutions, only to be used on an eval-only copy of the network
+    void fuse_batchnorm();
 
 private:
     int input_channels_;
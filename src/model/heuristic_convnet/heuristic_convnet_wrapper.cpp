@@ -14,7 +14,9 @@
 #include <sstream>
 
 #include "model/heuristic_convnet/heuristic_convnet.h"
+#include "model/checkpoint_writer.h"
 #include "model/loss_functions.h"
+#include "model/torch_util.h"
 #include "util/zip.h"
 
 namespace hpts::model::wrapper {
@@ -49,8 +51,8 @@ auto HeuristicConvNetWrapperBase::SaveCheckpoint(long long int step) -> std::str
     std::filesystem::create_directories(path_);
     std::string full_path = absl::StrCat(path_, checkpoint_base_name_, "checkpoint-", step);
     SPDLOG_INFO("Checkpointing model to {:s}.pt", full_path);
-    torch::save(model_, absl::StrCat(full_path, ".pt"));
-    torch::save(model_optimizer_, absl::StrCat(full_path, "-optimizer.pt"));
+    checkpoint_writer::save(model_, absl::StrCat(full_path, ".pt"));
+    checkpoint_writer::save(model_optimizer_, absl::StrCat(full_path, "-optimizer.pt"));
     return full_path;
 }
 auto HeuristicConvNetWrapperBase::SaveCheckpointWithoutOptimizer(long long int step) -> std::string {
@@ -58,52 +60,91 @@ auto HeuristicConvNetWrapperBase::SaveCheckpointWithoutOptimizer(long long int s
     std::filesystem::create_directories(path_);
     std::string full_path = absl::StrCat(path_, checkpoint_base_name_, "checkpoint-", step);
     SPDLOG_INFO("Checkpointing model to {:s}.pt", full_path);
-    torch::save(model_, absl::StrCat(full_path, ".pt"));
+    checkpoint_writer::save(model_, absl::StrCat(full_path, ".pt"));
     return full_path;
 }
 
 void HeuristicConvNetWrapperBase::LoadCheckpoint(const std::string& path) {
+    // Checkpoint may still be queued in the background writer
+    checkpoint_writer::flush();
     if (!std::filesystem::exists(absl::StrCat(path, ".pt")) || !std::filesystem::exists(absl::StrCat(path, "-optimizer.pt"))) {
         SPDLOG_ERROR("path {:s} does not contain model and/or optimizer", path);
         std::exit(1);
     }
     torch::load(model_, absl::StrCat(path, ".pt"), torch_device_);
     torch::load(model_optimizer_, absl::StrCat(path, "-optimizer.pt"), torch_device_);
+    inference_model_version_ = -1;
 }
 void HeuristicConvNetWrapperBase::LoadCheckpointWithoutOptimizer(const std::string& path) {
+    // Checkpoint may still be queued in the background writer
+    checkpoint_writer::flush();
     if (!std::filesystem::exists(absl::StrCat(path, ".pt"))) {
         SPDLOG_ERROR("path {:s} does not contain model", path);
         std::exit(1);
     }
     torch::load(model_, absl::StrCat(path, ".pt"), torch_device_);
+    inference_model_version_ = -1;
+}
+
+auto HeuristicConvNetWrapperBase::Modules() -> std::vector<std::shared_ptr<torch::nn::Module>> {
+    return {model_.ptr()};
+}
+
+void HeuristicConvNetWrapperBase::UpdateInferenceModel() {
+    const int64_t version = module_state_version(*model_);
+    if (inference_model_ && version == inference_model_version_) {
+        return;
+    }
+    network::HeuristicConvNet inference_model(config.observation_shape, config.resnet_channels, config.resnet_blocks,
+                                              config.heuristic_channels, config.heuristic_mlp_layers, config.use_batchnorm);
+    copy_module_state(*model_, *inference_model);
+    inference_model->fuse_batchnorm();
+    // Batchnorm is folded in fp32 before casting, so the folded scales don't lose precision twice
+    inference_model->to(torch_device_, inference_dtype(config.inference_bf16));
+    if (channels_last_) {
+        to_channels_last(*inference_model);
+    }
+    inference_model->eval();
+    inference_model_ = std::move(inference_model);
+    inference_model_version_ = version;
 }
 
 auto HeuristicConvNetWrapperBase::Inference(std::vector<InferenceInput>& batch) -> std::vector<InferenceOutput> {
     const int batch_size = static_cast<int>(batch.size());
 
-    // Create tensor from raw flat array
-    // torch::from_blob requires a pointer to non-const and doesn't take ownership
-    auto options = torch::TensorOptions().dtype(torch::kFloat);
-    torch::Tensor input_observations = torch::empty({batch_size, input_flat_size}, options);
-    for (auto&& [idx, batch_item] : enumerate(batch)) {
-        const auto i = static_cast<int>(idx);
-        input_observations[i] = torch::from_blob(batch_item.observation.data(), {input_flat_size}, options);
+    // Pack into the reusable staging buffer and wrap as a single tensor
+    // Sparse inputs stay as byte indices on the device, which the first layer looks up from its dense weights
+    torch::Tensor input_observations;
+    if (config.sparse_input_planes > 0) {
+        input_observations = observations_to_index_tensor(batch, config.observation_shape.c, config.sparse_input_planes,
+                                                          inference_index_staging_);
+        input_observations = input_observations.to(torch_device_);
+        input_observations = input_observations.reshape(
+            {batch_size, config.sparse_input_planes, config.observation_shape.h, config.observation_shape.w});
+    } else if (channels_last_) {
+        // Packed cell major, so the input is already in the layout of the channels-last weights
+        input_observations = observations_to_channels_last_tensor(batch, config.observation_shape.c, config.observation_shape.h,
+                                                                  config.observation_shape.w, inference_staging_);
+        input_observations = input_observations.to(torch_device_, inference_dtype(config.inference_bf16));
+    } else {
+        input_observations = observations_to_tensor(batch, input_flat_size, inference_staging_);
+        // Reshape to expected size for network (batch_size, flat) -> (batch_size, c, h, w)
+        input_observations = input_observations.to(torch_device_, inference_dtype(config.inference_bf16));
+        input_observations = input_observations.reshape(
+            {batch_size, config.observation_shape.c, config.observation_shape.h, config.observation_shape.w});
     }
 
-    // Reshape to expected size for network (batch_size, flat) -> (batch_size, c, h, w)
-    input_observations = input_observations.to(torch_device_);
-    input_observations = input_observations.reshape(
-        {batch_size, config.observation_shape.c, config.observation_shape.h, config.observation_shape.w});
-
-    // Put model in eval mode for inference + scoped no_grad
-    model_->eval();
-    const torch::NoGradGuard no_grad;
+    // Inference copy is always in eval mode, and inference mode skips autograd tracking entirely
+    UpdateInferenceModel();
+    const torch::InferenceMode inference_guard;
 
     // Run inference
-    const torch::Tensor model_output = model_->forward(input_observations);
+    const torch::Tensor model_output = to_cpu_float(inference_model_->forward(input_observations).reshape({batch_size, 1}));
+    const float *heuristic_data = model_output.data_ptr<float>();
     std::vector<InferenceOutput> inference_output;
+    inference_output.reserve(static_cast<std::size_t>(batch_size));
     for (int i = 0; i < batch_size; ++i) {
-        inference_output.emplace_back(model_output[i].item<double>());
+        inference_output.emplace_back(static_cast<double>(heuristic_data[i]));    // NOLINT (*-pointer-arithmetic)
     }
     return inference_output;
 }
@@ -112,13 +153,12 @@ auto HeuristicConvNetWrapperMSE::Learn(std::vector<LearningInput>& batch) -> dou
     const int batch_size = static_cast<int>(batch.size());
     auto options_float = torch::TensorOptions().dtype(torch::kFloat);
 
-    // Create tensor from raw flat array
-    // torch::from_blob requires a pointer to non-const and doesn't take ownership
+    // Stored observations are unpacked directly into the input tensor
     torch::Tensor input_observations = torch::empty({batch_size, input_flat_size}, options_float);
     torch::Tensor target_costs = torch::empty({batch_size, 1}, options_float);
     for (auto&& [idx, batch_item] : enumerate(batch)) {
         const auto i = static_cast<int>(idx);    // stop torch from complaining about narrowing conversions
-        input_observations[i] = torch::from_blob(batch_item.observation.data(), {input_flat_size}, options_float);
+        batch_item.observation.unpack(input_observations[i].data_ptr<float>());
         target_costs[i] = static_cast<double>(batch_item.target_cost_to_goal);
     }
 
@@ -4,6 +4,9 @@
 #ifndef HPTS_WRAPPER_HEURISTIC_CONVNET_H_
 #define HPTS_WRAPPER_HEURISTIC_CONVNET_H_
 
+#include <atomic>
+#include <vector>
+
 #include "common/observation.h"
 #include "model/base_model_wrapper.h"
 #include "model/heuristic_convnet/heuristic_convnet.h"
@@ -17,10 +20,12 @@ struct HeuristicConvNetConfig {
     int heuristic_channels;
     std::vector<int> heuristic_mlp_layers;
     bool use_batchnorm;
+    bool inference_bf16 = false;    // Run the inference copy in bfloat16, learning stays in fp32
+    int sparse_input_planes = 0;    // Pack inference inputs as this many active channel index planes, 0 for dense
 };
 
 struct HeuristicConvNetLearningInput {
-    Observation observation;
+    PackedObservation observation;
     double target_cost_to_goal;
 };
 
@@ -50,6 +55,8 @@ public:
     void LoadCheckpoint(const std::string& path) override;
     void LoadCheckpointWithoutOptimizer(const std::string& path) override;
 
+    [[nodiscard]] auto Modules() -> std::vector<std::shared_ptr<torch::nn::Module>> override;
+
     /**
      * Perform inference
      * @param inputs Batched observations (implementation defined)
@@ -58,11 +65,18 @@ public:
     [[nodiscard]] auto Inference(std::vector<InferenceInput>& batch) -> std::vector<InferenceOutput>;
 
 protected:
+    // Rebuild the eval-only inference copy from the current weights if they changed since it was last built
+    void UpdateInferenceModel();
+
     // NOLINTBEGIN(*-non-private-member-variables-in-classes)
     network::HeuristicConvNet model_;
     torch::optim::Adam model_optimizer_;
     HeuristicConvNetConfig config;
     int input_flat_size;
+    std::vector<float> inference_staging_;                  // Reused contiguous buffer for batched inference observations
+    std::vector<uint8_t> inference_index_staging_;          // Reused buffer for sparse inference observations
+    network::HeuristicConvNet inference_model_{nullptr};    // Eval-only copy with batchnorm folded, used for inference
+    std::atomic<int64_t> inference_model_version_{-1};      // Weight version the inference copy was built from
     // NOLINTEND(*-non-private-member-variables-in-classes)
 };
 
@@ -72,7 +86,7 @@ class HeuristicConvNetWrapperMSE : public HeuristicConvNetWrapperBase {
 public:
     using BaseType = HeuristicConvNetWrapperBase;
     struct LearningInput {
-        Observation observation;
+        PackedObservation observation;
         double target_cost_to_goal = 0;
     };
 
@@ -0,0 +1,106 @@
+// File: inference_record.cpp
+// Description: Table of recorded inference outputs keyed by observation, which can be saved and replayed without a model
+
+#include "model/inference_record.h"
+
+#include <array>
+#include <cstring>
+
+namespace hpts::model {
+
+namespace {
+constexpr std::array<char, 8> RECORD_MAGIC = {'H', 'P', 'T', 'S', 'I', 'N', 'F', 'R'};
+constexpr uint32_t RECORD_VERSION = 1;
+constexpr uint64_t FNV_OFFSET = 14695981039346656037ULL;
+constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+template <typename T>
+void write_value(std::ofstream& stream, const T& value) {
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(T));    // NOLINT(*-reinterpret-cast)
+}
+
+template <typename T>
+auto read_value(std::ifstream& stream, T& value) -> bool {
+    return static_cast<bool>(stream.read(reinterpret_cast<char*>(&value), sizeof(T)));    // NOLINT(*-reinterpret-cast)
+}
+
+void write_floats(std::ofstream& stream, const std::vector<float>& values) {
+    stream.write(reinterpret_cast<const char*>(values.data()),    // NOLINT(*-reinterpret-cast)
+                 static_cast<std::streamsize>(values.size() * sizeof(float)));
+}
+
+auto read_floats(std::ifstream& stream, std::vector<float>& values, uint32_t size) -> bool {
+    values.resize(size);
+    return static_cast<bool>(stream.read(reinterpret_cast<char*>(values.data()),    // NOLINT(*-reinterpret-cast)
+                                         static_cast<std::streamsize>(values.size() * sizeof(float))));
+}
+}    // namespace
+
+// FNV-1a over the bit patterns of the values
+auto observation_key(const Observation& observation) -> uint64_t {
+    uint64_t hash = FNV_OFFSET;
+    for (const auto& value : observation) {
+        uint32_t bits = 0;
+        std::memcpy(&bits, &value, sizeof(bits));
+        for (int i = 0; i < 4; ++i) {
+            hash ^= (bits >> (8 * i)) & 0xFFU;
+            hash *= FNV_PRIME;
+        }
+    }
+    return hash;
+}
+
+namespace detail {
+
+// Layout per entry: key, fields, then [policy size, logits, policy, log_policy] and [heuristic] if recorded
+void write_recorded_output(std::ofstream& stream, uint64_t key, const RecordedOutput& output) {
+    write_value(stream, key);
+    write_value(stream, output.fields);
+    if (output.fields & RecordedOutput::POLICY) {
+        write_value(stream, static_cast<uint32_t>(output.policy.size()));
+        write_floats(stream, output.logits);
+        write_floats(stream, output.policy);
+        write_floats(stream, output.log_policy);
+    }
+    if (output.fields & RecordedOutput::HEURISTIC) {
+        write_value(stream, output.heuristic);
+    }
+}
+
+auto read_recorded_output(std::ifstream& stream, uint64_t& key, RecordedOutput& output) -> bool {
+    if (!read_value(stream, key) || !read_value(stream, output.fields)) {
+        return false;
+    }
+    if (output.fields & RecordedOutput::POLICY) {
+        uint32_t size = 0;
+        if (!read_value(stream, size) || !read_floats(stream, output.logits, size) ||
+            !read_floats(stream, output.policy, size) || !read_floats(stream, output.log_policy, size)) {
+            return false;
+        }
+    }
+    if (output.fields & RecordedOutput::HEURISTIC) {
+        return read_value(stream, output.heuristic);
+    }
+    return true;
+}
+
+auto write_record_header(std::ofstream& stream, uint64_t num_entries) -> bool {
+    stream.write(RECORD_MAGIC.data(), RECORD_MAGIC.size());
+    write_value(stream, RECORD_VERSION);
+    write_value(stream, num_entries);
+    return static_cast<bool>(stream);
+}
+
+auto read_record_header(std::ifstream& stream, uint64_t& num_entries) -> bool {
+    std::array<char, RECORD_MAGIC.size()> magic{};
+    uint32_t version = 0;
+    if (!stream.read(magic.data(), magic.size()) || magic != RECORD_MAGIC || !read_value(stream, version) ||
+        version != RECORD_VERSION) {
+        return false;
+    }
+    return read_value(stream, num_entries);
+}
+
+}    // namespace detail
+
+}    // namespace hpts::model
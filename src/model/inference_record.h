@@ -0,0 +1,225 @@
+// File: inference_record.h
+// Description: Table of recorded inference outputs keyed by observation, which can be saved and replayed without a model
+
+#ifndef HPTS_MODEL_INFERENCE_RECORD_H_
+#define HPTS_MODEL_INFERENCE_RECORD_H_
+
+// NOLINTBEGIN
+#include <absl/container/flat_hash_map.h>
+#include <absl/synchronization/mutex.h>
+// NOLINTEND
+
+#include <spdlog/spdlog.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common/observation.h"
+#include "model/twoheaded_convnet/twoheaded_convnet_heads.h"
+#include "util/concepts.h"
+#include "util/zip.h"
+
+namespace hpts::model {
+
+/**
+ * Key of the observation in the record, which is stable across runs and machines (unlike absl::Hash)
+ * @param observation The observation to key
+ * @return 64 bit hash of the observation values
+ */
+[[nodiscard]] auto observation_key(const Observation& observation) -> uint64_t;
+
+// Owned copy of a single inference output, which replayed outputs view into
+struct RecordedOutput {
+    static constexpr uint8_t POLICY = 1 << 0;
+    static constexpr uint8_t HEURISTIC = 1 << 1;
+
+    uint8_t fields = 0;    // Which of the outputs below were recorded
+    std::vector<float> logits;
+    std::vector<float> policy;
+    std::vector<float> log_policy;
+    double heuristic = 0;
+};
+
+// Key of an inference input in the record, with the outputs it needs
+struct RecordKey {
+    uint64_t observation;
+    uint8_t fields;    // RecordedOutput fields the input requested
+};
+
+namespace detail {
+void write_recorded_output(std::ofstream& stream, uint64_t key, const RecordedOutput& output);
+[[nodiscard]] auto read_recorded_output(std::ifstream& stream, uint64_t& key, RecordedOutput& output) -> bool;
+[[nodiscard]] auto write_record_header(std::ofstream& stream, uint64_t num_entries) -> bool;
+[[nodiscard]] auto read_record_header(std::ifstream& stream, uint64_t& num_entries) -> bool;
+}    // namespace detail
+
+// Maps observations to the inference outputs the model gave for them
+// Outputs with a policy are expected to be views (logits, policy, log_policy) kept alive by batch_storage, as produced by
+// the convnet wrappers, and replayed outputs view into the record in the same way.
+// Inputs which only requested some heads (i.e. the heuristic) are merged with other requests for the other heads.
+template <typename InferenceInputT, typename InferenceOutputT>
+class InferenceRecord {
+public:
+    /**
+     * Get the key of the input, which must be taken before the input is moved into the model
+     * @param input The inference input
+     * @return Key of the input
+     */
+    [[nodiscard]] static auto make_key(const InferenceInputT& input) -> RecordKey {
+        uint8_t heads = network::TwoHeadedConvNetHeads::ALL;
+        if constexpr (HasHeadMask<InferenceInputT>) {
+            heads = input.heads;
+        }
+        uint8_t fields = 0;
+        if (HasPolicy<InferenceOutputT> && (heads & network::TwoHeadedConvNetHeads::POLICY_HEAD)) {
+            fields |= RecordedOutput::POLICY;
+        }
+        if (HasHeuristic<InferenceOutputT> && (heads & network::TwoHeadedConvNetHeads::HEURISTIC)) {
+            fields |= RecordedOutput::HEURISTIC;
+        }
+        return {observation_key(input.observation), fields};
+    }
+
+    /**
+     * Record the outputs of a batch
+     * @param keys Key of each inferred input
+     * @param outputs Inference output of each input
+     */
+    void add(const std::vector<RecordKey>& keys, const std::vector<InferenceOutputT>& outputs) {
+        absl::MutexLock lock(&mutex_);
+        for (auto&& [key, output] : zip(keys, outputs)) {
+            auto recorded = std::make_shared<RecordedOutput>(to_recorded(output, key.fields));
+            if (const auto it = entries_.find(key.observation); it != entries_.end()) {
+                merge(*recorded, *it->second);
+            }
+            entries_[key.observation] = std::move(recorded);
+        }
+    }
+
+    /**
+     * Get the recorded output of the input
+     * @param key Key of the input
+     * @return The recorded output viewing into the record, or std::nullopt if the requested outputs were never recorded
+     */
+    [[nodiscard]] auto find(const RecordKey& key) const -> std::optional<InferenceOutputT> {
+        absl::MutexLock lock(&mutex_);
+        const auto it = entries_.find(key.observation);
+        if (it == entries_.end() || (it->second->fields & key.fields) != key.fields) {
+            return std::nullopt;
+        }
+        return from_recorded(it->second);
+    }
+
+    [[nodiscard]] auto size() const -> std::size_t {
+        absl::MutexLock lock(&mutex_);
+        return entries_.size();
+    }
+
+    /**
+     * Save the record to a compact binary file
+     * @param path Path of the record file
+     */
+    void save(const std::string& path) const {
+        absl::MutexLock lock(&mutex_);
+        std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+        if (!detail::write_record_header(stream, entries_.size())) {
+            SPDLOG_ERROR("Unable to write inference record {:s}", path);
+            return;
+        }
+        for (const auto& [key, output] : entries_) {
+            detail::write_recorded_output(stream, key, *output);
+        }
+        if (!stream) {
+            SPDLOG_ERROR("Unable to write inference record {:s}", path);
+            return;
+        }
+        SPDLOG_INFO("Saved {:d} recorded inference outputs to {:s}", entries_.size(), path);
+    }
+
+    /**
+     * Load a record saved with save(), replacing the current entries
+     * @param path Path of the record file
+     */
+    void load(const std::string& path) {
+        std::ifstream stream(path, std::ios::binary);
+        uint64_t num_entries = 0;
+        if (!stream.is_open() || !detail::read_record_header(stream, num_entries)) {
+            SPDLOG_ERROR("Inference record {:s} cannot be opened or is not an inference record.", path);
+            std::exit(1);
+        }
+        absl::MutexLock lock(&mutex_);
+        entries_.clear();
+        entries_.reserve(num_entries);
+        for (uint64_t i = 0; i < num_entries; ++i) {
+            uint64_t key = 0;
+            auto recorded = std::make_shared<RecordedOutput>();
+            if (!detail::read_recorded_output(stream, key, *recorded)) {
+                SPDLOG_ERROR("Inference record {:s} is truncated after {:d} of {:d} entries.", path, i, num_entries);
+                std::exit(1);
+            }
+            entries_[key] = std::move(recorded);
+        }
+        SPDLOG_INFO("Loaded {:d} recorded inference outputs from {:s}", entries_.size(), path);
+    }
+
+private:
+    // Only the outputs the input requested are recorded, as the others may not have been computed
+    [[nodiscard]] static auto to_recorded(const InferenceOutputT& output, uint8_t fields) -> RecordedOutput {
+        RecordedOutput recorded;
+        if constexpr (HasPolicy<InferenceOutputT>) {
+            if ((fields & RecordedOutput::POLICY) && !output.policy.empty()) {
+                recorded.fields |= RecordedOutput::POLICY;
+                recorded.logits.assign(output.logits.begin(), output.logits.end());
+                recorded.policy.assign(output.policy.begin(), output.policy.end());
+                recorded.log_policy.assign(output.log_policy.begin(), output.log_policy.end());
+            }
+        }
+        if constexpr (HasHeuristic<InferenceOutputT>) {
+            if (fields & RecordedOutput::HEURISTIC) {
+                recorded.fields |= RecordedOutput::HEURISTIC;
+                recorded.heuristic = output.heuristic;
+            }
+        }
+        return recorded;
+    }
+
+    // Outputs not requested this time (i.e. the policy of a heuristic only request) are kept from an earlier request
+    static void merge(RecordedOutput& recorded, const RecordedOutput& previous) {
+        if (!(recorded.fields & RecordedOutput::POLICY) && (previous.fields & RecordedOutput::POLICY)) {
+            recorded.fields |= RecordedOutput::POLICY;
+            recorded.logits = previous.logits;
+            recorded.policy = previous.policy;
+            recorded.log_policy = previous.log_policy;
+        }
+        if (!(recorded.fields & RecordedOutput::HEURISTIC) && (previous.fields & RecordedOutput::HEURISTIC)) {
+            recorded.fields |= RecordedOutput::HEURISTIC;
+            recorded.heuristic = previous.heuristic;
+        }
+    }
+
+    [[nodiscard]] static auto from_recorded(const std::shared_ptr<const RecordedOutput>& recorded) -> InferenceOutputT {
+        InferenceOutputT output{};
+        if constexpr (HasPolicy<InferenceOutputT>) {
+            output.logits = recorded->logits;
+            output.policy = recorded->policy;
+            output.log_policy = recorded->log_policy;
+            output.batch_storage = recorded;
+        }
+        if constexpr (HasHeuristic<InferenceOutputT>) {
+            output.heuristic = recorded->heuristic;
+        }
+        return output;
+    }
+
+    mutable absl::Mutex mutex_;
+    absl::flat_hash_map<uint64_t, std::shared_ptr<const RecordedOutput>> entries_;    // Recorded output per observation key
+};
+
+}    // namespace hpts::model
+
+#endif    // HPTS_MODEL_INFERENCE_RECORD_H_
@@ -0,0 +1,175 @@
+// File: inference_tuner.cpp
+// Description: Online tuner for the batch size and wait time the model evaluator coalesces requests with
+
+#include "model/inference_tuner.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstdint>
+
+namespace hpts::model {
+
+namespace {
+constexpr std::size_t HOLD_WINDOWS = 16;                   // Windows to hold the limits for once converged
+constexpr double MIN_IMPROVEMENT = 0.02;                   // Relative throughput gain needed to keep a move
+constexpr int NUM_LIMITS = 2;                              // Batch size and wait time
+const absl::Duration MIN_WAIT = absl::Microseconds(10);    // Smallest non-zero wait time
+const absl::Duration IDLE_GAP = absl::Seconds(1);          // Gap between batches which restarts the window
+}    // namespace
+
+InferenceTuner::InferenceTuner(std::size_t max_batch_size, absl::Duration max_wait, absl::Duration latency_cap,
+                               std::size_t window_batches)
+    : upper_batch_size_(std::max(max_batch_size, static_cast<std::size_t>(1))),
+      upper_wait_(std::max(max_wait, absl::ZeroDuration())),
+      latency_cap_(latency_cap),
+      window_batches_(std::max(window_batches, static_cast<std::size_t>(1))),
+      current_{upper_batch_size_, upper_wait_},
+      accepted_(current_) {}
+
+auto InferenceTuner::limits() const -> InferenceLimits {
+    absl::MutexLock lock(&mutex_);
+    return current_;
+}
+
+void InferenceTuner::record(std::size_t num_inputs, absl::Time dispatch, absl::Duration queue_delay,
+                            absl::Duration forward_latency) {
+    absl::MutexLock lock(&mutex_);
+    const absl::Time now = dispatch + forward_latency;
+    // Windows interrupted by an idle gap (i.e. training between search iterations) don't measure the limits
+    // The gap is from the end of the previous batch to this dispatch, so a slow forward pass or a long batching wait
+    // isn't mistaken for idling
+    const bool idle = dispatch - last_batch_end_ > IDLE_GAP;
+    // Batches from several device runners can overlap, so keep the latest end
+    last_batch_end_ = std::max(last_batch_end_, now);
+    if (idle) {
+        window_count_ = 0;
+        window_inputs_ = 0;
+        window_latency_ = absl::ZeroDuration();
+        window_start_ = now;
+        return;
+    }
+    ++window_count_;
+    window_inputs_ += num_inputs;
+    window_latency_ += queue_delay + forward_latency;
+    if (window_count_ < window_batches_) {
+        return;
+    }
+
+    const double throughput = static_cast<double>(window_inputs_) / absl::ToDoubleSeconds(now - window_start_);
+    const absl::Duration mean_latency = window_latency_ / static_cast<int64_t>(window_count_);
+    SPDLOG_DEBUG("Inference tuner window - batch: {:d}, wait: {:d}us, throughput: {:.0f}/s, mean batch: {:.1f}, "
+                 "mean latency: {:d}us",
+                 current_.max_batch_size, absl::ToInt64Microseconds(current_.max_wait), throughput,
+                 static_cast<double>(window_inputs_) / static_cast<double>(window_count_),
+                 absl::ToInt64Microseconds(mean_latency));
+    decide(throughput, mean_latency);
+    window_count_ = 0;
+    window_inputs_ = 0;
+    window_latency_ = absl::ZeroDuration();
+    window_start_ = now;
+}
+
+auto InferenceTuner::step(Limit limit, int direction) -> bool {
+    if (limit == Limit::BatchSize) {
+        const std::size_t batch_size = current_.max_batch_size;
+        const std::size_t next =
+            direction > 0 ? std::min(batch_size * 2, upper_batch_size_) : std::max(batch_size / 2, static_cast<std::size_t>(1));
+        current_.max_batch_size = next;
+        return next != batch_size;
+    }
+    const absl::Duration wait = current_.max_wait;
+    absl::Duration next;
+    if (direction > 0) {
+        next = std::min(wait == absl::ZeroDuration() ? MIN_WAIT : wait * 2, upper_wait_);
+    } else {
+        next = wait / 2 < MIN_WAIT ? absl::ZeroDuration() : wait / 2;
+    }
+    current_.max_wait = next;
+    return next != wait;
+}
+
+void InferenceTuner::propose() {
+    // Moves which can't be made (the limit is at its bound) count as not improving
+    while (true) {
+        if (exhausted_limits_ >= NUM_LIMITS) {
+            hold_windows_ = HOLD_WINDOWS;
+            exhausted_limits_ = 0;
+            SPDLOG_INFO("Inference tuner converged - batch: {:d}, wait: {:d}us, throughput: {:.0f}/s",
+                        accepted_.max_batch_size, absl::ToInt64Microseconds(accepted_.max_wait), accepted_throughput_);
+            return;
+        }
+        if (step(limit_, direction_)) {
+            trial_ = true;
+            return;
+        }
+        reject();
+    }
+}
+
+void InferenceTuner::reject() {
+    current_ = accepted_;
+    if (!flipped_) {
+        direction_ = -direction_;
+        flipped_ = true;
+    } else {
+        limit_ = limit_ == Limit::Wait ? Limit::BatchSize : Limit::Wait;
+        direction_ = -1;
+        flipped_ = false;
+        ++exhausted_limits_;
+    }
+}
+
+void InferenceTuner::decide(double throughput, absl::Duration mean_latency) {
+    if (latency_cap_ > absl::ZeroDuration() && mean_latency > latency_cap_) {
+        if (trial_) {
+            trial_ = false;
+            reject();
+        } else if (!step(Limit::Wait, -1) && !step(Limit::BatchSize, -1)) {
+            if (!cap_unreachable_) {
+                SPDLOG_WARN("Inference tuner can't meet the latency cap of {:d}us, mean latency: {:d}us",
+                            absl::ToInt64Microseconds(latency_cap_), absl::ToInt64Microseconds(mean_latency));
+                cap_unreachable_ = true;
+            }
+            return;
+        }
+        accepted_ = current_;
+        accepted_throughput_ = 0;
+        hold_windows_ = 0;
+        SPDLOG_INFO("Inference tuner over latency cap - mean latency: {:d}us, cap: {:d}us, next batch: {:d}, next wait: {:d}us",
+                    absl::ToInt64Microseconds(mean_latency), absl::ToInt64Microseconds(latency_cap_),
+                    current_.max_batch_size, absl::ToInt64Microseconds(current_.max_wait));
+        return;
+    }
+    cap_unreachable_ = false;
+
+    if (!trial_) {
+        // Window measured the accepted limits, used as the baseline for the next move
+        accepted_throughput_ = throughput;
+        if (hold_windows_ > 0) {
+            --hold_windows_;
+            return;
+        }
+        propose();
+        return;
+    }
+
+    trial_ = false;
+    if (throughput > accepted_throughput_ * (1 + MIN_IMPROVEMENT)) {
+        SPDLOG_INFO("Inference tuner accepted - batch: {:d}, wait: {:d}us, throughput: {:.0f}/s (was {:.0f}/s)",
+                    current_.max_batch_size, absl::ToInt64Microseconds(current_.max_wait), throughput, accepted_throughput_);
+        accepted_ = current_;
+        accepted_throughput_ = throughput;
+        // The opposite move is known to be worse, so keep moving this way or move on to the other limit
+        flipped_ = true;
+        exhausted_limits_ = 0;
+        propose();
+        return;
+    }
+    SPDLOG_DEBUG("Inference tuner rejected - batch: {:d}, wait: {:d}us, throughput: {:.0f}/s (accepted {:.0f}/s)",
+                 current_.max_batch_size, absl::ToInt64Microseconds(current_.max_wait), throughput, accepted_throughput_);
+    // Next window re-measures the accepted limits, so the baseline tracks drift in the load
+    reject();
+}
+
+}    // namespace hpts::model
@@ -0,0 +1,94 @@
+// File: inference_tuner.h
+// Description: Online tuner for the batch size and wait time the model evaluator coalesces requests with
+
+#ifndef HPTS_MODEL_INFERENCE_TUNER_H_
+#define HPTS_MODEL_INFERENCE_TUNER_H_
+
+// NOLINTBEGIN
+#include <absl/synchronization/mutex.h>
+#include <absl/time/time.h>
+// NOLINTEND
+
+#include <cstddef>
+
+namespace hpts::model {
+
+// Current limits the evaluator dispatches batches with
+struct InferenceLimits {
+    std::size_t max_batch_size;
+    absl::Duration max_wait;
+};
+
+// Hill climbs the evaluator batch size and wait time to maximise the number of inputs inferred per second.
+// Every window of batches measures the throughput of the current limits, after which one limit is doubled or halved
+// for the next window. A move is kept if it improves throughput, otherwise it is reverted and the other direction
+// (and then the other limit) is tried. Once no move improves, the limits are held for a while before exploring again,
+// as the best limits drift with the number of active searchers.
+// If a latency cap is given, windows where the mean latency of the oldest request of each batch (queueing delay plus
+// forward pass) exceeds it are never accepted, and the wait time (then batch size) is shrunk until under the cap.
+// The configured limits are the upper bounds of the search, so the tuner never batches larger or waits longer.
+class InferenceTuner {
+public:
+    static constexpr std::size_t DEFAULT_WINDOW_BATCHES = 64;
+
+    /**
+     * @param max_batch_size Upper bound (and starting value) of the batch size
+     * @param max_wait Upper bound (and starting value) of the wait time for more requests
+     * @param latency_cap Mean request latency which can't be exceeded, zero for no cap
+     * @param window_batches Number of batches measured before each decision
+     */
+    InferenceTuner(std::size_t max_batch_size, absl::Duration max_wait, absl::Duration latency_cap = absl::ZeroDuration(),
+                   std::size_t window_batches = DEFAULT_WINDOW_BATCHES);
+
+    /**
+     * Get the limits the next batch should be dispatched with
+     */
+    [[nodiscard]] auto limits() const -> InferenceLimits;
+
+    /**
+     * Record a dispatched batch, called from every device runner
+     * @param num_inputs Number of inputs in the batch
+     * @param dispatch Time the batch was dispatched
+     * @param queue_delay Time the oldest request of the batch waited before dispatch
+     * @param forward_latency Time taken to run inference on the batch
+     */
+    void record(std::size_t num_inputs, absl::Time dispatch, absl::Duration queue_delay, absl::Duration forward_latency);
+
+private:
+    enum class Limit { BatchSize, Wait };
+
+    // Move the given limit in the given direction, returning false if already at its bound
+    [[nodiscard]] auto step(Limit limit, int direction) -> bool;
+    // Propose the next move to measure after the accepted limits were measured, or hold if converged
+    void propose();
+    // Revert to the accepted limits, and pick the next direction or limit to move
+    void reject();
+    // Decide on the window which just finished
+    void decide(double throughput, absl::Duration mean_latency);
+
+    const std::size_t upper_batch_size_;
+    const absl::Duration upper_wait_;
+    const absl::Duration latency_cap_;
+    const std::size_t window_batches_;
+
+    mutable absl::Mutex mutex_;
+    InferenceLimits current_;                             // Limits currently dispatched with
+    InferenceLimits accepted_;                            // Best limits found, reverted to if a move doesn't improve
+    double accepted_throughput_ = 0;                      // Throughput of the accepted limits, 0 if not yet measured
+    bool trial_ = false;                                  // Whether the current limits are a move under trial
+    Limit limit_ = Limit::Wait;                           // Limit currently being moved
+    int direction_ = -1;                                  // Direction the limit is being moved in
+    bool flipped_ = false;                                // Whether the other direction of the limit was already tried
+    int exhausted_limits_ = 0;                            // Limits with no improving move since the last accepted move
+    std::size_t hold_windows_ = 0;                        // Windows left to hold the limits for once converged
+    bool cap_unreachable_ = false;                        // Whether the latency cap was missed at the smallest limits
+    std::size_t window_count_ = 0;                        // Batches recorded in the current window
+    std::size_t window_inputs_ = 0;                       // Inputs recorded in the current window
+    absl::Duration window_latency_;                       // Summed latency of the oldest request of each batch
+    absl::Time window_start_;                             // Time the current window started
+    absl::Time last_batch_end_ = absl::InfinitePast();    // Time the latest recorded batch finished inference
+};
+
+}    // namespace hpts::model
+
+#endif    // HPTS_MODEL_INFERENCE_TUNER_H_
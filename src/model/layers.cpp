@@ -50,6 +50,22 @@ torch::nn::AvgPool2dOptions avg_pool3x3(int kernel_size, int stride, int padding
     return torch::nn::AvgPool2dOptions(kernel_size).stride(stride).padding(padding);
 }
 
+void fuse_conv_batchnorm(torch::nn::Conv2d &conv, const torch::nn::BatchNorm2d &batch_norm) {
+    assert(conv->bias.defined());
+    const torch::NoGradGuard no_grad;
+    // y = gamma * (conv(x) - mean) / sqrt(var + eps) + beta = (scale * W) x + scale * (b - mean) + beta
+    const torch::Tensor scale = batch_norm->weight / torch::sqrt(batch_norm->running_var + batch_norm->options.eps());
+    conv->weight.mul_(scale.reshape({-1, 1, 1, 1}));
+    conv->bias.sub_(batch_norm->running_mean).mul_(scale).add_(batch_norm->bias);
+}
+
+void copy_conv_group(const torch::nn::Conv2d &src, torch::nn::Conv2d &dst, int group) {
+    const torch::NoGradGuard no_grad;
+    const int64_t out_channels = src->weight.size(0);
+    dst->weight.narrow(0, group * out_channels, out_channels).copy_(src->weight);
+    dst->bias.narrow(0, group * out_channels, out_channels).copy_(src->bias);
+}
+
 // Create a batchnorm2d layer using pytorch defaults
 torch::nn::BatchNorm2dOptions bn(int num_filters) {
     return {num_filters};
@@ -58,14 +74,21 @@ torch::nn::BatchNorm2dOptions bn(int num_filters) {
 
 // ------------------------------- MLP Network ------------------------------
 // MLP
-MLPImpl::MLPImpl(int input_size, const std::vector<int> &layer_sizes, int output_size, const std::string &name) {
+MLPImpl::MLPImpl(int input_size, const std::vector<int> &layer_sizes, int output_size, const std::string &name, int rank) {
     std::vector<int> sizes = layer_sizes;
     sizes.insert(sizes.begin(), input_size);
     sizes.push_back(output_size);
 
     // Walk through adding layers
     for (std::size_t i = 0; i < sizes.size() - 1; ++i) {
-        layers->push_back("linear_" + std::to_string(i), torch::nn::Linear(sizes[i], sizes[i + 1]));
+        // Only factor layers where in * rank + rank * out weights is fewer than in * out
+        if (rank > 0 && rank * (sizes[i] + sizes[i + 1]) < sizes[i] * sizes[i + 1]) {
+            layers->push_back("linear_" + std::to_string(i) + "_factor",
+                              torch::nn::Linear(torch::nn::LinearOptions(sizes[i], rank).bias(false)));
+            layers->push_back("linear_" + std::to_string(i), torch::nn::Linear(rank, sizes[i + 1]));
+        } else {
+            layers->push_back("linear_" + std::to_string(i), torch::nn::Linear(sizes[i], sizes[i + 1]));
+        }
         if (i < sizes.size() - 2) {
             layers->push_back("activation_" + std::to_string(i), torch::nn::ReLU());
         }
@@ -77,14 +100,78 @@ auto MLPImpl::forward(torch::Tensor x) -> torch::Tensor {
     torch::Tensor output = layers->forward(x);
     return output;
 }
+
+void MLPImpl::factorize_from(const MLPImpl &src) {
+    const torch::NoGradGuard no_grad;
+    std::size_t dst_idx = 0;
+    for (std::size_t i = 0; i < src.layers->size(); ++i, ++dst_idx) {
+        const auto *src_linear = src.layers->ptr(i)->as<torch::nn::Linear>();
+        if (src_linear == nullptr) {
+            continue;
+        }
+        auto *linear = layers->ptr(dst_idx)->as<torch::nn::Linear>();
+        assert(linear != nullptr);
+        if (linear->weight.sizes() == src_linear->weight.sizes()) {
+            linear->weight.copy_(src_linear->weight);
+            linear->bias.copy_(src_linear->bias);
+            continue;
+        }
+        // W = U diag(S) V^T ~ (U_r diag(sqrt(S_r))) (diag(sqrt(S_r)) V_r^T), splitting the singular values evenly
+        auto *linear_out = layers->ptr(++dst_idx)->as<torch::nn::Linear>();
+        const int64_t rank = linear->weight.size(0);
+        const auto [u, s, vh] = torch::linalg_svd(src_linear->weight, false);
+        const torch::Tensor sqrt_s = s.narrow(0, 0, rank).sqrt();
+        linear->weight.copy_(sqrt_s.unsqueeze(1) * vh.narrow(0, 0, rank));
+        linear_out->weight.copy_(u.narrow(1, 0, rank) * sqrt_s.unsqueeze(0));
+        linear_out->bias.copy_(src_linear->bias);
+    }
+}
+
+// Grouped MLP
+GroupedMLPImpl::GroupedMLPImpl(int groups, int input_size, const std::vector<int> &layer_sizes, int output_size,
+                               const std::string &name) {
+    std::vector<int> sizes = layer_sizes;
+    sizes.insert(sizes.begin(), input_size);
+    sizes.push_back(output_size);
+
+    // Walk through adding layers, a grouped 1x1 conv over a length 1 sequence is a linear layer per group
+    for (std::size_t i = 0; i < sizes.size() - 1; ++i) {
+        layers->push_back("linear_" + std::to_string(i),
+                          torch::nn::Conv1d(conv1x1_1d(sizes[i] * groups, sizes[i + 1] * groups, groups)));
+        if (i < sizes.size() - 2) {
+            layers->push_back("activation_" + std::to_string(i), torch::nn::ReLU());
+        }
+    }
+    register_module(name + "mlp", layers);
+}
+
+auto GroupedMLPImpl::forward(torch::Tensor x) -> torch::Tensor {
+    torch::Tensor output = layers->forward(x.unsqueeze(-1));
+    return output.squeeze(-1);
+}
+
+void GroupedMLPImpl::copy_group(int group, const MLPImpl &src) {
+    assert(layers->size() == src.layers->size());
+    const torch::NoGradGuard no_grad;
+    for (std::size_t i = 0; i < layers->size(); ++i) {
+        const auto *linear = src.layers->ptr(i)->as<torch::nn::Linear>();
+        if (linear == nullptr) {
+            continue;
+        }
+        auto *conv = layers->ptr(i)->as<torch::nn::Conv1d>();
+        const int64_t out_features = linear->weight.size(0);
+        conv->weight.narrow(0, group * out_features, out_features).copy_(linear->weight.unsqueeze(-1));
+        conv->bias.narrow(0, group * out_features, out_features).copy_(linear->bias);
+    }
+}
 // ------------------------------- MLP Network ------------------------------
 
 // ------------------------------ ResNet Block ------------------------------
 // Main ResNet style residual block
-ResidualBlockImpl::ResidualBlockImpl(int num_channels, int layer_num, bool use_batchnorm, int groups)
-    : conv1(conv3x3(num_channels, num_channels, 1, 1, true, groups)),
-      conv2(conv3x3(num_channels, num_channels, 1, 1, true, groups)),
-      batch_norm1(bn(num_channels)),
+ResidualBlockImpl::ResidualBlockImpl(int num_channels, int layer_num, bool use_batchnorm, int groups, int bottleneck_channels)
+    : conv1(conv3x3(num_channels, bottleneck_channels > 0 ? bottleneck_channels : num_channels, 1, 1, true, groups)),
+      conv2(conv3x3(bottleneck_channels > 0 ? bottleneck_channels : num_channels, num_channels, 1, 1, true, groups)),
+      batch_norm1(bn(bottleneck_channels > 0 ? bottleneck_channels : num_channels)),
       batch_norm2(bn(num_channels)),
       use_batchnorm(use_batchnorm) {
     register_module("resnet_" + std::to_string(layer_num) + "_conv1", conv1);
@@ -110,14 +197,62 @@ auto ResidualBlockImpl::forward(torch::Tensor x) -> torch::Tensor {
     output = torch::relu(output);
     return output;
 }
+
+void ResidualBlockImpl::fuse_batchnorm() {
+    if (!use_batchnorm) {
+        return;
+    }
+    fuse_conv_batchnorm(conv1, batch_norm1);
+    fuse_conv_batchnorm(conv2, batch_norm2);
+    use_batchnorm = false;
+}
+
+void ResidualBlockImpl::copy_group(int group, const ResidualBlockImpl &src) {
+    assert(!use_batchnorm && !src.use_batchnorm);
+    copy_conv_group(src.conv1, conv1, group);
+    copy_conv_group(src.conv2, conv2, group);
+}
+
+void ResidualBlockImpl::prune_from(const ResidualBlockImpl &src) {
+    assert(use_batchnorm == src.use_batchnorm);
+    const torch::NoGradGuard no_grad;
+    const int64_t bottleneck_channels = conv1->weight.size(0);
+
+    // Importance of a bottleneck channel is the L1 norm of its conv1 filter, scaled by the batchnorm applied to it
+    torch::Tensor importance = src.conv1->weight.abs().sum({1, 2, 3});
+    if (src.use_batchnorm) {
+        const auto &bn1 = src.batch_norm1;
+        importance.mul_((bn1->weight / torch::sqrt(bn1->running_var + bn1->options.eps())).abs());
+    }
+    const torch::Tensor keep = std::get<0>(torch::sort(std::get<1>(importance.topk(bottleneck_channels))));
+
+    // Pruned channels are dropped from the conv1 outputs and the conv2 inputs, the block output is unchanged
+    conv1->weight.copy_(src.conv1->weight.index_select(0, keep));
+    conv1->bias.copy_(src.conv1->bias.index_select(0, keep));
+    conv2->weight.copy_(src.conv2->weight.index_select(1, keep));
+    conv2->bias.copy_(src.conv2->bias);
+    if (use_batchnorm) {
+        batch_norm1->weight.copy_(src.batch_norm1->weight.index_select(0, keep));
+        batch_norm1->bias.copy_(src.batch_norm1->bias.index_select(0, keep));
+        batch_norm1->running_mean.copy_(src.batch_norm1->running_mean.index_select(0, keep));
+        batch_norm1->running_var.copy_(src.batch_norm1->running_var.index_select(0, keep));
+        batch_norm2->weight.copy_(src.batch_norm2->weight);
+        batch_norm2->bias.copy_(src.batch_norm2->bias);
+        batch_norm2->running_mean.copy_(src.batch_norm2->running_mean);
+        batch_norm2->running_var.copy_(src.batch_norm2->running_var);
+    }
+}
 // ------------------------------ ResNet Block ------------------------------
 
 // ------------------------------ ResNet Head -------------------------------
 // Initial input convolutional before ResNet residual blocks
 // Primary use is to take N channels and set to the expected number
 //   of channels for the rest of the resnet body
-ResidualHeadImpl::ResidualHeadImpl(int input_channels, int output_channels, bool use_batchnorm, const std::string &name_prefix)
-    : conv(conv3x3(input_channels, output_channels)), batch_norm(bn(output_channels)), use_batchnorm(use_batchnorm) {
+ResidualHeadImpl::ResidualHeadImpl(int input_channels, int output_channels, bool use_batchnorm, const std::string &name_prefix,
+                                   int groups)
+    : conv(conv3x3(input_channels, output_channels, 1, 1, true, groups)),
+      batch_norm(bn(output_channels)),
+      use_batchnorm(use_batchnorm) {
     register_module(name_prefix + "resnet_head_conv", conv);
     if (use_batchnorm) {
         register_module(name_prefix + "resnet_head_bn", batch_norm);
@@ -125,7 +260,7 @@ ResidualHeadImpl::ResidualHeadImpl(int input_channels, int output_channels, bool
 }
 
 auto ResidualHeadImpl::forward(torch::Tensor x) -> torch::Tensor {
-    torch::Tensor output = conv(x);
+    torch::Tensor output = x.scalar_type() == torch::kByte ? sparse_conv(x) : conv(x);
     if (use_batchnorm) {
         output = batch_norm(output);
     }
@@ -133,6 +268,43 @@ auto ResidualHeadImpl::forward(torch::Tensor x) -> torch::Tensor {
     return output;
 }
 
+auto ResidualHeadImpl::sparse_conv(const torch::Tensor &indices) -> torch::Tensor {
+    const int64_t batch_size = indices.size(0);
+    const int64_t height = indices.size(2);
+    const int64_t width = indices.size(3);
+    const int64_t out_channels = conv->weight.size(0);
+    const int64_t in_channels = conv->weight.size(1);
+    const int64_t kernel_size = conv->weight.size(2) * conv->weight.size(3);
+    assert(conv->options.groups() == 1);
+
+    // Row c holds the flipped kernel of input channel c, as each cell adds into its neighbours instead of reading them
+    // An extra zero row is looked up by cells without an active channel
+    torch::Tensor table = conv->weight.flip({2, 3}).transpose(0, 1).reshape({in_channels, out_channels * kernel_size});
+    table = torch::cat({table, torch::zeros({1, out_channels * kernel_size}, table.options())});
+
+    // (batch_size, planes, h, w) -> (batch_size, out_channels * 3 * 3, h * w)
+    torch::Tensor columns = torch::embedding(table, indices.to(torch::kLong)).sum(1);
+    columns = columns.view({batch_size, height * width, out_channels * kernel_size}).transpose(1, 2);
+
+    // Fold sums each cell's kernel into its 3x3 neighbourhood, dropping what lands in the zero padding
+    namespace F = torch::nn::functional;
+    const torch::Tensor output = F::fold(columns, F::FoldFuncOptions({height, width}, {3, 3}).padding(1));
+    return output + conv->bias.view({1, -1, 1, 1});
+}
+
+void ResidualHeadImpl::fuse_batchnorm() {
+    if (!use_batchnorm) {
+        return;
+    }
+    fuse_conv_batchnorm(conv, batch_norm);
+    use_batchnorm = false;
+}
+
+void ResidualHeadImpl::copy_group(int group, const ResidualHeadImpl &src) {
+    assert(!use_batchnorm && !src.use_batchnorm);
+    copy_conv_group(src.conv, conv, group);
+}
+
 // Shape doesn't change
 ObservationShape ResidualHeadImpl::encoded_state_shape(ObservationShape observation_shape) {
     return observation_shape;
@@ -22,6 +22,22 @@ torch::nn::Conv2dOptions conv3x3(int in_channels, int out_channels, int stride =
                                  int groups = 1);
 torch::nn::AvgPool2dOptions avg_pool3x3(int kernel_size, int stride, int padding);
 
+/**
+ * Fold an eval-mode batchnorm which follows the given convolution into the convolution weights and bias
+ * @note The convolution must have a bias, and the batchnorm should no longer be applied afterwards
+ * @param conv The convolution to fold into
+ * @param batch_norm The batchnorm following the convolution
+ */
+void fuse_conv_batchnorm(torch::nn::Conv2d &conv, const torch::nn::BatchNorm2d &batch_norm);
+
+/**
+ * Copy the weights and bias of a convolution into one group of a grouped convolution of the same per-group shape
+ * @param src The ungrouped convolution to copy from
+ * @param dst The grouped convolution to copy into
+ * @param group The group index of dst to copy into
+ */
+void copy_conv_group(const torch::nn::Conv2d &src, torch::nn::Conv2d &dst, int group);
+
 // MLP
 class MLPImpl : public torch::nn::Module {
 public:
@@ -29,15 +45,39 @@ public:
      * @param input_size Size of the input layer
      * @param layer_sizes Vector of sizes for each hidden layer
      * @param output_size Size of the output layer
+     * @param rank If > 0, linear layers which get smaller are factored into two linear layers through this rank
      */
-    MLPImpl(int input_size, const std::vector<int> &layer_sizes, int output_size, const std::string &name);
+    MLPImpl(int input_size, const std::vector<int> &layer_sizes, int output_size, const std::string &name, int rank = 0);
     [[nodiscard]] auto forward(torch::Tensor x) -> torch::Tensor;
+    // Copy the weights of an unfactored MLP of the same sizes, using the truncated SVD for the factored layers
+    void factorize_from(const MLPImpl &src);
 
 private:
     torch::nn::Sequential layers;
+    friend class GroupedMLPImpl;
 };
 TORCH_MODULE(MLP);
 
+// Independent MLPs run side by side in a single pass, using grouped 1x1 convolutions in place of linear layers
+class GroupedMLPImpl : public torch::nn::Module {
+public:
+    /**
+     * @param groups Number of independent MLPs
+     * @param input_size Size of the input layer of each MLP
+     * @param layer_sizes Vector of sizes for each hidden layer of each MLP
+     * @param output_size Size of the output layer of each MLP
+     */
+    GroupedMLPImpl(int groups, int input_size, const std::vector<int> &layer_sizes, int output_size, const std::string &name);
+    // Input -> [batch_size, groups * input_size], output -> [batch_size, groups * output_size]
+    [[nodiscard]] auto forward(torch::Tensor x) -> torch::Tensor;
+    // Copy the weights of an MLP of the same sizes into the given group
+    void copy_group(int group, const MLPImpl &src);
+
+private:
+    torch::nn::Sequential layers;
+};
+TORCH_MODULE(GroupedMLP);
+
 // Main ResNet style residual block
 class ResidualBlockImpl : public torch::nn::Module {
 public:
@@ -45,9 +85,16 @@ public:
      * @param num_channels Number of channels for the resnet block
      * @param layer_num Layer number id, used for pretty printing
      * @param use_batchnorm Flag to use batch normalization
+     * @param bottleneck_channels Number of channels between the two convolutions, 0 to use num_channels
      */
-    ResidualBlockImpl(int num_channels, int layer_num, bool use_batchnorm, int groups = 1);
+    ResidualBlockImpl(int num_channels, int layer_num, bool use_batchnorm, int groups = 1, int bottleneck_channels = 0);
     [[nodiscard]] auto forward(torch::Tensor x) -> torch::Tensor;
+    // Copy the weights of a block with at least as many bottleneck channels, keeping the most important channels
+    void prune_from(const ResidualBlockImpl &src);
+    // Fold the batchnorm statistics into the convolutions for inference, disabling the batchnorm layers
+    void fuse_batchnorm();
+    // Copy the weights of a block without batchnorm into the given group of this grouped block
+    void copy_group(int group, const ResidualBlockImpl &src);
 
 private:
     torch::nn::Conv2d conv1;
@@ -71,13 +118,28 @@ public:
      *                        channels used for the resnet body
      * @param use_batchnorm Flag to use batch normalization
      * @param name_prefix Used to ID the sub-module for pretty printing
+     * @param groups Number of independent groups the channels are split into
+     * @note Byte inputs are treated as sparse active channel indices (see sparse_conv), which requires groups = 1
      */
-    ResidualHeadImpl(int input_channels, int output_channels, bool use_batchnorm, const std::string &name_prefix = "");
+    ResidualHeadImpl(int input_channels, int output_channels, bool use_batchnorm, const std::string &name_prefix = "",
+                     int groups = 1);
     [[nodiscard]] auto forward(torch::Tensor x) -> torch::Tensor;
+    // Fold the batchnorm statistics into the convolution for inference, disabling the batchnorm layer
+    void fuse_batchnorm();
+    // Copy the weights of a head without batchnorm into the given group of this grouped head
+    void copy_group(int group, const ResidualHeadImpl &src);
     // Get the observation shape the network outputs given the input
     static ObservationShape encoded_state_shape(ObservationShape observation_shape);
 
 private:
+    /**
+     * Equivalent of the dense conv over one-hot input planes, given the active channel index of each cell instead.
+     * Each active channel looks up its (flipped) kernel from the dense conv weights, which are folded into the 3x3
+     * neighbourhood of the cell, so the dense weights are used and checkpointed as is.
+     * @param indices Active channel indices, input_channels for no active channel -> [batch_size, num_planes, h, w]
+     */
+    [[nodiscard]] auto sparse_conv(const torch::Tensor &indices) -> torch::Tensor;
+
     torch::nn::Conv2d conv;
     torch::nn::BatchNorm2d batch_norm;
     bool use_batchnorm;
@@ -22,6 +22,13 @@ auto cross_entropy_loss(torch::Tensor logits, torch::Tensor target_actions, bool
     return reduce ? loss.mean() : loss;
 }
 
+auto kl_divergence_loss(torch::Tensor logits, torch::Tensor target_policy, bool reduce) -> torch::Tensor {
+    // Zero target probabilities contribute nothing, xlogy keeps them from producing 0 * -inf
+    const torch::Tensor loss =
+        (torch::xlogy(target_policy, target_policy) - target_policy * torch::log_softmax(logits, 1)).sum(1, true);
+    return reduce ? loss.mean() : loss;
+}
+
 auto mean_squared_error_loss(torch::Tensor output, torch::Tensor target, bool reduce) -> torch::Tensor {
     return torch::mse_loss(output, target, reduce ? at::Reduction::Mean : at::Reduction::None);
 }
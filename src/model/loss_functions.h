@@ -32,6 +32,15 @@ auto policy_gradient_loss(torch::Tensor logits, torch::Tensor target_actions, to
  */
 auto cross_entropy_loss(torch::Tensor logits, torch::Tensor target_actions, bool reduce = true) -> torch::Tensor;
 
+/**
+ * KL divergence from a target policy (i.e. a teacher network) to the policy of the logits
+ * @param logits (B, num_actions)
+ * @param target_policy (B, num_actions)
+ * @param reduce Flag to mean reduce
+ * @return Tensor loss, (B, 1) if not reduced
+ */
+auto kl_divergence_loss(torch::Tensor logits, torch::Tensor target_policy, bool reduce = true) -> torch::Tensor;
+
 /**
  * Mean Squared Error loss
  * @param output (*)
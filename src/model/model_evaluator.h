@@ -14,13 +14,14 @@
 // --------------------------------------------------------------------
 // File: model_evaluator.h
 // Description: Interfaces between user code and device manager/ModelWrapper
-//              Can spawn threads for inference if
+//              Spawns a thread per device which batches inference requests across search threads
 
 #ifndef HPTS_MODEL_EVALUATOR_H_
 #define HPTS_MODEL_EVALUATOR_H_
 
 // NOLINTBEGIN
 #include <absl/synchronization/mutex.h>
+#include <absl/time/time.h>
 #ifdef DEBUG_PRINT
 #define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_DEBUG
 #else
@@ -29,19 +30,29 @@
 #include <spdlog/spdlog.h>
 // NOLINTEND
 
+#include <algorithm>
+#include <cassert>
 #include <concepts>
+#include <exception>
 #include <future>
+#include <iterator>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <thread>
 #include <unordered_map>
 #include <vector>
 
+#include "model/checkpoint_writer.h"
 #include "model/device_manager.h"
+#include "model/inference_record.h"
+#include "model/inference_tuner.h"
 #include "util/concepts.h"
+#include "util/cpu_affinity.h"
 #include "util/queue.h"
 #include "util/stop_token.h"
 #include "util/thread_mapper.h"
+#include "util/utility.h"
 #include "util/zip.h"
 
 namespace hpts::model {
@@ -49,12 +60,27 @@ namespace hpts::model {
 // Forward declaration
 template <ModelWrapper ModelWrapperT>
 class ModelEvaluator;
+template <ModelWrapper ModelWrapperT>
+class ReplayEvaluator;
 
 // Concept to check if specialization of ModelEvaluator
 template <typename T>
 concept IsModelEvaluator = IsSpecialization<T, ModelEvaluator>;
 
+// Concept to check if an evaluator which only serves inference requests, i.e. a ModelEvaluator or a ReplayEvaluator
+// Users which also learn or checkpoint through the evaluator must use IsModelEvaluator
+template <typename T>
+concept IsInferenceEvaluator = IsModelEvaluator<T> || IsSpecialization<T, ReplayEvaluator>;
+
 // Handles threaded queries for the model
+// Inference requests from all search threads are queued and coalesced by one worker thread per device into larger
+// batches, which are dispatched once max_batch_size inputs are gathered, every active searcher has a request queued,
+// or max_wait has passed since the first request of the batch arrived.
+// An optional cascade model (a smaller network of the same type) can be run on every batch first, with only the inputs
+// it is unsure about escalated to the full model.
+// An optional tuner adapts the batch size and wait time (bounded by max_batch_size and max_wait) at runtime from the
+// measured throughput, queueing delay and forward latency of each batch.
+// All outputs can also be recorded against their observations, to later be replayed by ReplayEvaluator.
 template <ModelWrapper ModelWrapperT>
 class ModelEvaluator {
 public:
@@ -64,12 +90,41 @@ public:
     using LearningInput = ModelWrapperT::LearningInput;
     using BaseType = ModelWrapperT::BaseType;
 
+    static constexpr std::size_t DEFAULT_MAX_BATCH_SIZE = 1024;
+    static constexpr int DEFAULT_MAX_WAIT_US = 1000;
+
     /**
      * @param device_manager Pointer to device manager (holds the models on devices)
      * @param search_threads Number of threads which have a handle on the evaulator
+     * @param max_batch_size Maximum number of inference inputs to coalesce into a single forward pass
+     * @param max_wait Maximum time to wait for other requests once the first request of a batch arrives
+     * @param cascade_device_manager Optional device manager of the cascade model, which is run on every input first
+     * @param cascade_entropy_threshold Inputs with a cascade policy entropy (in nats) above this use the full model
+     * @param inference_tuner Optional tuner which adapts the batch size and wait time, used in place of the fixed limits
      */
-    explicit ModelEvaluator(std::unique_ptr<DeviceManager<ModelWrapperT>> device_manager, int search_threads)
-        : device_manager_(std::move(device_manager)), queue_(search_threads * 4) {
+    explicit ModelEvaluator(std::unique_ptr<DeviceManager<ModelWrapperT>> device_manager, int search_threads,
+                            std::size_t max_batch_size = DEFAULT_MAX_BATCH_SIZE,
+                            absl::Duration max_wait = absl::Microseconds(DEFAULT_MAX_WAIT_US),
+                            std::unique_ptr<DeviceManager<ModelWrapperT>> cascade_device_manager = nullptr,
+                            double cascade_entropy_threshold = 0,
+                            std::unique_ptr<InferenceTuner> inference_tuner = nullptr)
+        : device_manager_(std::move(device_manager)),
+          cascade_device_manager_(std::move(cascade_device_manager)),
+          cascade_entropy_threshold_(cascade_entropy_threshold),
+          queue_(std::max(search_threads, 1) * 4),
+          max_batch_size_(std::max(max_batch_size, static_cast<std::size_t>(1))),
+          max_wait_(max_wait),
+          inference_tuner_(std::move(inference_tuner)) {
+        if constexpr (!HasPolicy<InferenceOutput>) {
+            if (cascade_device_manager_) {
+                SPDLOG_ERROR("Cascade inference requires a model with a policy output.");
+                throw std::invalid_argument("Cascade inference requires a model with a policy output.");
+            }
+        }
+        if (cascade_device_manager_ && cascade_device_manager_->Count() == 0) {
+            SPDLOG_ERROR("Cascade device manager requires at least one device.");
+            throw std::invalid_argument("Cascade device manager requires at least one device.");
+        }
         // Reserve space and spawn threads on inference runner
         // One thread per device
         inference_threads_.reserve(device_manager_->Count());
@@ -79,13 +134,15 @@ public:
     }
 
     ~ModelEvaluator() {
-        // Clear the incoming queues and stop oustanding threads
+        // Stop accepting requests, let the runners drain what is queued, then stop outstanding threads
         stop_token_.stop();
         queue_.BlockNewValues();
-        queue_.Clear();
         for (auto& t : inference_threads_) {
             t.join();
         }
+        if (inference_record_) {
+            inference_record_->save(inference_record_path_);
+        }
     }
 
     // Doesn't make sense to copy/move
@@ -95,35 +152,63 @@ public:
     ModelEvaluator operator=(ModelEvaluator&&) = delete;
 
     /**
-     * Perform inference for a group of observations, single-threaded
+     * Perform inference for a group of observations, batched with the requests of other search threads.
+     * Blocks until the outputs are ready.
+     * @note The inference inputs are moved into the request
      * @param inference_inputs inputs for inference
      * @return inference outputs
      */
     [[nodiscard]] auto Inference(std::vector<InferenceInput>& inference_inputs) -> std::vector<InferenceOutput> {
-        return device_manager_->Get(1)->Inference(inference_inputs);
+        return InferenceAsync(std::move(inference_inputs)).get();
     }
 
     /**
-     * Perform inference for a group of observations, single-threaded
+     * Perform inference for a group of observations, batched with the requests of other search threads.
+     * Blocks until the outputs are ready.
      * @param inference_inputs inputs for inference
      * @return inference outputs
      */
     [[nodiscard]] auto InferenceBatched(std::vector<InferenceInput>&& inference_inputs) -> std::vector<InferenceOutput> {
+        return InferenceAsync(std::move(inference_inputs)).get();
+    }
+
+    /**
+     * Queue a group of observations for batched inference without waiting, so the caller can continue working
+     * @param inference_inputs inputs for inference
+     * @return future holding the inference outputs
+     */
+    [[nodiscard]] auto InferenceAsync(std::vector<InferenceInput>&& inference_inputs) -> std::future<std::vector<InferenceOutput>> {
         std::promise<std::vector<InferenceOutput>> prom;
         std::future<std::vector<InferenceOutput>> fut = prom.get_future();
-        queue_.Push(QueueItem{inference_inputs, inference_inputs.size(), &prom});
-        return fut.get();
+        if (inference_inputs.empty()) {
+            prom.set_value({});
+            return fut;
+        }
+        const std::size_t N = inference_inputs.size();
+        if (!queue_.Push(QueueItem{std::move(inference_inputs), N, std::move(prom), absl::Now()})) {
+            SPDLOG_ERROR("Inference requested after the evaluator has shut down.");
+            throw std::logic_error("Inference requested after the evaluator has shut down.");
+        }
+        return fut;
     }
 
     [[nodiscard]] auto get_device_manager() -> DeviceManager<ModelWrapperT>* {
         return device_manager_.get();
     }
 
+    /**
+     * Get the device manager of the cascade model
+     * @return Device manager, or nullptr if cascade inference isn't used
+     */
+    [[nodiscard]] auto get_cascade_device_manager() -> DeviceManager<ModelWrapperT>* {
+        return cascade_device_manager_.get();
+    }
+
     /**
      * Print the model
      */
     void print() {
-        get_device_manager()->Get(0, 0)->print();
+        for_each_device_manager([](auto& device_manager) { device_manager.Get(0, 0)->print(); });
     }
 
     /**
@@ -131,7 +216,7 @@ public:
      * @param step checkpoint step to load from
      */
     void load(long long int step = -1) {
-        get_device_manager()->load_all(step);
+        for_each_device_manager([&](auto& device_manager) { device_manager.load_all(step); });
     }
 
     /**
@@ -139,7 +224,7 @@ public:
      * @param step checkpoint step to load from
      */
     void load_without_optimizer(long long int step = -1) {
-        get_device_manager()->load_all_without_optimizer(step);
+        for_each_device_manager([&](auto& device_manager) { device_manager.load_all_without_optimizer(step); });
     }
 
     /**
@@ -147,7 +232,7 @@ public:
      * @param step Checkpoint number to save as
      */
     void checkpoint_and_sync(long long int step = -1) {
-        get_device_manager()->checkpoint_and_sync(step);
+        for_each_device_manager([&](auto& device_manager) { device_manager.checkpoint_and_sync(step); });
     }
 
     /**
@@ -155,7 +240,14 @@ public:
      * @param step Checkpoint number to save as
      */
     void checkpoint_and_sync_without_optimizer(long long int step = -1) {
-        get_device_manager()->checkpoint_and_sync_without_optimizer(step);
+        for_each_device_manager([&](auto& device_manager) { device_manager.checkpoint_and_sync_without_optimizer(step); });
+    }
+
+    /**
+     * Copy the weights of the learning device to all other devices in memory, without checkpointing
+     */
+    void sync_weights() {
+        for_each_device_manager([](auto& device_manager) { device_manager.sync_weights(0); });
     }
 
     /**
@@ -163,7 +255,7 @@ public:
      * @param step Checkpoint number to save as
      */
     void save_checkpoint(long long int step = -1) {
-        get_device_manager()->Get(0, 0)->SaveCheckpoint(step);
+        for_each_device_manager([&](auto& device_manager) { device_manager.Get(0, 0)->SaveCheckpoint(step); });
     }
 
     /**
@@ -171,7 +263,24 @@ public:
      * @param step Checkpoint number to save as
      */
     void save_checkpoint_without_optimizer(long long int step = -1) {
-        get_device_manager()->Get(0, 0)->SaveCheckpointWithoutOptimizer(step);
+        for_each_device_manager([&](auto& device_manager) { device_manager.Get(0, 0)->SaveCheckpointWithoutOptimizer(step); });
+    }
+
+    /**
+     * Block until all checkpoints are written to disk, as checkpoints are written in the background
+     */
+    void flush_checkpoints() {
+        checkpoint_writer::flush();
+    }
+
+    /**
+     * Record the output of every input from now on, which is saved to the given path once the evaluator is destroyed
+     * @note Must be called before any inference is requested
+     * @param path Path to save the inference record to
+     */
+    void record_inference(const std::string& path) {
+        inference_record_ = std::make_unique<RecordT>();
+        inference_record_path_ = path;
     }
 
     /**
@@ -191,58 +300,131 @@ public:
     }
 
 private:
-    const int WAIT_TIME = 10;                // NOLINT(*-avoid-const-or-ref-data-members)
-    const std::size_t MAX_BATCH_SIZE = 8;    // NOLINT(*-avoid-const-or-ref-data-members)
+    // Apply the given function to the device manager of the full model, and of the cascade model if used
+    template <typename F>
+    void for_each_device_manager(F&& f) {
+        f(*device_manager_);
+        if (cascade_device_manager_) {
+            f(*cascade_device_manager_);
+        }
+    }
 
-    // Runner to perform inference queries if using threading on the model (not used currently)
+    // Run the batch on the full model, or on the cascade model first with only its uncertain inputs escalated
+    [[nodiscard]] auto RunInference(int device_id, std::vector<InferenceInput>& inference_inputs)
+        -> std::vector<InferenceOutput> {
+        if (!cascade_device_manager_) {
+            return device_manager_->Get(1, device_id)->Inference(inference_inputs);
+        }
+        const auto cascade_device_id = static_cast<int>(static_cast<std::size_t>(device_id) % cascade_device_manager_->Count());
+        std::vector<InferenceOutput> results = cascade_device_manager_->Get(1, cascade_device_id)->Inference(inference_inputs);
+        if constexpr (HasPolicy<InferenceOutput>) {
+            // Outputs without a policy (i.e. heuristic-only requests) can't be judged, so always use the full model
+            std::vector<std::size_t> escalated;
+            std::vector<InferenceInput> escalated_inputs;
+            for (std::size_t i = 0; i < results.size(); ++i) {
+                if (results[i].policy.empty() || policy_entropy(results[i].policy) > cascade_entropy_threshold_) {
+                    escalated.push_back(i);
+                    escalated_inputs.push_back(std::move(inference_inputs[i]));
+                }
+            }
+            SPDLOG_DEBUG("Device {:d} escalating {:d} of {:d} inputs to the full model.", device_id, escalated.size(),
+                         results.size());
+            if (!escalated.empty()) {
+                auto escalated_results = device_manager_->Get(1, device_id)->Inference(escalated_inputs);
+                for (auto&& [i, result] : zip(escalated, escalated_results)) {
+                    results[i] = std::move(result);
+                }
+            }
+        }
+        return results;
+    }
+
+    // Number of requests a device should wait for before it can dispatch early
+    [[nodiscard]] auto expected_requests() -> std::size_t {
+        std::size_t batch_size{};
+        {
+            absl::MutexLock lock(&batch_size_lock_);
+            batch_size = batch_size_;
+        }
+        // Active searchers are split amongst the devices
+        const std::size_t num_devices = device_manager_->Count();
+        return (batch_size + num_devices - 1) / num_devices;
+    }
+
+    // Runner which coalesces queued inference requests into a single forward pass for the given device
     void BatchedInferenceRunner(int device_id) {
         std::vector<InferenceInput> inference_inputs;    // Collapsed inference inputs
-        std::vector<std::promise<std::vector<InferenceOutput>>*> promises;
+        std::vector<std::promise<std::vector<InferenceOutput>>> promises;
         std::vector<std::size_t> Ns;    // Each batch item has N inference inputs
-        while (!stop_token_.stop_requested()) {
-            absl::Time deadline = absl::InfiniteFuture();
-
-            std::size_t batch_size{};
-            {
-                absl::MutexLock lock(&batch_size_lock_);
-                batch_size = batch_size_;
+        auto add_item = [&](QueueItem& item) {
+            Ns.push_back(item.N);
+            promises.push_back(std::move(item.prom));
+            inference_inputs.insert(inference_inputs.end(), std::make_move_iterator(item.inputs.begin()),
+                                    std::make_move_iterator(item.inputs.end()));
+        };
+
+        // Pinned CPU replicas run their forward passes (and the op threads spawned from them) on their own cores
+        cpu_affinity::pin_thread(device_manager_->Get(0, device_id)->CpuCores());
+        while (true) {
+            // Sleep on the queue until the first request of the next batch arrives
+            // Queue only returns empty once new values are blocked and it is drained
+            absl::optional<QueueItem> item = queue_.Pop();
+            if (!item) {
+                break;
             }
-            // skip if no search threads have been fired
-            if (batch_size == 0) {
-                continue;
-            }
-
-            // Try to get a few items to send to device
-            // Once we have inputs to send off, we only wait for a short time
-            for (std::size_t i = 0; i < std::min(static_cast<std::size_t>(MAX_BATCH_SIZE), batch_size); ++i) {
-                absl::optional<QueueItem> item = queue_.Pop(deadline);
-                if (!item) {
+            const absl::Time oldest_request = item->enqueued;
+            add_item(*item);
+
+            // Once we have inputs to send off, we only wait for a short time for other search threads
+            const InferenceLimits limits =
+                inference_tuner_ ? inference_tuner_->limits() : InferenceLimits{max_batch_size_, max_wait_};
+            const absl::Time deadline = absl::Now() + limits.max_wait;
+            while (inference_inputs.size() < limits.max_batch_size && !stop_token_.stop_requested()) {
+                const std::size_t expected = expected_requests();
+                if (expected > 0 && promises.size() >= expected) {
                     break;
                 }
-                // At least one search thread is ready for inference.
-                // Only wait for WAIT_TIME for other search threads before sending out to device
-                if (inference_inputs.empty()) {
-                    deadline = absl::Now() + absl::Milliseconds(WAIT_TIME);
-                }
-                Ns.push_back(item->inputs.size());
-                promises.push_back(item->prom);
-                for (auto& input : item->inputs) {
-                    inference_inputs.push_back(std::move(input));
+                item = queue_.Pop(deadline);
+                if (!item) {
+                    break;
                 }
+                add_item(*item);
             }
 
             // Send batch to network
-            auto results = device_manager_->Get(1, device_id)->Inference(inference_inputs);
-
-            assert(promises.size() == Ns.size());
-            std::size_t start_idx = 0;
-            for (auto&& [promise, N] : zip(promises, Ns)) {
-                std::vector<InferenceOutput> inference_outputs;
-                for (std::size_t i = 0; i < N; ++i) {
-                    inference_outputs.push_back(std::move(results[start_idx + i]));
+            SPDLOG_DEBUG("Device {:d} running inference on {:d} inputs from {:d} requests.", device_id,
+                         inference_inputs.size(), promises.size());
+            try {
+                // Keys are taken up front, as the inputs may be moved into the model
+                std::vector<RecordKey> record_keys;
+                if (inference_record_) {
+                    record_keys.reserve(inference_inputs.size());
+                    for (const auto& input : inference_inputs) {
+                        record_keys.push_back(RecordT::make_key(input));
+                    }
+                }
+                const absl::Time dispatch = absl::Now();
+                auto results = RunInference(device_id, inference_inputs);
+                if (inference_tuner_) {
+                    inference_tuner_->record(inference_inputs.size(), dispatch, dispatch - oldest_request,
+                                             absl::Now() - dispatch);
+                }
+                if (inference_record_) {
+                    inference_record_->add(record_keys, results);
+                }
+                assert(promises.size() == Ns.size());
+                auto result_iter = results.begin();
+                for (auto&& [promise, N] : zip(promises, Ns)) {
+                    const auto result_end = result_iter + static_cast<std::ptrdiff_t>(N);
+                    promise.set_value(std::vector<InferenceOutput>(std::make_move_iterator(result_iter),
+                                                                   std::make_move_iterator(result_end)));
+                    result_iter = result_end;
+                }
+            } catch (...) {
+                // Surface the error on the requesting threads instead of taking down the runner
+                for (auto& promise : promises) {
+                    promise.set_exception(std::current_exception());
                 }
-                promise->set_value(std::move(inference_outputs));
-                start_idx += N;
             }
 
             inference_inputs.clear();
@@ -251,20 +433,51 @@ private:
         }
     }
 
-    std::unique_ptr<DeviceManager<ModelWrapperT>> device_manager_;    // Sole owner of the device manager
+    using RecordT = InferenceRecord<InferenceInput, InferenceOutput>;
 
-    // Struct for holding promised value for inference queries
+    std::unique_ptr<DeviceManager<ModelWrapperT>> device_manager_;            // Sole owner of the device manager
+    std::unique_ptr<DeviceManager<ModelWrapperT>> cascade_device_manager_;    // Optional small model run first
+    double cascade_entropy_threshold_;                                        // Cascade policy entropy to escalate above
+
+    // Struct for holding promised value for inference queries, move only
     struct QueueItem {
         std::vector<InferenceInput> inputs;    // List of inputs for the current request
         std::size_t N{};                       // Number of inputs for the curent request
-        std::promise<std::vector<InferenceOutput>>* prom{};
+        std::promise<std::vector<InferenceOutput>> prom;
+        absl::Time enqueued;                   // Time the request was queued, to measure the queueing delay
     };
 
-    ThreadedQueue<QueueItem> queue_;                // Queue for inference requests
-    StopToken stop_token_;                          // Stop token flag to signal to quit the inference thread
-    std::vector<std::thread> inference_threads_;    // Threads for inference requests
-    absl::Mutex batch_size_lock_;                   // Lock for checking batch size on inference thread
-    std::size_t batch_size_ = 0;                    // Batch size which corresponds to how many search threads are running
+    ThreadedQueue<QueueItem> queue_;                     // Queue for inference requests
+    std::size_t max_batch_size_;                         // Maximum number of inputs coalesced into a single forward pass
+    absl::Duration max_wait_;                            // Maximum time to hold a partial batch waiting for more requests
+    std::unique_ptr<InferenceTuner> inference_tuner_;    // Optional tuner of the batch size and wait time
+    std::unique_ptr<RecordT> inference_record_;          // Optional record of all inference outputs
+    std::string inference_record_path_;                  // Path the inference record is saved to
+    StopToken stop_token_;                               // Stop token flag to signal to quit the inference thread
+    std::vector<std::thread> inference_threads_;         // Threads for inference requests
+    absl::Mutex batch_size_lock_;                        // Lock for checking batch size on inference thread
+    std::size_t batch_size_ = 0;                         // Batch size which corresponds to how many search threads are running
+};
+
+// Registers the owning thread as one which may be requesting inference for the lifetime of the guard, which lets the
+// evaluator dispatch a batch as soon as every active searcher has a request queued
+template <typename ModelEvaluatorT>
+class ActiveSearcherGuard {
+public:
+    explicit ActiveSearcherGuard(std::shared_ptr<ModelEvaluatorT> model_eval) : model_eval_(std::move(model_eval)) {
+        model_eval_->increment_batch_size();
+    }
+    ~ActiveSearcherGuard() {
+        model_eval_->decrement_batch_size();
+    }
+
+    ActiveSearcherGuard(const ActiveSearcherGuard&) = delete;
+    ActiveSearcherGuard(ActiveSearcherGuard&&) = delete;
+    ActiveSearcherGuard& operator=(const ActiveSearcherGuard&) = delete;
+    ActiveSearcherGuard& operator=(ActiveSearcherGuard&&) = delete;
+
+private:
+    std::shared_ptr<ModelEvaluatorT> model_eval_;
 };
 
 }    // namespace hpts::model
@@ -3,11 +3,15 @@
 
 #include "model/policy_convnet/policy_convnet.h"
 
+#include <cassert>
+
+#include "model/torch_util.h"
+
 namespace hpts::model::network {
 
 PolicyConvNetImpl::PolicyConvNetImpl(const ObservationShape &observation_shape, int num_actions, int resnet_channels,
                                      int resnet_blocks, int policy_channels, const std::vector<int> &policy_mlp_layers,
-                                     bool use_batchnorm)
+                                     bool use_batchnorm, int resnet_bottleneck_channels, int mlp_rank)
     : input_channels_(observation_shape.c),
       input_height_(observation_shape.h),
       input_width_(observation_shape.w),
@@ -16,10 +20,10 @@ PolicyConvNetImpl::PolicyConvNetImpl(const ObservationShape &observation_shape,
       policy_mlp_input_size_(policy_channels_ * input_height_ * input_width_),
       resnet_head_(ResidualHead(input_channels_, resnet_channels_, use_batchnorm, "representation_")),
       conv1x1_policy_(conv1x1(resnet_channels_, policy_channels_)),
-      policy_mlp_(policy_mlp_input_size_, policy_mlp_layers, num_actions, "policy_head_") {
+      policy_mlp_(policy_mlp_input_size_, policy_mlp_layers, num_actions, "policy_head_", mlp_rank) {
     // ResNet body
     for (int i = 0; i < resnet_blocks; ++i) {
-        resnet_layers_->push_back(ResidualBlock(resnet_channels_, i, use_batchnorm));
+        resnet_layers_->push_back(ResidualBlock(resnet_channels_, i, use_batchnorm, 1, resnet_bottleneck_channels));
     }
     register_module("representation_head", resnet_head_);
     register_module("representation_layers", resnet_layers_);
@@ -36,11 +40,73 @@ PolicyConvNetOutput PolicyConvNetImpl::forward(torch::Tensor x) {
 
     // Reduce and mlp for policy
     torch::Tensor logits = conv1x1_policy_->forward(output);
-    logits = logits.view({-1, policy_mlp_input_size_});
+    logits = logits.reshape({-1, policy_mlp_input_size_});
     logits = policy_mlp_->forward(logits);
     const torch::Tensor policy = torch::softmax(logits, 1);
     const torch::Tensor log_policy = torch::log_softmax(logits, 1);
     return {logits, policy, log_policy};
 }
 
+void PolicyConvNetImpl::fuse_batchnorm() {
+    resnet_head_->fuse_batchnorm();
+    for (int i = 0; i < (int)resnet_layers_->size(); ++i) {
+        resnet_layers_[i]->as<ResidualBlock>()->fuse_batchnorm();
+    }
+}
+
+void PolicyConvNetImpl::compress_from(const PolicyConvNetImpl &src) {
+    assert(resnet_layers_->size() == src.resnet_layers_->size());
+    copy_module_state(*src.resnet_head_, *resnet_head_);
+    for (int i = 0; i < (int)resnet_layers_->size(); ++i) {
+        resnet_layers_[i]->as<ResidualBlock>()->prune_from(*src.resnet_layers_->ptr(i)->as<ResidualBlock>());
+    }
+    copy_module_state(*src.conv1x1_policy_, *conv1x1_policy_);
+    policy_mlp_->factorize_from(*src.policy_mlp_);
+}
+
+GroupedPolicyConvNetImpl::GroupedPolicyConvNetImpl(const ObservationShape &observation_shape, int num_actions,
+                                                   int resnet_channels, int resnet_blocks, int policy_channels,
+                                                   const std::vector<int> &policy_mlp_layers, int num_groups)
+    : num_groups_(num_groups),
+      num_actions_(num_actions),
+      policy_mlp_input_size_(policy_channels * observation_shape.h * observation_shape.w),
+      resnet_head_(ResidualHead(observation_shape.c * num_groups, resnet_channels * num_groups, false, "representation_",
+                                num_groups)),
+      conv1x1_policy_(conv1x1(resnet_channels * num_groups, policy_channels * num_groups, num_groups)),
+      policy_mlp_(num_groups, policy_mlp_input_size_, policy_mlp_layers, num_actions, "policy_head_") {
+    // ResNet body
+    for (int i = 0; i < resnet_blocks; ++i) {
+        resnet_layers_->push_back(ResidualBlock(resnet_channels * num_groups, i, false, num_groups));
+    }
+    register_module("representation_head", resnet_head_);
+    register_module("representation_layers", resnet_layers_);
+    register_module("policy_1x1", conv1x1_policy_);
+    register_module("policy_mlp", policy_mlp_);
+}
+
+PolicyConvNetOutput GroupedPolicyConvNetImpl::forward(torch::Tensor x) {
+    torch::Tensor output = resnet_head_->forward(x);
+    // ResNet body
+    for (int i = 0; i < (int)resnet_layers_->size(); ++i) {
+        output = resnet_layers_[i]->as<ResidualBlock>()->forward(output);
+    }
+
+    // Reduce and mlp for policy, channels of each group are contiguous so flattening keeps groups contiguous
+    torch::Tensor logits = conv1x1_policy_->forward(output);
+    logits = logits.view({-1, num_groups_ * policy_mlp_input_size_});
+    logits = policy_mlp_->forward(logits).view({-1, num_groups_, num_actions_});
+    const torch::Tensor policy = torch::softmax(logits, 2);
+    const torch::Tensor log_policy = torch::log_softmax(logits, 2);
+    return {logits, policy, log_policy};
+}
+
+void GroupedPolicyConvNetImpl::copy_group(int group, const PolicyConvNetImpl &model) {
+    resnet_head_->copy_group(group, *model.resnet_head_);
+    for (int i = 0; i < (int)resnet_layers_->size(); ++i) {
+        resnet_layers_[i]->as<ResidualBlock>()->copy_group(group, *model.resnet_layers_->ptr(i)->as<ResidualBlock>());
+    }
+    copy_conv_group(model.conv1x1_policy_, conv1x1_policy_, group);
+    policy_mlp_->copy_group(group, *model.policy_mlp_);
+}
+
 }    // namespace hpts::model::network
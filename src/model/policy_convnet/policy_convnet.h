@@ -32,10 +32,17 @@ public:
      * @param policy_channels Number of channels in the policy reduce head
      * @param policy_mlp_layers Hidden layer sizes for the policy head MLP
      * @param use_batchnorm Flag to use batchnorm in the resnet layers
+     * @param resnet_bottleneck_channels Channels between the convolutions of each resnet block, 0 for resnet_channels
+     * @param mlp_rank Rank the MLP layers are factored through, 0 for unfactored layers
      */
     PolicyConvNetImpl(const ObservationShape &observation_shape, int num_actions, int resnet_channels, int resnet_blocks,
-                      int policy_channels, const std::vector<int> &policy_mlp_layers, bool use_batchnorm);
+                      int policy_channels, const std::vector<int> &policy_mlp_layers, bool use_batchnorm,
+                      int resnet_bottleneck_channels = 0, int mlp_rank = 0);
     [[nodiscard]] auto forward(torch::Tensor x) -> PolicyConvNetOutput;
+    // Fold batchnorm into the resnet convolutions, only to be used on an eval-only copy of the network
+    void fuse_batchnorm();
+    // Copy the weights of an uncompressed network of the same sizes, pruning the resnet blocks and factoring the MLP
+    void compress_from(const PolicyConvNetImpl &src);
 
 private:
     int input_channels_;
@@ -48,9 +55,42 @@ private:
     torch::nn::Conv2d conv1x1_policy_;    // Conv pass before passing to policy mlp
     MLP policy_mlp_;
     torch::nn::ModuleList resnet_layers_;
+    friend class GroupedPolicyConvNetImpl;
 };
 TORCH_MODULE(PolicyConvNet);
 
+class GroupedPolicyConvNetImpl : public torch::nn::Module {
+public:
+    /**
+     * Independent policy convnets of the same architecture (i.e. one per subgoal) run side by side in a single pass,
+     * using grouped convolutions. Only used for inference, groups are copied from batchnorm folded networks.
+     * @param observation_shape Input observation shape to each network
+     * @param num_actions Number of actions for the policy output
+     * @param resnet_channels Number of channels for each resenet block
+     * @param resnet_blocks Number of resnet blocks
+     * @param policy_channels Number of channels in the policy reduce head
+     * @param policy_mlp_layers Hidden layer sizes for the policy head MLP
+     * @param num_groups Number of networks
+     */
+    GroupedPolicyConvNetImpl(const ObservationShape &observation_shape, int num_actions, int resnet_channels,
+                             int resnet_blocks, int policy_channels, const std::vector<int> &policy_mlp_layers,
+                             int num_groups);
+    // Input -> [batch_size, num_groups * c, h, w], outputs -> [batch_size, num_groups, num_actions]
+    [[nodiscard]] auto forward(torch::Tensor x) -> PolicyConvNetOutput;
+    // Copy a batchnorm folded network into the given group
+    void copy_group(int group, const PolicyConvNetImpl &model);
+
+private:
+    int num_groups_;
+    int num_actions_;
+    int policy_mlp_input_size_;
+    ResidualHead resnet_head_;
+    torch::nn::Conv2d conv1x1_policy_;
+    GroupedMLP policy_mlp_;
+    torch::nn::ModuleList resnet_layers_;
+};
+TORCH_MODULE(GroupedPolicyConvNet);
+
 }    // namespace hpts::model::network
 
 #endif    // HPTS_MODEL_POLICY_CONVNET_H_
@@ -11,11 +11,15 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <cassert>
 #include <cmath>
+#include <cstring>
 #include <filesystem>
 #include <ostream>
 #include <sstream>
 
+#include "model/checkpoint_writer.h"
 #include "model/loss_functions.h"
 #include "model/torch_util.h"
 #include "util/zip.h"
@@ -25,10 +29,12 @@ namespace hpts::model::wrapper {
 PolicyConvNetMultiWrapperBase::PolicyConvNetMultiWrapperBase(const PolicyConvNetConfig& config, int num_models,
                                                              double learning_rate, double l2_weight_decay,
                                                              const std::string& device, const std::string& output_path,
-                                                             const std::string& checkpoint_base_name)
+                                                             const std::string& checkpoint_base_name,
+                                                             bool grouped_inference)
     : BaseModelWrapper(device, output_path, checkpoint_base_name),
       config(config),
-      input_flat_size(config.observation_shape.flat_size()) {
+      input_flat_size(config.observation_shape.flat_size()),
+      grouped_inference_(grouped_inference) {
     for (int i = 0; i < num_models; ++i) {
         models_.emplace_back(config.observation_shape, config.num_actions, config.resnet_channels, config.resnet_blocks,
                              config.policy_channels, config.policy_mlp_layers, config.use_batchnorm);
@@ -58,8 +64,8 @@ auto PolicyConvNetMultiWrapperBase::SaveCheckpoint(long long int step) -> std::s
     SPDLOG_INFO("Checkpointing model to {:s}.pt", full_path);
 
     for (std::size_t i = 0; i < models_.size(); ++i) {
-        torch::save(models_[i], absl::StrCat(full_path, "_", i, ".pt"));
-        torch::save(model_optimizers_[i], absl::StrCat(full_path, "_", i, "-optimizer.pt"));
+        checkpoint_writer::save(models_[i], absl::StrCat(full_path, "_", i, ".pt"));
+        checkpoint_writer::save(model_optimizers_[i], absl::StrCat(full_path, "_", i, "-optimizer.pt"));
     }
     return full_path;
 }
@@ -70,12 +76,14 @@ auto PolicyConvNetMultiWrapperBase::SaveCheckpointWithoutOptimizer(long long int
     SPDLOG_INFO("Checkpointing model to {:s}.pt", full_path);
 
     for (std::size_t i = 0; i < models_.size(); ++i) {
-        torch::save(models_[i], absl::StrCat(full_path, "_", i, ".pt"));
+        checkpoint_writer::save(models_[i], absl::StrCat(full_path, "_", i, ".pt"));
     }
     return full_path;
 }
 
 void PolicyConvNetMultiWrapperBase::LoadCheckpoint(const std::string& path) {
+    // Checkpoint may still be queued in the background writer
+    checkpoint_writer::flush();
     for (std::size_t i = 0; i < models_.size(); ++i) {
         if (!std::filesystem::exists(absl::StrCat(path, "_", i, ".pt")) ||
             !std::filesystem::exists(absl::StrCat(path, "_", i, "-optimizer.pt"))) {
@@ -86,8 +94,11 @@ void PolicyConvNetMultiWrapperBase::LoadCheckpoint(const std::string& path) {
         torch::load(models_[i], absl::StrCat(path, "_", i, ".pt"), torch_device_);
         torch::load(model_optimizers_[i], absl::StrCat(path, "_", i, "-optimizer.pt"), torch_device_);
     }
+    inference_model_version_ = -1;
 }
 void PolicyConvNetMultiWrapperBase::LoadCheckpointWithoutOptimizer(const std::string& path) {
+    // Checkpoint may still be queued in the background writer
+    checkpoint_writer::flush();
     for (std::size_t i = 0; i < models_.size(); ++i) {
         if (!std::filesystem::exists(absl::StrCat(path, "_", i, ".pt"))) {
             SPDLOG_ERROR("path {:s} does not contain model and/or optimizer", path);
@@ -96,9 +107,30 @@ void PolicyConvNetMultiWrapperBase::LoadCheckpointWithoutOptimizer(const std::st
 
         torch::load(models_[i], absl::StrCat(path, "_", i, ".pt"), torch_device_);
     }
+    inference_model_version_ = -1;
+}
+
+auto PolicyConvNetMultiWrapperBase::Modules() -> std::vector<std::shared_ptr<torch::nn::Module>> {
+    std::vector<std::shared_ptr<torch::nn::Module>> modules;
+    modules.reserve(models_.size());
+    for (const auto& model : models_) {
+        modules.push_back(model.ptr());
+    }
+    return modules;
 }
 
 auto PolicyConvNetMultiWrapperBase::Inference(std::vector<InferenceInput>& batch) -> std::vector<InferenceOutput> {
+    if (grouped_inference_ && !batch.empty()) {
+        // The grouped pass costs (largest group * num_models) samples, so skewed batches are cheaper per model
+        std::vector<int> group_sizes(models_.size(), 0);
+        for (const auto& batch_item : batch) {
+            ++group_sizes[static_cast<std::size_t>(batch_item.subgoal)];
+        }
+        const auto padded_size = static_cast<std::size_t>(*std::ranges::max_element(group_sizes)) * models_.size();
+        if (padded_size <= MAX_GROUPED_PADDING * batch.size()) {
+            return GroupedInference(batch);
+        }
+    }
     const int batch_size = static_cast<int>(batch.size());
     absl::flat_hash_map<int, std::vector<int>> mapping_input;
 
@@ -139,6 +171,87 @@ auto PolicyConvNetMultiWrapperBase::Inference(std::vector<InferenceInput>& batch
     return inference_output;
 }
 
+void PolicyConvNetMultiWrapperBase::UpdateInferenceModel() {
+    int64_t version = 0;
+    for (const auto& model : models_) {
+        version += module_state_version(*model);
+    }
+    if (inference_model_ && version == inference_model_version_) {
+        return;
+    }
+    const int num_models = static_cast<int>(models_.size());
+    network::GroupedPolicyConvNet inference_model(config.observation_shape, config.num_actions, config.resnet_channels,
+                                                  config.resnet_blocks, config.policy_channels, config.policy_mlp_layers,
+                                                  num_models);
+    for (int i = 0; i < num_models; ++i) {
+        // Batchnorm is folded per model on a separate copy, before the model is copied into its group
+        network::PolicyConvNet model(config.observation_shape, config.num_actions, config.resnet_channels, config.resnet_blocks,
+                                     config.policy_channels, config.policy_mlp_layers, config.use_batchnorm);
+        copy_module_state(*models_[i], *model);
+        model->fuse_batchnorm();
+        inference_model->copy_group(i, *model);
+    }
+    inference_model->to(torch_device_, inference_dtype(config.inference_bf16));
+    inference_model->eval();
+    inference_model_ = std::move(inference_model);
+    inference_model_version_ = version;
+}
+
+auto PolicyConvNetMultiWrapperBase::GroupedInference(std::vector<InferenceInput>& batch) -> std::vector<InferenceOutput> {
+    const int batch_size = static_cast<int>(batch.size());
+    const int num_models = static_cast<int>(models_.size());
+    if (batch_size == 0) {
+        return {};
+    }
+
+    // Each input takes the next free row of its subgoal's channel group, groups with fewer inputs are zero padded
+    // Layout is (rows, num_models, flat) -> (rows, num_models * c, h, w)
+    const auto row_size = static_cast<std::size_t>(input_flat_size);
+    std::vector<int> group_sizes(static_cast<std::size_t>(num_models), 0);
+    std::vector<int64_t> rows;
+    std::vector<int64_t> groups;
+    rows.reserve(batch.size());
+    groups.reserve(batch.size());
+    for (const auto& batch_item : batch) {
+        rows.push_back(group_sizes[batch_item.subgoal]++);
+        groups.push_back(batch_item.subgoal);
+    }
+    const int num_rows = *std::ranges::max_element(group_sizes);
+    inference_staging_.assign(static_cast<std::size_t>(num_rows * num_models) * row_size, 0);
+    for (auto&& [i, batch_item] : enumerate(batch)) {
+        assert(batch_item.observation.size() == row_size);
+        const auto offset = static_cast<std::size_t>(rows[i] * num_models + groups[i]) * row_size;
+        std::memcpy(&inference_staging_[offset], batch_item.observation.data(), row_size * sizeof(float));
+    }
+    torch::Tensor input_observations =
+        torch::from_blob(inference_staging_.data(),
+                         {num_rows, num_models * config.observation_shape.c, config.observation_shape.h,
+                          config.observation_shape.w},
+                         torch::TensorOptions().dtype(torch::kFloat));
+    input_observations = input_observations.to(torch_device_, inference_dtype(config.inference_bf16));
+
+    // Inference copy is always in eval mode, and inference mode skips autograd tracking entirely
+    UpdateInferenceModel();
+    const torch::InferenceMode inference_guard;
+
+    // Run inference, then pick out the output of each input's own group
+    const auto model_output = inference_model_->forward(input_observations);
+    const torch::Tensor row_index = torch::tensor(rows, torch::kLong).to(torch_device_);
+    const torch::Tensor group_index = torch::tensor(groups, torch::kLong).to(torch_device_);
+    const auto logits_output = model_output.logits.index({row_index, group_index}).to(torch::kDouble).to(torch::kCPU);
+    const auto policy_output = model_output.policy.index({row_index, group_index}).to(torch::kDouble).to(torch::kCPU);
+    const auto log_policy_output =
+        model_output.log_policy.index({row_index, group_index}).to(torch::kDouble).to(torch::kCPU);
+
+    std::vector<InferenceOutput> inference_output;
+    inference_output.reserve(static_cast<std::size_t>(batch_size));
+    for (int i = 0; i < batch_size; ++i) {
+        inference_output.push_back({tensor_to_vec<double>(logits_output[i]), tensor_to_vec<double>(policy_output[i]),
+                                    tensor_to_vec<double>(log_policy_output[i])});
+    }
+    return inference_output;
+}
+
 auto PolicyConvNetMultiWrapperLevin::Learn(std::vector<LearningInput>& batch) -> double {
     const int batch_size = static_cast<int>(batch.size());
     absl::flat_hash_map<int, std::vector<int>> mapping_input;
@@ -159,7 +272,7 @@ auto PolicyConvNetMultiWrapperLevin::Learn(std::vector<LearningInput>& batch) ->
 
         for (int i = 0; i < collection_size; ++i) {
             auto& batch_item = batch[indices[i]];
-            input_observations[i] = torch::from_blob(batch_item.observation.data(), {input_flat_size}, options_float);
+            batch_item.observation.unpack(input_observations[i].data_ptr<float>());
             target_actions[i] = batch_item.target_action;
             expandeds[i] = static_cast<float>(batch_item.solution_expanded);
         }
@@ -210,7 +323,7 @@ auto PolicyConvNetMultiWrapperPolicyGradient::Learn(std::vector<LearningInput>&
 
         for (int i = 0; i < collection_size; ++i) {
             auto& batch_item = batch[indices[i]];
-            input_observations[i] = torch::from_blob(batch_item.observation.data(), {input_flat_size}, options_float);
+            batch_item.observation.unpack(input_observations[i].data_ptr<float>());
             target_actions[i] = batch_item.target_action;
             target_costs[i] = static_cast<double>(batch_item.target_cost_to_goal);
             rewards[i] = static_cast<float>(batch_item.reward);
@@ -5,6 +5,9 @@
 #ifndef HPTS_WRAPPER_POLICY_CONVNET_MULTI_H_
 #define HPTS_WRAPPER_POLICY_CONVNET_MULTI_H_
 
+#include <atomic>
+#include <vector>
+
 #include "common/observation.h"
 #include "model/base_model_wrapper.h"
 #include "model/policy_convnet/policy_convnet.h"
@@ -32,7 +35,7 @@ public:
 
     PolicyConvNetMultiWrapperBase(const PolicyConvNetConfig& config, int num_models, double learning_rate, double l2_weight_decay,
                                   const std::string& device, const std::string& output_path,
-                                  const std::string& checkpoint_base_name = "");
+                                  const std::string& checkpoint_base_name = "", bool grouped_inference = false);
 
     void print() const override;
 
@@ -44,6 +47,8 @@ public:
     void LoadCheckpoint(const std::string& path) override;
     void LoadCheckpointWithoutOptimizer(const std::string& path) override;
 
+    [[nodiscard]] auto Modules() -> std::vector<std::shared_ptr<torch::nn::Module>> override;
+
     /**
      * Perform inference
      * @param inputs Batched observations (implementation defined)
@@ -52,11 +57,25 @@ public:
     [[nodiscard]] auto Inference(std::vector<InferenceInput>& batch) -> std::vector<InferenceOutput>;
 
 protected:
+    // Run all subgoal models in a single pass of the grouped inference copy
+    // Every group is zero padded to the largest group, so batches where this pads to more than
+    // MAX_GROUPED_PADDING times the batch size run per model instead
+    [[nodiscard]] auto GroupedInference(std::vector<InferenceInput>& batch) -> std::vector<InferenceOutput>;
+
+    // Rebuild the grouped inference copy from the current weights of all models if they changed since it was last built
+    void UpdateInferenceModel();
+
+    static constexpr std::size_t MAX_GROUPED_PADDING = 2;    // Padded samples per input above which inference runs per model
+
     // NOLINTBEGIN(*-non-private-member-variables-in-classes)
     std::vector<network::PolicyConvNet> models_;
     std::vector<torch::optim::Adam> model_optimizers_;
     PolicyConvNetConfig config;
     int input_flat_size;
+    bool grouped_inference_;                                    // Run all subgoal models in a single grouped pass
+    std::vector<float> inference_staging_;                      // Reused buffer for the grouped inference observations
+    network::GroupedPolicyConvNet inference_model_{nullptr};    // Eval-only grouped copy of all models, batchnorm folded
+    std::atomic<int64_t> inference_model_version_{-1};          // Combined weight version the grouped copy was built from
     // NOLINTEND(*-non-private-member-variables-in-classes)
 };
 
@@ -66,7 +85,7 @@ class PolicyConvNetMultiWrapperLevin : public PolicyConvNetMultiWrapperBase {
 public:
     using BaseType = PolicyConvNetMultiWrapperBase;
     struct LearningInput {
-        Observation observation;
+        PackedObservation observation;
         int subgoal;
         int target_action = -1;
         int solution_expanded;
@@ -80,7 +99,7 @@ class PolicyConvNetMultiWrapperPolicyGradient : public PolicyConvNetMultiWrapper
 public:
     using BaseType = PolicyConvNetMultiWrapperBase;
     struct LearningInput {
-        Observation observation;
+        PackedObservation observation;
         int subgoal;
         int target_action = -1;
         double target_cost_to_goal = 0;
@@ -8,11 +8,14 @@
 // NOLINTEND
 #include <spdlog/spdlog.h>
 
+#include <cassert>
 #include <cmath>
+#include <cstring>
 #include <filesystem>
 #include <ostream>
 #include <sstream>
 
+#include "model/checkpoint_writer.h"
 #include "model/loss_functions.h"
 #include "model/torch_util.h"
 #include "util/zip.h"
@@ -24,7 +27,7 @@ PolicyConvNetWrapperBase::PolicyConvNetWrapperBase(const PolicyConvNetConfig& co
                                                    const std::string& output_path, const std::string& checkpoint_base_name)
     : BaseModelWrapper(device, output_path, checkpoint_base_name),
       model_(config.observation_shape, config.num_actions, config.resnet_channels, config.resnet_blocks, config.policy_channels,
-             config.policy_mlp_layers, config.use_batchnorm),
+             config.policy_mlp_layers, config.use_batchnorm, config.resnet_bottleneck_channels, config.mlp_rank),
       model_optimizer_(model_->parameters(), torch::optim::AdamOptions(learning_rate).weight_decay(l2_weight_decay)),
       config(config),
       input_flat_size(config.observation_shape.flat_size()) {
@@ -48,8 +51,8 @@ auto PolicyConvNetWrapperBase::SaveCheckpoint(long long int step) -> std::string
     std::filesystem::create_directories(path_);
     std::string full_path = absl::StrCat(path_, checkpoint_base_name_, "checkpoint-", step);
     SPDLOG_INFO("Checkpointing model to {:s}.pt", full_path);
-    torch::save(model_, absl::StrCat(full_path, ".pt"));
-    torch::save(model_optimizer_, absl::StrCat(full_path, "-optimizer.pt"));
+    checkpoint_writer::save(model_, absl::StrCat(full_path, ".pt"));
+    checkpoint_writer::save(model_optimizer_, absl::StrCat(full_path, "-optimizer.pt"));
     return full_path;
 }
 auto PolicyConvNetWrapperBase::SaveCheckpointWithoutOptimizer(long long int step) -> std::string {
@@ -57,56 +60,101 @@ auto PolicyConvNetWrapperBase::SaveCheckpointWithoutOptimizer(long long int step
     std::filesystem::create_directories(path_);
     std::string full_path = absl::StrCat(path_, checkpoint_base_name_, "checkpoint-", step);
     SPDLOG_INFO("Checkpointing model to {:s}.pt", full_path);
-    torch::save(model_, absl::StrCat(full_path, ".pt"));
+    checkpoint_writer::save(model_, absl::StrCat(full_path, ".pt"));
     return full_path;
 }
 
 void PolicyConvNetWrapperBase::LoadCheckpoint(const std::string& path) {
+    // Checkpoint may still be queued in the background writer
+    checkpoint_writer::flush();
     if (!std::filesystem::exists(absl::StrCat(path, ".pt")) || !std::filesystem::exists(absl::StrCat(path, "-optimizer.pt"))) {
         SPDLOG_ERROR("path {:s} does not contain model and/or optimizer", path);
         std::exit(1);
     }
     torch::load(model_, absl::StrCat(path, ".pt"), torch_device_);
     torch::load(model_optimizer_, absl::StrCat(path, "-optimizer.pt"), torch_device_);
+    inference_model_version_ = -1;
 }
 void PolicyConvNetWrapperBase::LoadCheckpointWithoutOptimizer(const std::string& path) {
+    // Checkpoint may still be queued in the background writer
+    checkpoint_writer::flush();
     if (!std::filesystem::exists(absl::StrCat(path, ".pt"))) {
         SPDLOG_ERROR("path {:s} does not contain model", path);
         std::exit(1);
     }
     torch::load(model_, absl::StrCat(path, ".pt"), torch_device_);
+    inference_model_version_ = -1;
+}
+
+auto PolicyConvNetWrapperBase::Modules() -> std::vector<std::shared_ptr<torch::nn::Module>> {
+    return {model_.ptr()};
+}
+
+void PolicyConvNetWrapperBase::CompressFrom(const PolicyConvNetWrapperBase& src) {
+    // In-place copies bump the weight version, so the inference copy is rebuilt on the next call
+    model_->compress_from(*src.model_);
+}
+
+void PolicyConvNetWrapperBase::UpdateInferenceModel() {
+    const int64_t version = module_state_version(*model_);
+    if (inference_model_ && version == inference_model_version_) {
+        return;
+    }
+    network::PolicyConvNet inference_model(config.observation_shape, config.num_actions, config.resnet_channels,
+                                           config.resnet_blocks, config.policy_channels, config.policy_mlp_layers,
+                                           config.use_batchnorm, config.resnet_bottleneck_channels, config.mlp_rank);
+    copy_module_state(*model_, *inference_model);
+    inference_model->fuse_batchnorm();
+    // Batchnorm is folded in fp32 before casting, so the folded scales don't lose precision twice
+    inference_model->to(torch_device_, inference_dtype(config.inference_bf16));
+    if (channels_last_) {
+        to_channels_last(*inference_model);
+    }
+    inference_model->eval();
+    inference_model_ = std::move(inference_model);
+    inference_model_version_ = version;
 }
 
 auto PolicyConvNetWrapperBase::Inference(std::vector<InferenceInput>& batch) -> std::vector<InferenceOutput> {
     const int batch_size = static_cast<int>(batch.size());
 
-    // Create tensor from raw flat array
-    // torch::from_blob requires a pointer to non-const and doesn't take ownership
-    auto options = torch::TensorOptions().dtype(torch::kFloat);
-    torch::Tensor input_observations = torch::empty({batch_size, input_flat_size}, options);
-    for (auto&& [idx, batch_item] : enumerate(batch)) {
-        const auto i = static_cast<int>(idx);    // stop torch from complaining about narrowing conversions
-        input_observations[i] = torch::from_blob(batch_item.observation.data(), {input_flat_size}, options);
+    // Pack into the reusable staging buffer and wrap as a single tensor
+    // Sparse inputs stay as byte indices on the device, which the first layer looks up from its dense weights
+    torch::Tensor input_observations;
+    if (config.sparse_input_planes > 0) {
+        input_observations = observations_to_index_tensor(batch, config.observation_shape.c, config.sparse_input_planes,
+                                                          inference_index_staging_);
+        input_observations = input_observations.to(torch_device_);
+        input_observations = input_observations.reshape(
+            {batch_size, config.sparse_input_planes, config.observation_shape.h, config.observation_shape.w});
+    } else if (channels_last_) {
+        // Packed cell major, so the input is already in the layout of the channels-last weights
+        input_observations = observations_to_channels_last_tensor(batch, config.observation_shape.c, config.observation_shape.h,
+                                                                  config.observation_shape.w, inference_staging_);
+        input_observations = input_observations.to(torch_device_, inference_dtype(config.inference_bf16));
+    } else {
+        input_observations = observations_to_tensor(batch, input_flat_size, inference_staging_);
+        // Reshape to expected size for network (batch_size, flat) -> (batch_size, c, h, w)
+        input_observations = input_observations.to(torch_device_, inference_dtype(config.inference_bf16));
+        input_observations = input_observations.reshape(
+            {batch_size, config.observation_shape.c, config.observation_shape.h, config.observation_shape.w});
     }
 
-    // Reshape to expected size for network (batch_size, flat) -> (batch_size, c, h, w)
-    input_observations = input_observations.to(torch_device_);
-    input_observations = input_observations.reshape(
-        {batch_size, config.observation_shape.c, config.observation_shape.h, config.observation_shape.w});
-
-    // Put model in eval mode for inference + scoped no_grad
-    model_->eval();
-    const torch::NoGradGuard no_grad;
+    // Inference copy is always in eval mode, and inference mode skips autograd tracking entirely
+    UpdateInferenceModel();
+    const torch::InferenceMode inference_guard;
 
     // Run inference
-    const auto model_output = model_->forward(input_observations);
-    const auto logits_output = model_output.logits.to(torch::kDouble).to(torch::kCPU);
-    const auto policy_output = model_output.policy.to(torch::kDouble).to(torch::kCPU);
-    const auto log_policy_output = model_output.log_policy.to(torch::kDouble).to(torch::kCPU);
+    const auto model_output = inference_model_->forward(input_observations);
+    const auto logits_output = to_cpu_float(model_output.logits);
+    const auto policy_output = to_cpu_float(model_output.policy);
+    const auto log_policy_output = to_cpu_float(model_output.log_policy);
+    const auto batch_storage = make_batch_storage({logits_output, policy_output, log_policy_output});
     std::vector<InferenceOutput> inference_output;
+    inference_output.reserve(static_cast<std::size_t>(batch_size));
     for (int i = 0; i < batch_size; ++i) {
-        inference_output.emplace_back(tensor_to_vec<double>(logits_output[i]), tensor_to_vec<double>(policy_output[i]),
-                                      tensor_to_vec<double>(log_policy_output[i]));
+        inference_output.emplace_back(tensor_row_view(logits_output, i), tensor_row_view(policy_output, i),
+                                      tensor_row_view(log_policy_output, i), batch_storage);
     }
     return inference_output;
 }
@@ -116,15 +164,14 @@ auto PolicyConvNetWrapperLevin::Learn(std::vector<LearningInput>& batch) -> doub
     const auto options_float = torch::TensorOptions().dtype(torch::kFloat);
     const auto options_long = torch::TensorOptions().dtype(torch::kLong);
 
-    // Create tensor from raw flat array
-    // torch::from_blob requires a pointer to non-const and doesn't take ownership
+    // Stored observations are unpacked directly into the input tensor
     torch::Tensor input_observations = torch::empty({batch_size, input_flat_size}, options_float);
     torch::Tensor target_actions = torch::empty({batch_size, 1}, options_long);
     torch::Tensor expandeds = torch::empty({batch_size, 1}, options_float);
 
     for (auto&& [idx, batch_item] : enumerate(batch)) {
         const auto i = static_cast<int>(idx);    // stop torch from complaining about narrowing conversions
-        input_observations[i] = torch::from_blob(batch_item.observation.data(), {input_flat_size}, options_float);
+        batch_item.observation.unpack(input_observations[i].data_ptr<float>());
         target_actions[i] = batch_item.target_action;
         expandeds[i] = static_cast<float>(batch_item.solution_expanded);
     }
@@ -157,15 +204,14 @@ auto PolicyConvNetWrapperPolicyGradient::Learn(std::vector<LearningInput>& batch
     const auto options_float = torch::TensorOptions().dtype(torch::kFloat);
     const auto options_long = torch::TensorOptions().dtype(torch::kLong);
 
-    // Create tensor from raw flat array
-    // torch::from_blob requires a pointer to non-const and doesn't take ownership
+    // Stored observations are unpacked directly into the input tensor
     torch::Tensor input_observations = torch::empty({batch_size, input_flat_size}, options_float);
     torch::Tensor target_actions = torch::empty({batch_size, 1}, options_long);
     torch::Tensor rewards = torch::empty({batch_size, 1}, options_float);
 
     for (auto&& [idx, batch_item] : enumerate(batch)) {
         const auto i = static_cast<int>(idx);    // stop torch from complaining about narrowing conversions
-        input_observations[i] = torch::from_blob(batch_item.observation.data(), {input_flat_size}, options_float);
+        batch_item.observation.unpack(input_observations[i].data_ptr<float>());
         target_actions[i] = batch_item.target_action;
         rewards[i] = static_cast<float>(batch_item.reward);
     }
@@ -199,8 +245,7 @@ auto PolicyConvNetWrapperPHS::Learn(std::vector<LearningInput>& batch) -> double
     const auto options_float = torch::TensorOptions().dtype(torch::kFloat);
     const auto options_long = torch::TensorOptions().dtype(torch::kLong);
 
-    // Create tensor from raw flat array
-    // torch::from_blob requires a pointer to non-const and doesn't take ownership
+    // Stored observations are unpacked directly into the input tensor
     torch::Tensor input_observations = torch::empty({batch_size, input_flat_size}, options_float);
     torch::Tensor target_actions = torch::empty({batch_size, 1}, options_long);
     torch::Tensor depths = torch::empty({batch_size, 1}, options_float);
@@ -209,7 +254,7 @@ auto PolicyConvNetWrapperPHS::Learn(std::vector<LearningInput>& batch) -> double
 
     for (auto&& [idx, batch_item] : enumerate(batch)) {
         const auto i = static_cast<int>(idx);    // stop torch from complaining about narrowing conversions
-        input_observations[i] = torch::from_blob(batch_item.observation.data(), {input_flat_size}, options_float);
+        batch_item.observation.unpack(input_observations[i].data_ptr<float>());
         target_actions[i] = batch_item.target_action;
         depths[i] = static_cast<float>(batch_item.solution_cost);
         expandeds[i] = static_cast<float>(batch_item.solution_expanded);
@@ -242,4 +287,43 @@ auto PolicyConvNetWrapperPHS::Learn(std::vector<LearningInput>& batch) -> double
     return loss_value;
 }
 
+auto PolicyConvNetWrapperDistill::Learn(std::vector<LearningInput>& batch) -> double {
+    const int batch_size = static_cast<int>(batch.size());
+    const auto options_float = torch::TensorOptions().dtype(torch::kFloat);
+
+    // Stored observations are unpacked directly into the input tensor
+    torch::Tensor input_observations = torch::empty({batch_size, input_flat_size}, options_float);
+    torch::Tensor target_policies = torch::empty({batch_size, config.num_actions}, options_float);
+
+    for (auto&& [idx, batch_item] : enumerate(batch)) {
+        const auto i = static_cast<int>(idx);    // stop torch from complaining about narrowing conversions
+        assert(static_cast<int>(batch_item.target_policy.size()) == config.num_actions);
+        batch_item.observation.unpack(input_observations[i].data_ptr<float>());
+        std::memcpy(target_policies[i].data_ptr<float>(), batch_item.target_policy.data(),
+                    batch_item.target_policy.size() * sizeof(float));
+    }
+
+    // Reshape to expected size for network (batch_size, flat) -> (batch_size, c, h, w)
+    input_observations = input_observations.to(torch_device_);
+    target_policies = target_policies.to(torch_device_);
+    input_observations = input_observations.reshape(
+        {batch_size, config.observation_shape.c, config.observation_shape.h, config.observation_shape.w});
+
+    // Put model in train mode for learning
+    model_->train();
+    model_->zero_grad();
+
+    // Get model output
+    auto model_output = model_->forward(input_observations);
+
+    const torch::Tensor loss = loss::kl_divergence_loss(model_output.logits, target_policies);
+    auto loss_value = loss.item<double>();
+
+    // Optimize model
+    loss.backward();
+    model_optimizer_.step();
+
+    return loss_value;
+}
+
 }    // namespace hpts::model::wrapper
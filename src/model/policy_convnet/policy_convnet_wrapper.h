@@ -4,6 +4,11 @@
 #ifndef HPTS_WRAPPER_POLICY_CONVNET_H_
 #define HPTS_WRAPPER_POLICY_CONVNET_H_
 
+#include <atomic>
+#include <memory>
+#include <span>
+#include <vector>
+
 #include "common/observation.h"
 #include "model/base_model_wrapper.h"
 #include "model/policy_convnet/policy_convnet.h"
@@ -19,6 +24,10 @@ struct PolicyConvNetConfig {
     int policy_channels;
     std::vector<int> policy_mlp_layers;
     bool use_batchnorm;
+    bool inference_bf16 = false;           // Run the inference copy in bfloat16, learning stays in fp32
+    int sparse_input_planes = 0;           // Pack inference inputs as this many active channel index planes, 0 for dense
+    int resnet_bottleneck_channels = 0;    // Pruned channels between the resnet block convolutions, 0 for resnet_channels
+    int mlp_rank = 0;                      // Rank of the factored MLP layers, 0 for unfactored
 };
 
 class PolicyConvNetWrapperBase : public BaseModelWrapper {
@@ -27,15 +36,18 @@ public:
     constexpr static std::string LevinLoss = "levin";
     constexpr static std::string PolicyGradientLoss = "policy_gradient";
     constexpr static std::string PHSLoss = "phs";
+    constexpr static std::string DistillLoss = "distill";
 
     struct InferenceInput {
         Observation observation;
     };
 
+    // Row views into the contiguous per-head CPU buffers of the batched forward pass
     struct InferenceOutput {
-        std::vector<double> logits;
-        std::vector<double> policy;
-        std::vector<double> log_policy;
+        std::span<const float> logits;
+        std::span<const float> policy;
+        std::span<const float> log_policy;
+        std::shared_ptr<const void> batch_storage;    // Keeps the batch buffers the views point into alive
     };
 
     PolicyConvNetWrapperBase(const PolicyConvNetConfig& config, double learning_rate, double l2_weight_decay,
@@ -52,6 +64,15 @@ public:
     void LoadCheckpoint(const std::string& path) override;
     void LoadCheckpointWithoutOptimizer(const std::string& path) override;
 
+    [[nodiscard]] auto Modules() -> std::vector<std::shared_ptr<torch::nn::Module>> override;
+
+    /**
+     * Initialize from the weights of an uncompressed model of the same sizes, pruning the resnet blocks to
+     * config.resnet_bottleneck_channels and factoring the MLP layers through config.mlp_rank
+     * @param src The model to compress
+     */
+    void CompressFrom(const PolicyConvNetWrapperBase& src);
+
     /**
      * Perform inference
      * @param inputs Batched observations (implementation defined)
@@ -60,11 +81,18 @@ public:
     [[nodiscard]] auto Inference(std::vector<InferenceInput>& batch) -> std::vector<InferenceOutput>;
 
 protected:
+    // Rebuild the eval-only inference copy from the current weights if they changed since it was last built
+    void UpdateInferenceModel();
+
     // NOLINTBEGIN(*-non-private-member-variables-in-classes)
     network::PolicyConvNet model_;
     torch::optim::Adam model_optimizer_;
     PolicyConvNetConfig config;
     int input_flat_size;
+    std::vector<float> inference_staging_;                // Reused contiguous buffer for batched inference observations
+    std::vector<uint8_t> inference_index_staging_;        // Reused buffer for sparse inference observations
+    network::PolicyConvNet inference_model_{nullptr};     // Eval-only copy with batchnorm folded, used for inference
+    std::atomic<int64_t> inference_model_version_{-1};    // Weight version the inference copy was built from
     // NOLINTEND(*-non-private-member-variables-in-classes)
 };
 
@@ -74,7 +102,7 @@ class PolicyConvNetWrapperLevin : public PolicyConvNetWrapperBase {
 public:
     using BaseType = PolicyConvNetWrapperBase;
     struct LearningInput {
-        Observation observation;
+        PackedObservation observation;
         int target_action = -1;
         int solution_expanded = 0;
     };
@@ -87,7 +115,7 @@ class PolicyConvNetWrapperPolicyGradient : public PolicyConvNetWrapperBase {
 public:
     using BaseType = PolicyConvNetWrapperBase;
     struct LearningInput {
-        Observation observation;
+        PackedObservation observation;
         int target_action = -1;
         double reward = 0;
     };
@@ -100,7 +128,7 @@ class PolicyConvNetWrapperPHS : public PolicyConvNetWrapperBase {
 public:
     using BaseType = PolicyConvNetWrapperBase;
     struct LearningInput {
-        Observation observation;
+        PackedObservation observation;
         int target_action = -1;
         double solution_cost = 0;
         int solution_expanded = 0;
@@ -111,6 +139,19 @@ public:
     auto Learn(std::vector<LearningInput>& batch) -> double;
 };
 
+// Student trained against the soft policy targets of a teacher network
+class PolicyConvNetWrapperDistill : public PolicyConvNetWrapperBase {
+public:
+    using BaseType = PolicyConvNetWrapperBase;
+    struct LearningInput {
+        PackedObservation observation;
+        std::vector<float> target_policy;
+    };
+
+    using PolicyConvNetWrapperBase::PolicyConvNetWrapperBase;
+    auto Learn(std::vector<LearningInput>& batch) -> double;
+};
+
 }    // namespace hpts::model::wrapper
 
 #endif    // HPTS_WRAPPER_POLICY_CONVNET_H_
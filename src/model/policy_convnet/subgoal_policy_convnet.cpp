@@ -0,0 +1,53 @@
+// File: subgoal_policy_convnet.cpp
+// Description: Convnet scoring the subgoals of a state, with a single trunk pass per state and late fused subgoal planes
+
+#include "model/policy_convnet/subgoal_policy_convnet.h"
+
+namespace hpts::model::network {
+
+SubgoalPolicyConvNetImpl::SubgoalPolicyConvNetImpl(const ObservationShape &observation_shape, int subgoal_channels,
+                                                   int resnet_channels, int resnet_blocks, int policy_channels,
+                                                   const std::vector<int> &policy_mlp_layers, bool use_batchnorm)
+    : input_channels_(observation_shape.c),
+      input_height_(observation_shape.h),
+      input_width_(observation_shape.w),
+      subgoal_channels_(subgoal_channels),
+      resnet_channels_(resnet_channels),
+      policy_channels_(policy_channels),
+      policy_mlp_input_size_(policy_channels_ * input_height_ * input_width_),
+      resnet_head_(ResidualHead(input_channels_, resnet_channels_, use_batchnorm, "representation_")),
+      conv1x1_subgoal_(conv1x1(resnet_channels_ + subgoal_channels_, policy_channels_)),
+      policy_mlp_(policy_mlp_input_size_, policy_mlp_layers, 1, "policy_head_") {
+    // ResNet body
+    for (int i = 0; i < resnet_blocks; ++i) {
+        resnet_layers_->push_back(ResidualBlock(resnet_channels_, i, use_batchnorm));
+    }
+    register_module("representation_head", resnet_head_);
+    register_module("representation_layers", resnet_layers_);
+    register_module("subgoal_1x1", conv1x1_subgoal_);
+    register_module("policy_mlp", policy_mlp_);
+}
+
+torch::Tensor SubgoalPolicyConvNetImpl::forward(torch::Tensor x, const torch::Tensor &subgoals,
+                                                const torch::Tensor &state_index) {
+    torch::Tensor output = resnet_head_->forward(x);
+    // ResNet body, once per state
+    for (int i = 0; i < (int)resnet_layers_->size(); ++i) {
+        output = resnet_layers_[i]->as<ResidualBlock>()->forward(output);
+    }
+
+    // Each subgoal gets the trunk features of its state, with its planes appended as extra channels
+    output = torch::cat({output.index_select(0, state_index), subgoals}, 1);
+    output = torch::relu(conv1x1_subgoal_->forward(output));
+    output = output.reshape({-1, policy_mlp_input_size_});
+    return policy_mlp_->forward(output);
+}
+
+void SubgoalPolicyConvNetImpl::fuse_batchnorm() {
+    resnet_head_->fuse_batchnorm();
+    for (int i = 0; i < (int)resnet_layers_->size(); ++i) {
+        resnet_layers_[i]->as<ResidualBlock>()->fuse_batchnorm();
+    }
+}
+
+}    // namespace hpts::model::network
@@ -0,0 +1,63 @@
+// File: subgoal_policy_convnet.h
+// Description: Convnet scoring the subgoals of a state, with a single trunk pass per state and late fused subgoal planes
+
+#ifndef HPTS_MODEL_SUBGOAL_POLICY_CONVNET_H_
+#define HPTS_MODEL_SUBGOAL_POLICY_CONVNET_H_
+
+// NOLINTBEGIN
+#include <torch/torch.h>
+// NOLINTEND
+
+#include <vector>
+
+#include "common/observation.h"
+#include "model/layers.h"
+
+namespace hpts::model::network {
+
+class SubgoalPolicyConvNetImpl : public torch::nn::Module {
+public:
+    /**
+     * ResNet style subgoal policy convnet. The trunk runs over the state observation only, and the subgoal planes are
+     * concatenated to the trunk features of their state before a lightweight conditioning head, so a state with many
+     * subgoals pays for a single trunk pass.
+     * @param observation_shape Input state observation shape to the network, without the subgoal planes
+     * @param subgoal_channels Number of subgoal planes
+     * @param resnet_channels Number of channels for each resenet block
+     * @param resnet_blocks Number of resnet blocks
+     * @param policy_channels Number of channels in the conditioning reduce head
+     * @param policy_mlp_layers Hidden layer sizes for the conditioning head MLP
+     * @param use_batchnorm Flag to use batchnorm in the resnet layers
+     */
+    SubgoalPolicyConvNetImpl(const ObservationShape &observation_shape, int subgoal_channels, int resnet_channels,
+                             int resnet_blocks, int policy_channels, const std::vector<int> &policy_mlp_layers,
+                             bool use_batchnorm);
+    /**
+     * @param x State observations -> [num_states, c, h, w]
+     * @param subgoals Subgoal planes of all states -> [num_subgoals, subgoal_channels, h, w]
+     * @param state_index Index of the state of each subgoal into x -> [num_subgoals]
+     * @return Logit of each subgoal -> [num_subgoals, 1]
+     */
+    [[nodiscard]] auto forward(torch::Tensor x, const torch::Tensor &subgoals, const torch::Tensor &state_index)
+        -> torch::Tensor;
+    // Fold batchnorm into the resnet convolutions, only to be used on an eval-only copy of the network
+    void fuse_batchnorm();
+
+private:
+    int input_channels_;
+    int input_height_;
+    int input_width_;
+    int subgoal_channels_;
+    int resnet_channels_;
+    int policy_channels_;
+    int policy_mlp_input_size_;
+    ResidualHead resnet_head_;
+    torch::nn::Conv2d conv1x1_subgoal_;    // Fuses the trunk features with the subgoal planes
+    MLP policy_mlp_;
+    torch::nn::ModuleList resnet_layers_;
+};
+TORCH_MODULE(SubgoalPolicyConvNet);
+
+}    // namespace hpts::model::network
+
+#endif    // HPTS_MODEL_SUBGOAL_POLICY_CONVNET_H_
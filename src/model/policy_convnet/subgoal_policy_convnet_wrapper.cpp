@@ -0,0 +1,332 @@
+// File: subgoal_policy_convnet_wrapper.cpp
+// Description: Convnet wrapper which scores the subgoals of a state into a single policy, sharing the trunk between them
+
+#include "model/policy_convnet/subgoal_policy_convnet_wrapper.h"
+
+// NOLINTBEGIN
+#include <absl/strings/str_cat.h>
+// NOLINTEND
+#include <spdlog/spdlog.h>
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <numeric>
+#include <ostream>
+#include <sstream>
+
+#include "model/checkpoint_writer.h"
+#include "model/loss_functions.h"
+#include "model/torch_util.h"
+#include "util/zip.h"
+
+namespace hpts::model::wrapper {
+
+namespace {
+// Network inputs of a batch, see SubgoalPolicyConvNetImpl::forward
+struct SubgoalBatch {
+    torch::Tensor states;         // (B, C - K, H, W)
+    torch::Tensor subgoals;       // (B * A, K, H, W)
+    torch::Tensor state_index;    // (B * A)
+};
+
+// Split each subgoal observation into the state planes, shared by all subgoals of a batch item, and its subgoal planes
+template <typename T>
+auto pack_subgoal_batch(const std::vector<T>& batch, const SubgoalPolicyConvNetConfig& config, const torch::Device& device)
+    -> SubgoalBatch {
+    const ObservationShape& shape = config.observation_shape;
+    const int state_channels = shape.c - config.subgoal_channels;
+    const auto cells = static_cast<std::size_t>(shape.h) * static_cast<std::size_t>(shape.w);
+    const std::size_t state_size = static_cast<std::size_t>(state_channels) * cells;
+    const std::size_t subgoal_size = static_cast<std::size_t>(config.subgoal_channels) * cells;
+    const std::vector<int64_t> counts = observation_counts(batch);
+    const int64_t N = std::accumulate(counts.begin(), counts.end(), static_cast<int64_t>(0));
+    const auto B = static_cast<int64_t>(batch.size());
+    const auto options_float = torch::TensorOptions().dtype(torch::kFloat);
+
+    // Batch items without subgoals keep zeroed state planes, no subgoal looks them up
+    torch::Tensor states = torch::zeros({B, state_channels, shape.h, shape.w}, options_float);
+    torch::Tensor subgoals = torch::empty({N, config.subgoal_channels, shape.h, shape.w}, options_float);
+    torch::Tensor state_index = torch::empty({N}, torch::TensorOptions().dtype(torch::kLong));
+    float* states_data = states.data_ptr<float>();
+    float* subgoals_data = subgoals.data_ptr<float>();
+    int64_t* state_index_data = state_index.data_ptr<int64_t>();
+
+    // NOLINTBEGIN (*-pointer-arithmetic)
+    for (std::size_t batch_idx = 0; batch_idx < batch.size(); ++batch_idx) {
+        const auto& batch_item = batch[batch_idx];
+        if (!batch_item.observations.empty()) {
+            std::memcpy(states_data + batch_idx * state_size, batch_item.observations[0].data(), state_size * sizeof(float));
+        }
+        for (const auto& obs : batch_item.observations) {
+            assert(obs.size() == state_size + subgoal_size);
+            std::memcpy(subgoals_data, obs.data() + state_size, subgoal_size * sizeof(float));
+            *state_index_data++ = static_cast<int64_t>(batch_idx);
+            subgoals_data += subgoal_size;
+        }
+    }
+    // NOLINTEND (*-pointer-arithmetic)
+    return {states.to(device), subgoals.to(device), state_index.to(device)};
+}
+}    // namespace
+
+SubgoalPolicyConvNetWrapperBase::SubgoalPolicyConvNetWrapperBase(const SubgoalPolicyConvNetConfig& config, double learning_rate,
+                                                                 double l2_weight_decay, const std::string& device,
+                                                                 const std::string& output_path,
+                                                                 const std::string& checkpoint_base_name)
+    : BaseModelWrapper(device, output_path, checkpoint_base_name),
+      model_(ObservationShape(config.observation_shape.c - config.subgoal_channels, config.observation_shape.h,
+                              config.observation_shape.w),
+             config.subgoal_channels, config.resnet_channels, config.resnet_blocks, config.policy_channels,
+             config.policy_mlp_layers, config.use_batchnorm),
+      model_optimizer_(model_->parameters(), torch::optim::AdamOptions(learning_rate).weight_decay(l2_weight_decay)),
+      config(config) {
+    if (config.subgoal_channels <= 0 || config.subgoal_channels >= config.observation_shape.c) {
+        SPDLOG_ERROR("Subgoal channels {:d} must be in (0, {:d}).", config.subgoal_channels, config.observation_shape.c);
+        std::exit(1);
+    }
+    model_->to(torch_device_);
+};
+
+void SubgoalPolicyConvNetWrapperBase::print() const {
+    std::ostringstream oss;
+    std::ostream& os = oss;
+    os << *model_;
+    SPDLOG_INFO("{:s}", oss.str());
+    std::size_t num_params = 0;
+    for (const auto& p : model_->parameters()) {
+        num_params += p.numel();
+    }
+    SPDLOG_INFO("Number of parameters: {:d}", num_params);
+}
+
+auto SubgoalPolicyConvNetWrapperBase::SaveCheckpoint(long long int step) -> std::string {
+    // create directory for model
+    std::filesystem::create_directories(path_);
+    std::string full_path = absl::StrCat(path_, checkpoint_base_name_, "checkpoint-", step);
+    SPDLOG_INFO("Checkpointing model to {:s}.pt", full_path);
+    checkpoint_writer::save(model_, absl::StrCat(full_path, ".pt"));
+    checkpoint_writer::save(model_optimizer_, absl::StrCat(full_path, "-optimizer.pt"));
+    return full_path;
+}
+auto SubgoalPolicyConvNetWrapperBase::SaveCheckpointWithoutOptimizer(long long int step) -> std::string {
+    // create directory for model
+    std::filesystem::create_directories(path_);
+    std::string full_path = absl::StrCat(path_, checkpoint_base_name_, "checkpoint-", step);
+    SPDLOG_INFO("Checkpointing model to {:s}.pt", full_path);
+    checkpoint_writer::save(model_, absl::StrCat(full_path, ".pt"));
+    return full_path;
+}
+
+void SubgoalPolicyConvNetWrapperBase::LoadCheckpoint(const std::string& path) {
+    // Checkpoint may still be queued in the background writer
+    checkpoint_writer::flush();
+    if (!std::filesystem::exists(absl::StrCat(path, ".pt")) || !std::filesystem::exists(absl::StrCat(path, "-optimizer.pt"))) {
+        SPDLOG_ERROR("path {:s} does not contain model and/or optimizer", path);
+        std::exit(1);
+    }
+    torch::load(model_, absl::StrCat(path, ".pt"), torch_device_);
+    torch::load(model_optimizer_, absl::StrCat(path, "-optimizer.pt"), torch_device_);
+    inference_model_version_ = -1;
+}
+void SubgoalPolicyConvNetWrapperBase::LoadCheckpointWithoutOptimizer(const std::string& path) {
+    // Checkpoint may still be queued in the background writer
+    checkpoint_writer::flush();
+    if (!std::filesystem::exists(absl::StrCat(path, ".pt"))) {
+        SPDLOG_ERROR("path {:s} does not contain model", path);
+        std::exit(1);
+    }
+    torch::load(model_, absl::StrCat(path, ".pt"), torch_device_);
+    inference_model_version_ = -1;
+}
+
+auto SubgoalPolicyConvNetWrapperBase::Modules() -> std::vector<std::shared_ptr<torch::nn::Module>> {
+    return {model_.ptr()};
+}
+
+void SubgoalPolicyConvNetWrapperBase::UpdateInferenceModel() {
+    const int64_t version = module_state_version(*model_);
+    if (inference_model_ && version == inference_model_version_) {
+        return;
+    }
+    network::SubgoalPolicyConvNet inference_model(
+        ObservationShape(config.observation_shape.c - config.subgoal_channels, config.observation_shape.h,
+                         config.observation_shape.w),
+        config.subgoal_channels, config.resnet_channels, config.resnet_blocks, config.policy_channels,
+        config.policy_mlp_layers, config.use_batchnorm);
+    copy_module_state(*model_, *inference_model);
+    inference_model->fuse_batchnorm();
+    // Batchnorm is folded in fp32 before casting, so the folded scales don't lose precision twice
+    inference_model->to(torch_device_, inference_dtype(config.inference_bf16));
+    inference_model->eval();
+    inference_model_ = std::move(inference_model);
+    inference_model_version_ = version;
+}
+
+auto SubgoalPolicyConvNetWrapperBase::Inference(std::vector<InferenceInput>& batch) -> std::vector<InferenceOutput> {
+    const SubgoalBatch inputs = pack_subgoal_batch(batch, config, torch_device_);
+    const auto N = inputs.subgoals.size(0);
+    const auto dtype = inference_dtype(config.inference_bf16);
+
+    // Inference copy is always in eval mode, and inference mode skips autograd tracking entirely
+    UpdateInferenceModel();
+    const torch::InferenceMode inference_guard;
+
+    // Run inference (B, C - K, H, W) + (B * A, K, H, W) -> (B * A, 1)
+    // The softmax runs in fp32 even for a bf16 inference copy
+    const torch::Tensor model_output =
+        inference_model_->forward(inputs.states.to(dtype), inputs.subgoals.to(dtype), inputs.state_index).to(torch::kFloat);
+
+    // Pad each batch item's logits to a common length, and create the policies with one masked softmax
+    const torch::Tensor mask = segment_mask(observation_counts(batch), torch_device_);
+    const torch::Tensor logits = pad_segments(model_output.flatten(), mask, -std::numeric_limits<double>::infinity());
+    const torch::Tensor policy = torch::softmax(logits, 1);
+    const torch::Tensor log_policy = torch::log_softmax(logits, 1);
+
+    // Bring back the valid entries of all outputs in a single transfer -> (3, B * A)
+    const torch::Tensor outputs =
+        torch::stack({logits.masked_select(mask), policy.masked_select(mask), log_policy.masked_select(mask)})
+            .to(torch::kCPU, torch::kDouble)
+            .contiguous();
+    const double* logits_data = outputs.data_ptr<double>();
+    const double* policy_data = logits_data + N;        // NOLINT (*-pointer-arithmetic)
+    const double* log_policy_data = policy_data + N;    // NOLINT (*-pointer-arithmetic)
+
+    // Collect back the original number of inputs per batch item
+    std::size_t offset = 0;
+    std::vector<InferenceOutput> inference_output;
+    inference_output.reserve(batch.size());
+    for (const auto& batch_item : batch) {
+        const auto slice_size = batch_item.observations.size();
+        // NOLINTBEGIN (*-pointer-arithmetic)
+        inference_output.emplace_back(std::vector<double>(logits_data + offset, logits_data + offset + slice_size),
+                                      std::vector<double>(policy_data + offset, policy_data + offset + slice_size),
+                                      std::vector<double>(log_policy_data + offset, log_policy_data + offset + slice_size));
+        // NOLINTEND (*-pointer-arithmetic)
+        offset += slice_size;
+    }
+    return inference_output;
+}
+
+auto SubgoalPolicyConvNetWrapperLevin::Learn(std::vector<LearningInput>& batch) -> double {
+    const auto batch_size = static_cast<int>(batch.size());
+    const auto options_float = torch::TensorOptions().dtype(torch::kFloat);
+    const auto options_long = torch::TensorOptions().dtype(torch::kLong);
+
+    torch::Tensor target_actions = torch::empty({batch_size, 1}, options_long);
+    torch::Tensor expandeds = torch::empty({batch_size, 1}, options_float);
+    for (auto&& [batch_idx, batch_item] : enumerate(batch)) {
+        const auto i = static_cast<int>(batch_idx);    // stop torch from complaining about narrowing conversions
+        target_actions[i] = batch_item.target_action;
+        expandeds[i] = static_cast<float>(batch_item.solution_expanded);
+    }
+    const SubgoalBatch inputs = pack_subgoal_batch(batch, config, torch_device_);
+    target_actions = target_actions.to(torch_device_);
+    expandeds = expandeds.to(torch_device_);
+
+    // Put model in train mode for learning
+    model_->train();
+    model_->zero_grad();
+
+    // Get model output (B, C - K, H, W) + (B * A, K, H, W) -> (B * A, 1)
+    const torch::Tensor model_output = model_->forward(inputs.states, inputs.subgoals, inputs.state_index);
+
+    // Pad each batch item's logits to a common length, padded subgoals are masked out of the softmax
+    const torch::Tensor mask = segment_mask(observation_counts(batch), torch_device_);
+    const torch::Tensor logits = pad_segments(model_output.flatten(), mask, -std::numeric_limits<double>::infinity());
+
+    const torch::Tensor loss = (expandeds.flatten() * loss::cross_entropy_loss(logits, target_actions, false)).mean();
+    auto loss_value = loss.item<double>();
+
+    // Optimize model
+    loss.backward();
+    model_optimizer_.step();
+
+    return loss_value;
+}
+
+auto SubgoalPolicyConvNetWrapperPolicyGradient::Learn(std::vector<LearningInput>& batch) -> double {
+    const auto batch_size = static_cast<int>(batch.size());
+    const auto options_float = torch::TensorOptions().dtype(torch::kFloat);
+    const auto options_long = torch::TensorOptions().dtype(torch::kLong);
+
+    torch::Tensor target_actions = torch::empty({batch_size, 1}, options_long);
+    torch::Tensor rewards = torch::empty({batch_size, 1}, options_float);
+    for (auto&& [batch_idx, batch_item] : enumerate(batch)) {
+        const auto i = static_cast<int>(batch_idx);    // stop torch from complaining about narrowing conversions
+        target_actions[i] = batch_item.target_action;
+        rewards[i] = static_cast<float>(batch_item.reward);
+    }
+    const SubgoalBatch inputs = pack_subgoal_batch(batch, config, torch_device_);
+    target_actions = target_actions.to(torch_device_);
+    rewards = rewards.to(torch_device_);
+
+    // Put model in train mode for learning
+    model_->train();
+    model_->zero_grad();
+
+    // Get model output (B, C - K, H, W) + (B * A, K, H, W) -> (B * A, 1)
+    const torch::Tensor model_output = model_->forward(inputs.states, inputs.subgoals, inputs.state_index);
+
+    // Pad each batch item's logits to a common length, padded subgoals are masked out of the softmax
+    const torch::Tensor mask = segment_mask(observation_counts(batch), torch_device_);
+    const torch::Tensor logits = pad_segments(model_output.flatten(), mask, -std::numeric_limits<double>::infinity());
+
+    const torch::Tensor loss = loss::policy_gradient_loss(logits, target_actions, rewards, false).mean();
+    auto loss_value = loss.item<double>();
+
+    // Optimize model
+    loss.backward();
+    model_optimizer_.step();
+
+    return loss_value;
+}
+
+auto SubgoalPolicyConvNetWrapperPHS::Learn(std::vector<LearningInput>& batch) -> double {
+    const auto batch_size = static_cast<int>(batch.size());
+    const auto options_float = torch::TensorOptions().dtype(torch::kFloat);
+    const auto options_long = torch::TensorOptions().dtype(torch::kLong);
+
+    torch::Tensor target_actions = torch::empty({batch_size, 1}, options_long);
+    torch::Tensor depths = torch::empty({batch_size, 1}, options_float);
+    torch::Tensor expandeds = torch::empty({batch_size, 1}, options_float);
+    torch::Tensor log_pis = torch::empty({batch_size, 1}, options_float);
+    for (auto&& [batch_idx, batch_item] : enumerate(batch)) {
+        const auto i = static_cast<int>(batch_idx);    // stop torch from complaining about narrowing conversions
+        target_actions[i] = batch_item.target_action;
+        depths[i] = static_cast<float>(batch_item.solution_cost);
+        expandeds[i] = static_cast<float>(batch_item.solution_expanded);
+        log_pis[i] = static_cast<float>(batch_item.solution_log_pi);
+    }
+    const SubgoalBatch inputs = pack_subgoal_batch(batch, config, torch_device_);
+    target_actions = target_actions.to(torch_device_);
+    depths = depths.to(torch_device_);
+    expandeds = expandeds.to(torch_device_);
+    log_pis = log_pis.to(torch_device_);
+
+    // Put model in train mode for learning
+    model_->train();
+    model_->zero_grad();
+
+    // Get model output (B, C - K, H, W) + (B * A, K, H, W) -> (B * A, 1)
+    const torch::Tensor model_output = model_->forward(inputs.states, inputs.subgoals, inputs.state_index);
+
+    // Pad each batch item's logits to a common length, padded subgoals are masked out of the softmax
+    const torch::Tensor mask = segment_mask(observation_counts(batch), torch_device_);
+    const torch::Tensor logits = pad_segments(model_output.flatten(), mask, -std::numeric_limits<double>::infinity());
+
+    // Per item loss terms are flattened so the cross entropy (B) and the per item terms (B, 1) don't broadcast
+    const torch::Tensor loss =
+        loss::phs_loss(logits, target_actions, depths.flatten(), expandeds.flatten(), log_pis.flatten(), false).mean();
+    auto loss_value = loss.item<double>();
+
+    // Optimize model
+    loss.backward();
+    model_optimizer_.step();
+
+    return loss_value;
+}
+
+}    // namespace hpts::model::wrapper
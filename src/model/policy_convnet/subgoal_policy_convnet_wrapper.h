@@ -0,0 +1,130 @@
+// File: subgoal_policy_convnet_wrapper.h
+// Description: Convnet wrapper which scores the subgoals of a state into a single policy, sharing the trunk between them
+
+#ifndef HPTS_WRAPPER_SUBGOAL_POLICY_CONVNET_H_
+#define HPTS_WRAPPER_SUBGOAL_POLICY_CONVNET_H_
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "common/observation.h"
+#include "model/base_model_wrapper.h"
+#include "model/policy_convnet/subgoal_policy_convnet.h"
+#include "util/concepts.h"
+
+namespace hpts::model::wrapper {
+
+struct SubgoalPolicyConvNetConfig {
+    ObservationShape observation_shape;    // Shape of each subgoal observation, the state planes then the subgoal planes
+    int subgoal_channels;                  // Number of trailing subgoal planes of each subgoal observation
+    int resnet_channels;
+    int resnet_blocks;
+    int policy_channels;
+    std::vector<int> policy_mlp_layers;
+    bool use_batchnorm;
+    bool inference_bf16 = false;           // Run the inference copy in bfloat16, learning stays in fp32
+};
+
+// Drop-in for the variable policy wrapper on subgoal observations (i.e. from get_observation_subgoal()), which only
+// differ in their trailing subgoal planes. The trunk runs once per batch item on the state planes of its first
+// observation, and only the conditioning head runs per subgoal.
+class SubgoalPolicyConvNetWrapperBase : public BaseModelWrapper {
+public:
+    constexpr static std::string ModelType = "subgoal_policy";
+    constexpr static std::string LevinLoss = "levin";
+    constexpr static std::string PolicyGradientLoss = "policy_gradient";
+    constexpr static std::string PHSLoss = "phs";
+
+    struct InferenceInput {
+        std::vector<Observation> observations;
+    };
+
+    struct InferenceOutput {
+        std::vector<double> logits;
+        std::vector<double> policy;
+        std::vector<double> log_policy;
+    };
+
+    SubgoalPolicyConvNetWrapperBase(const SubgoalPolicyConvNetConfig& config, double learning_rate, double l2_weight_decay,
+                                    const std::string& device, const std::string& output_path,
+                                    const std::string& checkpoint_base_name = "");
+
+    void print() const override;
+
+    auto SaveCheckpoint(long long int step = -1) -> std::string override;
+    auto SaveCheckpointWithoutOptimizer(long long int step = -1) -> std::string override;
+
+    using BaseModelWrapper::LoadCheckpoint;
+    using BaseModelWrapper::LoadCheckpointWithoutOptimizer;
+    void LoadCheckpoint(const std::string& path) override;
+    void LoadCheckpointWithoutOptimizer(const std::string& path) override;
+
+    [[nodiscard]] auto Modules() -> std::vector<std::shared_ptr<torch::nn::Module>> override;
+
+    /**
+     * Perform inference
+     * @param inputs Batched subgoal observations of each state
+     * @returns Policy over the subgoals of each state
+     */
+    [[nodiscard]] auto Inference(std::vector<InferenceInput>& batch) -> std::vector<InferenceOutput>;
+
+protected:
+    // Rebuild the inference copy from the current weights if they changed since it was last built
+    void UpdateInferenceModel();
+
+    // NOLINTBEGIN(*-non-private-member-variables-in-classes)
+    network::SubgoalPolicyConvNet model_;
+    torch::optim::Adam model_optimizer_;
+    SubgoalPolicyConvNetConfig config;
+    network::SubgoalPolicyConvNet inference_model_{nullptr};    // Eval-only copy with batchnorm folded, used for inference
+    std::atomic<int64_t> inference_model_version_{-1};          // Weight version the inference copy was built from
+    // NOLINTEND(*-non-private-member-variables-in-classes)
+};
+
+// Implementations for various loss types
+
+class SubgoalPolicyConvNetWrapperLevin : public SubgoalPolicyConvNetWrapperBase {
+public:
+    using BaseType = SubgoalPolicyConvNetWrapperBase;
+    struct LearningInput {
+        std::vector<Observation> observations;
+        int target_action = -1;
+        int solution_expanded = 0;
+    };
+
+    using SubgoalPolicyConvNetWrapperBase::SubgoalPolicyConvNetWrapperBase;
+    auto Learn(std::vector<LearningInput>& batch) -> double;
+};
+
+class SubgoalPolicyConvNetWrapperPolicyGradient : public SubgoalPolicyConvNetWrapperBase {
+public:
+    using BaseType = SubgoalPolicyConvNetWrapperBase;
+    struct LearningInput {
+        std::vector<Observation> observations;
+        int target_action = -1;
+        double reward = 0;
+    };
+
+    using SubgoalPolicyConvNetWrapperBase::SubgoalPolicyConvNetWrapperBase;
+    auto Learn(std::vector<LearningInput>& batch) -> double;
+};
+
+class SubgoalPolicyConvNetWrapperPHS : public SubgoalPolicyConvNetWrapperBase {
+public:
+    using BaseType = SubgoalPolicyConvNetWrapperBase;
+    struct LearningInput {
+        std::vector<Observation> observations;
+        int target_action = -1;
+        double solution_cost = 0;
+        int solution_expanded = 0;
+        double solution_log_pi = 0;
+    };
+
+    using SubgoalPolicyConvNetWrapperBase::SubgoalPolicyConvNetWrapperBase;
+    auto Learn(std::vector<LearningInput>& batch) -> double;
+};
+
+}    // namespace hpts::model::wrapper
+
+#endif    // HPTS_WRAPPER_SUBGOAL_POLICY_CONVNET_H_
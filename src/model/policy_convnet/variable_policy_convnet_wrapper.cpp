@@ -10,10 +10,12 @@
 
 #include <cmath>
 #include <filesystem>
+#include <limits>
 #include <numeric>
 #include <ostream>
 #include <sstream>
 
+#include "model/checkpoint_writer.h"
 #include "model/loss_functions.h"
 #include "model/torch_util.h"
 #include "util/zip.h"
@@ -51,8 +53,8 @@ auto VariablePolicyConvNetWrapperBase::SaveCheckpoint(long long int step) -> std
     std::filesystem::create_directories(path_);
     std::string full_path = absl::StrCat(path_, checkpoint_base_name_, "checkpoint-", step);
     SPDLOG_INFO("Checkpointing model to {:s}.pt", full_path);
-    torch::save(model_, absl::StrCat(full_path, ".pt"));
-    torch::save(model_optimizer_, absl::StrCat(full_path, "-optimizer.pt"));
+    checkpoint_writer::save(model_, absl::StrCat(full_path, ".pt"));
+    checkpoint_writer::save(model_optimizer_, absl::StrCat(full_path, "-optimizer.pt"));
     return full_path;
 }
 auto VariablePolicyConvNetWrapperBase::SaveCheckpointWithoutOptimizer(long long int step) -> std::string {
@@ -60,11 +62,13 @@ auto VariablePolicyConvNetWrapperBase::SaveCheckpointWithoutOptimizer(long long
     std::filesystem::create_directories(path_);
     std::string full_path = absl::StrCat(path_, checkpoint_base_name_, "checkpoint-", step);
     SPDLOG_INFO("Checkpointing model to {:s}.pt", full_path);
-    torch::save(model_, absl::StrCat(full_path, ".pt"));
+    checkpoint_writer::save(model_, absl::StrCat(full_path, ".pt"));
     return full_path;
 }
 
 void VariablePolicyConvNetWrapperBase::LoadCheckpoint(const std::string& path) {
+    // Checkpoint may still be queued in the background writer
+    checkpoint_writer::flush();
     if (!std::filesystem::exists(absl::StrCat(path, ".pt")) || !std::filesystem::exists(absl::StrCat(path, "-optimizer.pt"))) {
         SPDLOG_ERROR("path {:s} does not contain model and/or optimizer", path);
         std::exit(1);
@@ -73,6 +77,8 @@ void VariablePolicyConvNetWrapperBase::LoadCheckpoint(const std::string& path) {
     torch::load(model_optimizer_, absl::StrCat(path, "-optimizer.pt"), torch_device_);
 }
 void VariablePolicyConvNetWrapperBase::LoadCheckpointWithoutOptimizer(const std::string& path) {
+    // Checkpoint may still be queued in the background writer
+    checkpoint_writer::flush();
     if (!std::filesystem::exists(absl::StrCat(path, ".pt"))) {
         SPDLOG_ERROR("path {:s} does not contain model", path);
         std::exit(1);
@@ -80,6 +86,10 @@ void VariablePolicyConvNetWrapperBase::LoadCheckpointWithoutOptimizer(const std:
     torch::load(model_, absl::StrCat(path, ".pt"), torch_device_);
 }
 
+auto VariablePolicyConvNetWrapperBase::Modules() -> std::vector<std::shared_ptr<torch::nn::Module>> {
+    return {model_.ptr()};
+}
+
 auto VariablePolicyConvNetWrapperBase::Inference(std::vector<InferenceInput>& batch) -> std::vector<InferenceOutput> {
     const int N = std::accumulate(batch.begin(), batch.end(), 0,
                                   [&](std::size_t lhs, const InferenceInput& rhs) { return lhs + rhs.observations.size(); });
@@ -113,18 +123,33 @@ auto VariablePolicyConvNetWrapperBase::Inference(std::vector<InferenceInput>& ba
     // Run inference  (B * A, C, H, W) -> (B * A, 1)
     torch::Tensor model_output = model_->forward(input_observations);    // (B * A, C, H, W) -> (B * A, 1)
 
-    // Collect back the original number of inputs per batch item, and create policy
-    idx = 0;
+    // Pad each batch item's logits to a common length, and create the policies with one masked softmax
+    const torch::Tensor mask = segment_mask(observation_counts(batch), torch_device_);
+    const torch::Tensor logits = pad_segments(model_output.flatten(), mask, -std::numeric_limits<double>::infinity());
+    const torch::Tensor policy = torch::softmax(logits, 1);
+    const torch::Tensor log_policy = torch::log_softmax(logits, 1);
+
+    // Bring back the valid entries of all outputs in a single transfer -> (3, B * A)
+    const torch::Tensor outputs =
+        torch::stack({logits.masked_select(mask), policy.masked_select(mask), log_policy.masked_select(mask)})
+            .to(torch::kCPU, torch::kDouble)
+            .contiguous();
+    const double* logits_data = outputs.data_ptr<double>();
+    const double* policy_data = logits_data + N;        // NOLINT (*-pointer-arithmetic)
+    const double* log_policy_data = policy_data + N;    // NOLINT (*-pointer-arithmetic)
+
+    // Collect back the original number of inputs per batch item
+    std::size_t offset = 0;
     std::vector<InferenceOutput> inference_output;
+    inference_output.reserve(batch.size());
     for (const auto& batch_item : batch) {
         const auto slice_size = batch_item.observations.size();
-        const auto output_slice = model_output.index({torch::indexing::Slice(idx, idx + slice_size)}).flatten();
-        const auto logits_output = output_slice.to(torch::kDouble).to(torch::kCPU);
-        const auto policy_output = torch::softmax(output_slice, 0).to(torch::kDouble).to(torch::kCPU);
-        const auto log_policy_output = torch::log_softmax(output_slice, 0).to(torch::kDouble).to(torch::kCPU);
-        inference_output.emplace_back(tensor_to_vec<double>(logits_output), tensor_to_vec<double>(policy_output),
-                                      tensor_to_vec<double>(log_policy_output));
-        idx += slice_size;
+        // NOLINTBEGIN (*-pointer-arithmetic)
+        inference_output.emplace_back(std::vector<double>(logits_data + offset, logits_data + offset + slice_size),
+                                      std::vector<double>(policy_data + offset, policy_data + offset + slice_size),
+                                      std::vector<double>(log_policy_data + offset, log_policy_data + offset + slice_size));
+        // NOLINTEND (*-pointer-arithmetic)
+        offset += slice_size;
     }
     return inference_output;
 }
@@ -168,18 +193,11 @@ auto VariablePolicyConvNetWrapperLevin::Learn(std::vector<LearningInput>& batch)
     // Get model output
     torch::Tensor model_output = model_->forward(input_observations);    // (B * A, C, H, W) -> (B * A, 1)
 
-    // Collect back the original number of inputs per batch item, and create policy
-    idx = 0;
-    std::vector<torch::Tensor> losses;
-    for (auto&& [batch_idx, batch_item] : enumerate(batch)) {
-        const auto slice_size = static_cast<int>(batch_item.observations.size());
-        const auto logits =
-            model_output.index({torch::indexing::Slice(idx, idx + slice_size)}).view({1, -1});    // (1, slice_size)
-        losses.push_back(loss::cross_entropy_loss(logits, target_actions[static_cast<int>(batch_idx)].view({1, 1}), false));
-        idx += slice_size;
-    }
+    // Pad each batch item's logits to a common length, padded actions are masked out of the softmax
+    const torch::Tensor mask = segment_mask(observation_counts(batch), torch_device_);
+    const torch::Tensor logits = pad_segments(model_output.flatten(), mask, -std::numeric_limits<double>::infinity());
 
-    const torch::Tensor loss = (expandeds * torch::cat(losses)).mean();
+    const torch::Tensor loss = (expandeds.flatten() * loss::cross_entropy_loss(logits, target_actions, false)).mean();
     auto loss_value = loss.item<double>();
 
     // Optimize model
@@ -228,19 +246,11 @@ auto VariablePolicyConvNetWrapperPolicyGradient::Learn(std::vector<LearningInput
     // Get model output
     torch::Tensor model_output = model_->forward(input_observations);    // (B * A, C, H, W) -> (B * A, 1)
 
-    // Collect back the original number of inputs per batch item, and create policy
-    idx = 0;
-    std::vector<torch::Tensor> losses;
-    for (auto&& [batch_idx, batch_item] : enumerate(batch)) {
-        const auto slice_size = static_cast<int>(batch_item.observations.size());
-        const auto logits =
-            model_output.index({torch::indexing::Slice(idx, idx + slice_size)}).view({1, -1});    // (1, slice_size)
-        losses.push_back(loss::policy_gradient_loss(logits, target_actions[static_cast<int>(batch_idx)].view({1, 1}),
-                                                    rewards[static_cast<int>(batch_idx)].view({1, 1}), false));
-        idx += slice_size;
-    }
+    // Pad each batch item's logits to a common length, padded actions are masked out of the softmax
+    const torch::Tensor mask = segment_mask(observation_counts(batch), torch_device_);
+    const torch::Tensor logits = pad_segments(model_output.flatten(), mask, -std::numeric_limits<double>::infinity());
 
-    const torch::Tensor loss = torch::cat(losses).mean();
+    const torch::Tensor loss = loss::policy_gradient_loss(logits, target_actions, rewards, false).mean();
     auto loss_value = loss.item<double>();
 
     // Optimize model
@@ -295,20 +305,13 @@ auto VariablePolicyConvNetWrapperPHS::Learn(std::vector<LearningInput>& batch) -
     // Get model output
     torch::Tensor model_output = model_->forward(input_observations);    // (B * A, C, H, W) -> (B * A, 1)
 
-    // Collect back the original number of inputs per batch item, and create policy
-    idx = 0;
-    std::vector<torch::Tensor> losses;
-    for (auto&& [batch_idx, batch_item] : enumerate(batch)) {
-        const auto slice_size = static_cast<int>(batch_item.observations.size());
-        const auto logits =
-            model_output.index({torch::indexing::Slice(idx, idx + slice_size)}).view({1, -1});    // (1, slice_size)
-        losses.push_back(loss::phs_loss(
-            logits, target_actions[static_cast<int>(batch_idx)].view({1, 1}), depths[static_cast<int>(batch_idx)].view({1, 1}),
-            expandeds[static_cast<int>(batch_idx)].view({1, 1}), log_pis[static_cast<int>(batch_idx)].view({1, 1}), false));
-        idx += slice_size;
-    }
+    // Pad each batch item's logits to a common length, padded actions are masked out of the softmax
+    const torch::Tensor mask = segment_mask(observation_counts(batch), torch_device_);
+    const torch::Tensor logits = pad_segments(model_output.flatten(), mask, -std::numeric_limits<double>::infinity());
 
-    const torch::Tensor loss = torch::cat(losses).mean();
+    // Per item loss terms are flattened so the cross entropy (B) and the per item terms (B, 1) don't broadcast
+    const torch::Tensor loss =
+        loss::phs_loss(logits, target_actions, depths.flatten(), expandeds.flatten(), log_pis.flatten(), false).mean();
     auto loss_value = loss.item<double>();
 
     // Optimize model
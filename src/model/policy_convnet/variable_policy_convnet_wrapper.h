@@ -43,6 +43,8 @@ public:
     void LoadCheckpoint(const std::string& path) override;
     void LoadCheckpointWithoutOptimizer(const std::string& path) override;
 
+    [[nodiscard]] auto Modules() -> std::vector<std::shared_ptr<torch::nn::Module>> override;
+
     /**
      * Perform inference
      * @param inputs Batched observations (implementation defined)
@@ -0,0 +1,101 @@
+// File: replay_evaluator.h
+// Description: Evaluator which serves inference requests from a recorded run, without running a model
+
+#ifndef HPTS_MODEL_REPLAY_EVALUATOR_H_
+#define HPTS_MODEL_REPLAY_EVALUATOR_H_
+
+// NOLINTBEGIN
+#include <spdlog/spdlog.h>
+// NOLINTEND
+
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "model/base_model_wrapper.h"
+#include "model/inference_record.h"
+
+namespace hpts::model {
+
+// Serves the same inference requests as ModelEvaluator from a record saved by ModelEvaluator::record_inference, with no
+// model or device involved. As replayed outputs don't depend on batching or timing, searches using it are deterministic
+// and their cost is purely that of the search itself, which is used to benchmark the search machinery in isolation.
+// Only observations seen in the recorded run can be replayed, so the replaying search needs the same settings: problems,
+// search budget, inference batch size, mix epsilon, and a single synchronous search per problem (i.e. no async
+// inference or portfolio).
+template <ModelWrapper ModelWrapperT>
+class ReplayEvaluator {
+public:
+    // Expose types from model wrapper to users of the evaluator
+    using InferenceInput = ModelWrapperT::InferenceInput;
+    using InferenceOutput = ModelWrapperT::InferenceOutput;
+    using LearningInput = ModelWrapperT::LearningInput;
+    using BaseType = ModelWrapperT::BaseType;
+
+    /**
+     * @param record_path Path of the inference record to replay
+     */
+    explicit ReplayEvaluator(const std::string& record_path) {
+        record_.load(record_path);
+    }
+
+    /**
+     * Look up the recorded outputs for a group of observations
+     * @param inference_inputs inputs for inference
+     * @return inference outputs
+     * @throw std::out_of_range if an observation wasn't recorded
+     */
+    [[nodiscard]] auto Inference(std::vector<InferenceInput>& inference_inputs) -> std::vector<InferenceOutput> {
+        std::vector<InferenceOutput> outputs;
+        outputs.reserve(inference_inputs.size());
+        for (const auto& input : inference_inputs) {
+            auto output = record_.find(RecordT::make_key(input));
+            if (!output) {
+                SPDLOG_ERROR("Observation missing from the inference record, the search diverged from the recorded run.");
+                throw std::out_of_range("Observation missing from the inference record.");
+            }
+            outputs.push_back(std::move(*output));
+        }
+        return outputs;
+    }
+
+    [[nodiscard]] auto InferenceBatched(std::vector<InferenceInput>&& inference_inputs) -> std::vector<InferenceOutput> {
+        return Inference(inference_inputs);
+    }
+
+    /**
+     * Look up the recorded outputs, which are ready as soon as the future is returned
+     * @param inference_inputs inputs for inference
+     * @return future holding the inference outputs
+     */
+    [[nodiscard]] auto InferenceAsync(std::vector<InferenceInput>&& inference_inputs)
+        -> std::future<std::vector<InferenceOutput>> {
+        std::promise<std::vector<InferenceOutput>> prom;
+        try {
+            prom.set_value(Inference(inference_inputs));
+        } catch (...) {
+            prom.set_exception(std::current_exception());
+        }
+        return prom.get_future();
+    }
+
+    /**
+     * Print the size of the record, in place of the model
+     */
+    void print() const {
+        SPDLOG_INFO("Replaying {:d} recorded inference outputs.", record_.size());
+    }
+
+    // No batching across searchers, so active searchers don't need to be tracked
+    void increment_batch_size() {}
+    void decrement_batch_size() {}
+
+private:
+    using RecordT = InferenceRecord<InferenceInput, InferenceOutput>;
+    RecordT record_;
+};
+
+}    // namespace hpts::model
+
+#endif    // HPTS_MODEL_REPLAY_EVALUATOR_H_
@@ -3,7 +3,10 @@
 
 #include "model/torch_util.h"
 
+#include <algorithm>
+#include <cassert>
 #include <cmath>
+#include <utility>
 
 namespace hpts::model {
 
@@ -13,6 +16,73 @@ const double SQRT_2 = std::sqrt(2.0);
 constexpr double PI = 3.14159265358979;
 const double pdf_const = (1.0 / std::sqrt(2.0 * PI));
 
+auto to_cpu_float(const torch::Tensor &x) -> torch::Tensor {
+    return x.to(torch::kCPU, torch::kFloat).contiguous();
+}
+
+auto tensor_row_view(const torch::Tensor &x, int64_t row) -> std::span<const float> {
+    assert(x.dim() == 2 && x.is_contiguous() && x.scalar_type() == torch::kFloat);
+    const int64_t row_size = x.size(1);
+    return {x.data_ptr<float>() + (row * row_size), static_cast<std::size_t>(row_size)};    // NOLINT (*-pointer-arithmetic)
+}
+
+auto make_batch_storage(std::vector<torch::Tensor> tensors) -> std::shared_ptr<const void> {
+    return std::make_shared<const std::vector<torch::Tensor>>(std::move(tensors));
+}
+
+auto segment_mask(const std::vector<int64_t> &lengths, const torch::Device &device) -> torch::Tensor {
+    const int64_t max_length = lengths.empty() ? 0 : *std::ranges::max_element(lengths);
+    const torch::Tensor lengths_tensor = torch::tensor(lengths, torch::kLong).to(device);
+    return torch::arange(max_length, torch::TensorOptions().dtype(torch::kLong).device(device)).unsqueeze(0) <
+           lengths_tensor.unsqueeze(1);
+}
+
+auto pad_segments(const torch::Tensor &x, const torch::Tensor &mask, double pad_value) -> torch::Tensor {
+    // masked_scatter fills the mask in row-major order, which is the order the segments are concatenated in
+    return torch::full(mask.sizes(), pad_value, x.options()).masked_scatter(mask, x);
+}
+
+void copy_module_state(const torch::nn::Module &src, torch::nn::Module &dst) {
+    const torch::NoGradGuard no_grad;
+    const auto src_parameters = src.named_parameters();
+    for (auto &item : dst.named_parameters()) {
+        item.value().copy_(src_parameters[item.key()]);
+    }
+    const auto src_buffers = src.named_buffers();
+    for (auto &item : dst.named_buffers()) {
+        item.value().copy_(src_buffers[item.key()]);
+    }
+}
+
+void to_channels_last(torch::nn::Module &module) {
+    const torch::NoGradGuard no_grad;
+    for (auto &p : module.parameters()) {
+        if (p.dim() == 4) {
+            p.set_data(p.contiguous(torch::MemoryFormat::ChannelsLast));
+        }
+    }
+    for (auto &b : module.buffers()) {
+        if (b.dim() == 4) {
+            b.set_data(b.contiguous(torch::MemoryFormat::ChannelsLast));
+        }
+    }
+}
+
+auto module_state_version(const torch::nn::Module &module) -> int64_t {
+    int64_t version = 0;
+    for (const auto &p : module.parameters()) {
+        version += static_cast<int64_t>(p._version());
+    }
+    for (const auto &b : module.buffers()) {
+        version += static_cast<int64_t>(b._version());
+    }
+    return version;
+}
+
+auto inference_dtype(bool use_bf16) -> torch::ScalarType {
+    return use_bf16 ? torch::kBFloat16 : torch::kFloat;
+}
+
 auto tensor_vec_sum(const std::vector<torch::Tensor> &tensors) -> torch::Tensor {
     assert(tensors.size() > 0);
     torch::Tensor tensor = tensors[0];
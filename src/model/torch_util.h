@@ -4,6 +4,16 @@
 #ifndef HPTS_TORCH_UTIL_H_
 #define HPTS_TORCH_UTIL_H_
 
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <span>
+#include <stdexcept>
 #include <vector>
 
 // NOLINTBEGIN
@@ -23,6 +33,204 @@ auto tensor_to_vec(torch::Tensor x) -> std::vector<T> {
                           x.data_ptr<T>() + x.numel());    // NOLINT (*-pointer-arithmetic)
 }
 
+/**
+ * Pack the observations of a batch into a contiguous staging buffer, and wrap it as a single tensor
+ * @note The returned tensor aliases the staging buffer, so is only valid until the buffer is next modified
+ * @param batch Batch of items holding an observation member
+ * @param flat_size The flat size of each observation
+ * @param staging Reusable staging buffer, resized to fit the batch
+ * @return Tensor of observations -> [batch_size, flat_size]
+ */
+template <typename T>
+auto observations_to_tensor(const std::vector<T> &batch, int flat_size, std::vector<float> &staging) -> torch::Tensor {
+    const auto row_size = static_cast<std::size_t>(flat_size);
+    staging.resize(batch.size() * row_size);
+    float *dst = staging.data();
+    for (const auto &batch_item : batch) {
+        assert(batch_item.observation.size() == row_size);
+        std::memcpy(dst, batch_item.observation.data(), row_size * sizeof(float));
+        dst += row_size;    // NOLINT (*-pointer-arithmetic)
+    }
+    // torch::from_blob requires a pointer to non-const and doesn't take ownership
+    return torch::from_blob(staging.data(), {static_cast<int64_t>(batch.size()), flat_size},
+                            torch::TensorOptions().dtype(torch::kFloat));
+}
+
+/**
+ * Pack the observations of a batch cell major into a contiguous staging buffer, and wrap it as a single tensor in the
+ * channels-last layout, so convolutions over channels-last weights read it without another layout conversion
+ * @note The returned tensor aliases the staging buffer, so is only valid until the buffer is next modified
+ * @param batch Batch of items holding an observation member of channel major planes
+ * @param channels The number of channels of each observation
+ * @param height The height of each observation
+ * @param width The width of each observation
+ * @param staging Reusable staging buffer, resized to fit the batch
+ * @return Channels-last tensor of observations -> [batch_size, channels, height, width]
+ */
+template <typename T>
+auto observations_to_channels_last_tensor(const std::vector<T> &batch, int channels, int height, int width,
+                                          std::vector<float> &staging) -> torch::Tensor {
+    const auto num_channels = static_cast<std::size_t>(channels);
+    const auto cells = static_cast<std::size_t>(height) * static_cast<std::size_t>(width);
+    const std::size_t row_size = num_channels * cells;
+    staging.resize(batch.size() * row_size);
+    float *dst = staging.data();
+    for (const auto &batch_item : batch) {
+        assert(batch_item.observation.size() == row_size);
+        const float *src = batch_item.observation.data();
+        for (std::size_t c = 0; c < num_channels; ++c) {
+            for (std::size_t cell = 0; cell < cells; ++cell) {
+                dst[cell * num_channels + c] = src[c * cells + cell];    // NOLINT (*-pointer-arithmetic)
+            }
+        }
+        dst += row_size;    // NOLINT (*-pointer-arithmetic)
+    }
+    return torch::from_blob(staging.data(), {static_cast<int64_t>(batch.size()), height, width, channels},
+                            torch::TensorOptions().dtype(torch::kFloat))
+        .permute({0, 3, 1, 2});
+}
+
+/**
+ * Pack the observations of a batch as the indices of the active channels of each cell, rather than the dense channel
+ * planes, which shrinks the host to device transfer by a factor of channels / num_planes * 4.
+ * Cells use one plane per active channel, and the remaining planes are set to channels to mark no active channel.
+ * Only binary observations can be packed, as the active channel indices can't hold the value of a channel.
+ * @note The returned tensor aliases the staging buffer, so is only valid until the buffer is next modified
+ * @param batch Batch of items holding an observation member of channel major planes
+ * @param channels The number of channels of each observation
+ * @param num_planes The maximum number of active channels in a single cell
+ * @param staging Reusable staging buffer, resized to fit the batch
+ * @return Tensor of active channel indices -> [batch_size, num_planes * cells]
+ * @throw std::invalid_argument if there are too many channels, an observation value is not 0 or 1, or a cell has more
+ *        than num_planes active channels
+ */
+template <typename T>
+auto observations_to_index_tensor(const std::vector<T> &batch, int channels, int num_planes,
+                                  std::vector<uint8_t> &staging) -> torch::Tensor {
+    if (channels >= std::numeric_limits<uint8_t>::max()) {
+        SPDLOG_ERROR("Sparse observations support at most {:d} channels, given {:d}.",
+                     std::numeric_limits<uint8_t>::max() - 1, channels);
+        throw std::invalid_argument("Sparse observations have too many channels.");
+    }
+    const auto num_channels = static_cast<std::size_t>(channels);
+    const auto planes = static_cast<std::size_t>(num_planes);
+    const std::size_t cells = batch.empty() ? 0 : batch[0].observation.size() / num_channels;
+    const std::size_t row_size = planes * cells;
+    staging.assign(batch.size() * row_size, static_cast<uint8_t>(channels));
+    std::vector<uint8_t> active_count(cells);
+    uint8_t *dst = staging.data();
+    for (const auto &batch_item : batch) {
+        assert(batch_item.observation.size() == num_channels * cells);
+        std::fill(active_count.begin(), active_count.end(), 0);
+        for (std::size_t c = 0; c < num_channels; ++c) {
+            for (std::size_t cell = 0; cell < cells; ++cell) {
+                const auto value = batch_item.observation[c * cells + cell];
+                if (value == 0) {
+                    continue;
+                }
+                // Thrown rather than exiting, as this runs on the evaluator thread which hands errors to the searches
+                if (value != 1) {
+                    SPDLOG_ERROR("Observation channel {:d} of cell {:d} has non-binary value {}.", c, cell, value);
+                    throw std::invalid_argument("Sparse observations must be binary.");
+                }
+                if (active_count[cell] == num_planes) {
+                    SPDLOG_ERROR("Observation cell {:d} has more than {:d} active channels.", cell, num_planes);
+                    throw std::invalid_argument("Sparse observation cell has more active channels than planes.");
+                }
+                dst[active_count[cell]++ * cells + cell] = static_cast<uint8_t>(c);    // NOLINT (*-pointer-arithmetic)
+            }
+        }
+        dst += row_size;    // NOLINT (*-pointer-arithmetic)
+    }
+    return torch::from_blob(staging.data(), {static_cast<int64_t>(batch.size()), static_cast<int64_t>(row_size)},
+                            torch::TensorOptions().dtype(torch::kByte));
+}
+
+/**
+ * Convert a batched network head output into a contiguous CPU float buffer
+ * @param x The batched output tensor
+ * @return Contiguous CPU float tensor with the same values
+ */
+auto to_cpu_float(const torch::Tensor &x) -> torch::Tensor;
+
+/**
+ * Get a view of a single row of a contiguous 2D CPU float tensor
+ * @note The view does not own the data, the tensor needs to be kept alive (see make_batch_storage)
+ * @param x The contiguous CPU float tensor -> [batch_size, N]
+ * @param row The row index
+ * @return Span over the N values of the row
+ */
+auto tensor_row_view(const torch::Tensor &x, int64_t row) -> std::span<const float>;
+
+/**
+ * Keep the given tensors alive behind a single type-erased handle, which is shared by all row views of a batch
+ * @param tensors The tensors the row views point into
+ * @return Shared handle owning the tensors
+ */
+auto make_batch_storage(std::vector<torch::Tensor> tensors) -> std::shared_ptr<const void>;
+
+/**
+ * Get the number of observations of each batch item, for inputs holding a variable number of observations
+ * @param batch The batch items, each with a vector of observations
+ * @return Number of observations (i.e. actions or subgoals) of each batch item
+ */
+template <typename T>
+auto observation_counts(const std::vector<T> &batch) -> std::vector<int64_t> {
+    std::vector<int64_t> counts;
+    counts.reserve(batch.size());
+    for (const auto &batch_item : batch) {
+        counts.push_back(static_cast<int64_t>(batch_item.observations.size()));
+    }
+    return counts;
+}
+
+/**
+ * Get the mask of valid entries when variable length segments are padded to a common length
+ * @param lengths The length of each segment
+ * @param device The device to create the mask on
+ * @return Mask of valid entries -> [num_segments, max_length]
+ */
+auto segment_mask(const std::vector<int64_t> &lengths, const torch::Device &device) -> torch::Tensor;
+
+/**
+ * Scatter concatenated variable length segments into a padded tensor, so a (masked) softmax runs over all segments at
+ * once. Valid entries are recovered in their original order with padded.masked_select(mask).
+ * @param x Concatenated segments -> [N]
+ * @param mask Mask of valid entries from segment_mask -> [num_segments, max_length]
+ * @param pad_value Value of the padded entries, -inf masks them out of a softmax
+ * @return Padded segments -> [num_segments, max_length]
+ */
+auto pad_segments(const torch::Tensor &x, const torch::Tensor &mask, double pad_value) -> torch::Tensor;
+
+/**
+ * Copy all parameters and buffers of the source module into a destination module of the same structure
+ * @param src The module to copy from
+ * @param dst The module to copy into
+ */
+void copy_module_state(const torch::nn::Module &src, torch::nn::Module &dst);
+
+/**
+ * Convert the 4D parameters and buffers (i.e. convolution weights) of a module to the channels-last layout in place
+ * @param module The module to convert
+ */
+void to_channels_last(torch::nn::Module &module);
+
+/**
+ * Get a combined version of all parameters and buffers of a module, which changes on every in-place update of them
+ * (i.e. optimizer steps, or loading from a checkpoint)
+ * @param module The module to check
+ * @return The combined version counter
+ */
+auto module_state_version(const torch::nn::Module &module) -> int64_t;
+
+/**
+ * Get the dtype the inference copy of a network runs in
+ * @note The learning weights always stay in fp32, only the inference copy is ever cast down
+ * @param use_bf16 Whether to run inference in bfloat16
+ * @return The dtype to cast the inference copy and its inputs to
+ */
+auto inference_dtype(bool use_bf16) -> torch::ScalarType;
+
 /**
  * Sum a vector of tensors
  * @param tensors The vector of tensors
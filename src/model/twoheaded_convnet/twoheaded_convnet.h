@@ -8,13 +8,16 @@
 #include <torch/torch.h>
 // NOLINTEND
 
+#include <cstdint>
 #include <vector>
 
 #include "common/observation.h"
 #include "model/layers.h"
+#include "model/twoheaded_convnet/twoheaded_convnet_heads.h"
 
 namespace hpts::model::network {
 
+// Outputs which were not selected are undefined tensors
 struct TwoHeadedConvNetOutput {
     torch::Tensor logits;
     torch::Tensor policy;
@@ -35,11 +38,22 @@ public:
      * @param policy_mlp_layers Hidden layer sizes for the policy head MLP
      * @param heuristic_mlp_layers Hidden layer sizes for the heuristic head MLP
      * @param use_batchnorm Flag to use batchnorm in the resnet layers
+     * @param resnet_bottleneck_channels Channels between the convolutions of each resnet block, 0 for resnet_channels
+     * @param mlp_rank Rank the MLP layers are factored through, 0 for unfactored layers
      */
     TwoHeadedConvNetImpl(const ObservationShape &observation_shape, int num_actions, int resnet_channels, int resnet_blocks,
                          int policy_channels, int heuristic_channels, const std::vector<int> &policy_mlp_layers,
-                         const std::vector<int> &heuristic_mlp_layers, bool use_batchnorm);
-    [[nodiscard]] auto forward(torch::Tensor x) -> TwoHeadedConvNetOutput;
+                         const std::vector<int> &heuristic_mlp_layers, bool use_batchnorm, int resnet_bottleneck_channels = 0,
+                         int mlp_rank = 0);
+    /**
+     * @param x Input observations -> [batch_size, c, h, w]
+     * @param heads Bit mask of TwoHeadedConvNetHeads to compute, the logits are kept whenever the policy head is run
+     */
+    [[nodiscard]] auto forward(torch::Tensor x, uint8_t heads = TwoHeadedConvNetHeads::ALL) -> TwoHeadedConvNetOutput;
+    // Fold batchnorm into the resnet convolutions, only to be used on an eval-only copy of the network
+    void fuse_batchnorm();
+    // Copy the weights of an uncompressed network of the same sizes, pruning the resnet blocks and factoring the MLPs
+    void compress_from(const TwoHeadedConvNetImpl &src);
 
 private:
     int input_channels_;
@@ -56,9 +70,48 @@ private:
     MLP policy_mlp_;
     MLP heuristic_mlp_;
     torch::nn::ModuleList resnet_layers_;
+    friend class GroupedTwoHeadedConvNetImpl;
 };
 TORCH_MODULE(TwoHeadedConvNet);
 
+class GroupedTwoHeadedConvNetImpl : public torch::nn::Module {
+public:
+    /**
+     * Independent heuristic + policy convnets of the same architecture (i.e. one per subgoal) run side by side in a
+     * single pass, using grouped convolutions. Only used for inference, groups are copied from batchnorm folded networks.
+     * @param observation_shape Input observation shape to each network
+     * @param num_actions Number of actions for the policy output
+     * @param resnet_channels Number of channels for each resenet block
+     * @param resnet_blocks Number of resnet blocks
+     * @param policy_channels Number of channels in the policy reduce head
+     * @param heuristic_channels Number of channels in the heuristic reduce head
+     * @param policy_mlp_layers Hidden layer sizes for the policy head MLP
+     * @param heuristic_mlp_layers Hidden layer sizes for the heuristic head MLP
+     * @param num_groups Number of networks
+     */
+    GroupedTwoHeadedConvNetImpl(const ObservationShape &observation_shape, int num_actions, int resnet_channels,
+                                int resnet_blocks, int policy_channels, int heuristic_channels,
+                                const std::vector<int> &policy_mlp_layers, const std::vector<int> &heuristic_mlp_layers,
+                                int num_groups);
+    // Input -> [batch_size, num_groups * c, h, w], outputs -> [batch_size, num_groups, num_actions | 1]
+    [[nodiscard]] auto forward(torch::Tensor x) -> TwoHeadedConvNetOutput;
+    // Copy a batchnorm folded network into the given group
+    void copy_group(int group, const TwoHeadedConvNetImpl &model);
+
+private:
+    int num_groups_;
+    int num_actions_;
+    int policy_mlp_input_size_;
+    int heuristic_mlp_input_size_;
+    ResidualHead resnet_head_;
+    torch::nn::Conv2d conv1x1_policy_;
+    torch::nn::Conv2d conv1x1_heuristic_;
+    GroupedMLP policy_mlp_;
+    GroupedMLP heuristic_mlp_;
+    torch::nn::ModuleList resnet_layers_;
+};
+TORCH_MODULE(GroupedTwoHeadedConvNet);
+
 }    // namespace hpts::model::network
 
 #endif    // HPTS_MODEL_TWOHEADED_CONVNET_H_
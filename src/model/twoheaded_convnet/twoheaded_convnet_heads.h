@@ -0,0 +1,23 @@
+// File: twoheaded_convnet_heads.h
+// Description: Head selection mask of the twoheaded convnet, kept free of torch so non-model code can use it
+
+#ifndef HPTS_MODEL_TWOHEADED_CONVNET_HEADS_H_
+#define HPTS_MODEL_TWOHEADED_CONVNET_HEADS_H_
+
+#include <cstdint>
+
+namespace hpts::model::network {
+
+// Outputs of the network, combined as a bit mask to select which are computed in a forward pass
+struct TwoHeadedConvNetHeads {
+    constexpr static uint8_t LOGITS = 1 << 0;
+    constexpr static uint8_t POLICY = 1 << 1;
+    constexpr static uint8_t LOG_POLICY = 1 << 2;
+    constexpr static uint8_t HEURISTIC = 1 << 3;
+    constexpr static uint8_t POLICY_HEAD = LOGITS | POLICY | LOG_POLICY;
+    constexpr static uint8_t ALL = POLICY_HEAD | HEURISTIC;
+};
+
+}    // namespace hpts::model::network
+
+#endif    // HPTS_MODEL_TWOHEADED_CONVNET_HEADS_H_
@@ -4,6 +4,11 @@
 #ifndef HPTS_WRAPPER_TWOHEADED_CONVNET_H_
 #define HPTS_WRAPPER_TWOHEADED_CONVNET_H_
 
+#include <atomic>
+#include <memory>
+#include <span>
+#include <vector>
+
 #include "common/observation.h"
 #include "model/base_model_wrapper.h"
 #include "model/twoheaded_convnet/twoheaded_convnet.h"
@@ -21,11 +26,16 @@ struct TwoHeadedConvNetConfig {
     std::vector<int> policy_mlp_layers;
     std::vector<int> heuristic_mlp_layers;
     bool use_batchnorm;
+    bool inference_bf16 = false;           // Run the inference copy in bfloat16, learning stays in fp32
+    int sparse_input_planes = 0;           // Pack inference inputs as this many active channel index planes, 0 for dense
+    int resnet_bottleneck_channels = 0;    // Pruned channels between the resnet block convolutions, 0 for resnet_channels
+    int mlp_rank = 0;                      // Rank of the factored MLP layers, 0 for unfactored
 };
 
 constexpr std::string LevinLoss = "levin";
 constexpr std::string PolicyGradientLoss = "policy_gradient";
 constexpr std::string PHSLoss = "phs";
+constexpr std::string DistillLoss = "distill";
 
 // template <TwoHeadedConvNetLossType LossType>
 class TwoHeadedConvNetWrapperBase : public BaseModelWrapper {
@@ -34,16 +44,21 @@ public:
     constexpr static std::string LevinLoss = "levin";
     constexpr static std::string PolicyGradientLoss = "policy_gradient";
     constexpr static std::string PHSLoss = "phs";
+    constexpr static std::string DistillLoss = "distill";
 
     struct InferenceInput {
         Observation observation;
+        uint8_t heads = network::TwoHeadedConvNetHeads::ALL;    // Outputs needed by the caller
     };
 
+    // Row views into the contiguous per-head CPU buffers of the batched forward pass
+    // Outputs not requested by any input of the batch are left empty
     struct InferenceOutput {
-        std::vector<double> logits;
-        std::vector<double> policy;
-        std::vector<double> log_policy;
+        std::span<const float> logits;
+        std::span<const float> policy;
+        std::span<const float> log_policy;
         double heuristic = 0;
+        std::shared_ptr<const void> batch_storage;    // Keeps the batch buffers the views point into alive
     };
 
     TwoHeadedConvNetWrapperBase(const TwoHeadedConvNetConfig& config, double learning_rate, double l2_weight_decay,
@@ -60,19 +75,35 @@ public:
     void LoadCheckpoint(const std::string& path) override;
     void LoadCheckpointWithoutOptimizer(const std::string& path) override;
 
+    [[nodiscard]] auto Modules() -> std::vector<std::shared_ptr<torch::nn::Module>> override;
+
+    /**
+     * Initialize from the weights of an uncompressed model of the same sizes, pruning the resnet blocks to
+     * config.resnet_bottleneck_channels and factoring the MLP layers through config.mlp_rank
+     * @param src The model to compress
+     */
+    void CompressFrom(const TwoHeadedConvNetWrapperBase& src);
+
     /**
-     * Perform inference
+     * Perform inference, only computing the heads requested by some input of the batch
      * @param inputs Batched observations (implementation defined)
      * @returns Implementation defined output
      */
     [[nodiscard]] auto Inference(std::vector<InferenceInput>& batch) -> std::vector<InferenceOutput>;
 
 protected:
+    // Rebuild the eval-only inference copy from the current weights if they changed since it was last built
+    void UpdateInferenceModel();
+
     // NOLINTBEGIN(*-non-private-member-variables-in-classes)
     network::TwoHeadedConvNet model_;
     torch::optim::Adam model_optimizer_;
     TwoHeadedConvNetConfig config;
     int input_flat_size;
+    std::vector<float> inference_staging_;                  // Reused contiguous buffer for batched inference observations
+    std::vector<uint8_t> inference_index_staging_;          // Reused buffer for sparse inference observations
+    network::TwoHeadedConvNet inference_model_{nullptr};    // Eval-only copy with batchnorm folded, used for inference
+    std::atomic<int64_t> inference_model_version_{-1};      // Weight version the inference copy was built from
     // NOLINTEND(*-non-private-member-variables-in-classes)
 };
 
@@ -82,7 +113,7 @@ class TwoHeadedConvNetWrapperLevin : public TwoHeadedConvNetWrapperBase {
 public:
     using BaseType = TwoHeadedConvNetWrapperBase;
     struct LearningInput {
-        Observation observation;
+        PackedObservation observation;
         int target_action = -1;
         double target_cost_to_goal = 0;
         int solution_expanded;
@@ -96,7 +127,7 @@ class TwoHeadedConvNetWrapperPolicyGradient : public TwoHeadedConvNetWrapperBase
 public:
     using BaseType = TwoHeadedConvNetWrapperBase;
     struct LearningInput {
-        Observation observation;
+        PackedObservation observation;
         int target_action = -1;
         double target_cost_to_goal = 0;
         double reward = 0;
@@ -110,7 +141,7 @@ class TwoHeadedConvNetWrapperPHS : public TwoHeadedConvNetWrapperBase {
 public:
     using BaseType = TwoHeadedConvNetWrapperBase;
     struct LearningInput {
-        Observation observation;
+        PackedObservation observation;
         int target_action = -1;
         double target_cost_to_goal = 0;
         double solution_cost = 0;
@@ -122,6 +153,20 @@ public:
     auto Learn(std::vector<LearningInput>& batch) -> double;
 };
 
+// Student trained against the soft policy and heuristic targets of a teacher network
+class TwoHeadedConvNetWrapperDistill : public TwoHeadedConvNetWrapperBase {
+public:
+    using BaseType = TwoHeadedConvNetWrapperBase;
+    struct LearningInput {
+        PackedObservation observation;
+        std::vector<float> target_policy;
+        double target_cost_to_goal = 0;
+    };
+
+    using TwoHeadedConvNetWrapperBase::TwoHeadedConvNetWrapperBase;
+    auto Learn(std::vector<LearningInput>& batch) -> double;
+};
+
 }    // namespace hpts::model::wrapper
 
 #endif    // HPTS_WRAPPER_TWOHEADED_CONVNET_H_
@@ -43,9 +43,22 @@ void declare_observation_shape(py::module &m) {
         .def_readwrite("w", &ObservationShape::w);
 }
 
+void declare_packed_observation(py::module &m) {
+    py::class_<PackedObservation>(m, "PackedObservation")
+        .def(py::init<const Observation &>())
+        .def("__copy__", [](const PackedObservation &self) { return PackedObservation(self); })
+        .def("__deepcopy__", [](const PackedObservation &self, py::dict) { return PackedObservation(self); })
+        .def("__len__", &PackedObservation::size)
+        .def("unpack", py::overload_cast<>(&PackedObservation::unpack, py::const_))
+        .def("is_packed", &PackedObservation::is_packed);
+    // Plain observation lists can be passed wherever a packed observation is stored
+    py::implicitly_convertible<Observation, PackedObservation>();
+}
+
 void declare_common(py::module &m) {
     declare_load_problems(m);
     declare_observation_shape(m);
+    declare_packed_observation(m);
 }
 
 }    // namespace hpts::bindings
@@ -0,0 +1,31 @@
+// File: inference_output.h
+// Python binding helpers for inference outputs which hold row views into batched storage
+
+#ifndef HPTS_PYTHON_MODEL_INFERENCE_OUTPUT_H_
+#define HPTS_PYTHON_MODEL_INFERENCE_OUTPUT_H_
+
+#include <array>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace hpts::bindings {
+
+// Owning storage for inference outputs constructed from python, with one buffer per head
+using OutputStorage = std::array<std::vector<float>, 3>;
+
+inline auto make_output_storage(const std::vector<double> &logits, const std::vector<double> &policy,
+                                const std::vector<double> &log_policy) -> std::shared_ptr<const OutputStorage> {
+    return std::make_shared<const OutputStorage>(OutputStorage{std::vector<float>(logits.begin(), logits.end()),
+                                                               std::vector<float>(policy.begin(), policy.end()),
+                                                               std::vector<float>(log_policy.begin(), log_policy.end())});
+}
+
+// Copy a row view out so python gets an owning list
+inline auto to_vec(std::span<const float> values) -> std::vector<double> {
+    return {values.begin(), values.end()};
+}
+
+}    // namespace hpts::bindings
+
+#endif    // HPTS_PYTHON_MODEL_INFERENCE_OUTPUT_H_
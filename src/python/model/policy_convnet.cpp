@@ -12,6 +12,7 @@
 #include "model/device_manager.h"
 #include "model/model_evaluator.h"
 #include "model/policy_convnet/policy_convnet_wrapper.h"
+#include "python/model/inference_output.h"
 
 namespace py = pybind11;
 
@@ -43,7 +44,11 @@ void declare_model_evaluator_policy_convnet(py::module &m) {
         .def_readwrite("resnet_blocks", &PolicyConvNetConfig::resnet_blocks)
         .def_readwrite("policy_channels", &PolicyConvNetConfig::policy_channels)
         .def_readwrite("policy_mlp_layers", &PolicyConvNetConfig::policy_mlp_layers)
-        .def_readwrite("use_batchnorm", &PolicyConvNetConfig::use_batchnorm);
+        .def_readwrite("use_batchnorm", &PolicyConvNetConfig::use_batchnorm)
+        .def_readwrite("inference_bf16", &PolicyConvNetConfig::inference_bf16)
+        .def_readwrite("sparse_input_planes", &PolicyConvNetConfig::sparse_input_planes)
+        .def_readwrite("resnet_bottleneck_channels", &PolicyConvNetConfig::resnet_bottleneck_channels)
+        .def_readwrite("mlp_rank", &PolicyConvNetConfig::mlp_rank);
 
     // Inference Input
     using InferenceInput = PolicyConvNetWrapperLevin::InferenceInput;
@@ -56,12 +61,16 @@ void declare_model_evaluator_policy_convnet(py::module &m) {
     // Inference Output
     using InferenceOutput = PolicyConvNetWrapperLevin::InferenceOutput;
     py::class_<InferenceOutput>(m, "PolicyConvNetInferenceOutput")
-        .def(py::init<const std::vector<double> &, const std::vector<double> &, const std::vector<double> &>())
+        .def(py::init([](const std::vector<double> &logits, const std::vector<double> &policy,
+                         const std::vector<double> &log_policy) {
+            const auto storage = make_output_storage(logits, policy, log_policy);
+            return InferenceOutput{(*storage)[0], (*storage)[1], (*storage)[2], storage};
+        }))
         .def("__copy__", [](const InferenceOutput &self) { return InferenceOutput(self); })
         .def("__deepcopy__", [](const InferenceOutput &self, py::dict) { return InferenceOutput(self); })
-        .def_readwrite("logits", &InferenceOutput::logits)
-        .def_readwrite("policy", &InferenceOutput::policy)
-        .def_readwrite("log_policy", &InferenceOutput::log_policy);
+        .def_property_readonly("logits", [](const InferenceOutput &self) { return to_vec(self.logits); })
+        .def_property_readonly("policy", [](const InferenceOutput &self) { return to_vec(self.policy); })
+        .def_property_readonly("log_policy", [](const InferenceOutput &self) { return to_vec(self.log_policy); });
 
     // Learning Input
     using LearningInput = PolicyConvNetWrapperLevin::LearningInput;
@@ -90,7 +99,8 @@ void declare_model_evaluator_policy_convnet(py::module &m) {
         .def("checkpoint_and_sync", &EvaluatorT::checkpoint_and_sync)
         .def("checkpoint_and_sync_without_optimizer", &EvaluatorT::checkpoint_and_sync_without_optimizer)
         .def("save_checkpoint", &EvaluatorT::save_checkpoint)
-        .def("save_checkpoint_without_optimizer", &EvaluatorT::save_checkpoint_without_optimizer);
+        .def("save_checkpoint_without_optimizer", &EvaluatorT::save_checkpoint_without_optimizer)
+        .def("flush_checkpoints", &EvaluatorT::flush_checkpoints);
 }
 
 }    // namespace hpts::bindings
@@ -12,6 +12,7 @@
 #include "model/device_manager.h"
 #include "model/model_evaluator.h"
 #include "model/twoheaded_convnet/twoheaded_convnet_wrapper.h"
+#include "python/model/inference_output.h"
 
 namespace py = pybind11;
 
@@ -46,7 +47,11 @@ void declare_model_evaluator_twoheaded_convnet(py::module &m) {
         .def_readwrite("heuristic_channels", &TwoHeadedConvNetConfig::heuristic_channels)
         .def_readwrite("policy_mlp_layers", &TwoHeadedConvNetConfig::policy_mlp_layers)
         .def_readwrite("heuristic_mlp_layers", &TwoHeadedConvNetConfig::heuristic_mlp_layers)
-        .def_readwrite("use_batchnorm", &TwoHeadedConvNetConfig::use_batchnorm);
+        .def_readwrite("use_batchnorm", &TwoHeadedConvNetConfig::use_batchnorm)
+        .def_readwrite("inference_bf16", &TwoHeadedConvNetConfig::inference_bf16)
+        .def_readwrite("sparse_input_planes", &TwoHeadedConvNetConfig::sparse_input_planes)
+        .def_readwrite("resnet_bottleneck_channels", &TwoHeadedConvNetConfig::resnet_bottleneck_channels)
+        .def_readwrite("mlp_rank", &TwoHeadedConvNetConfig::mlp_rank);
 
     // Inference Input
     using InferenceInput = TwoHeadedConvNetWrapperLevin::InferenceInput;
@@ -54,17 +59,22 @@ void declare_model_evaluator_twoheaded_convnet(py::module &m) {
         .def(py::init<const Observation &>())
         .def("__copy__", [](const InferenceInput &self) { return InferenceInput(self); })
         .def("__deepcopy__", [](const InferenceInput &self, py::dict) { return InferenceInput(self); })
-        .def_readwrite("observation", &InferenceInput::observation);
+        .def_readwrite("observation", &InferenceInput::observation)
+        .def_readwrite("heads", &InferenceInput::heads);
 
     // Inference Output
     using InferenceOutput = TwoHeadedConvNetWrapperLevin::InferenceOutput;
     py::class_<InferenceOutput>(m, "TwoHeadedConvNetInferenceOutput")
-        .def(py::init<const std::vector<double> &, const std::vector<double> &, const std::vector<double> &, double>())
+        .def(py::init([](const std::vector<double> &logits, const std::vector<double> &policy,
+                         const std::vector<double> &log_policy, double heuristic) {
+            const auto storage = make_output_storage(logits, policy, log_policy);
+            return InferenceOutput{(*storage)[0], (*storage)[1], (*storage)[2], heuristic, storage};
+        }))
         .def("__copy__", [](const InferenceOutput &self) { return InferenceOutput(self); })
         .def("__deepcopy__", [](const InferenceOutput &self, py::dict) { return InferenceOutput(self); })
-        .def_readwrite("logits", &InferenceOutput::logits)
-        .def_readwrite("policy", &InferenceOutput::policy)
-        .def_readwrite("log_policy", &InferenceOutput::log_policy)
+        .def_property_readonly("logits", [](const InferenceOutput &self) { return to_vec(self.logits); })
+        .def_property_readonly("policy", [](const InferenceOutput &self) { return to_vec(self.policy); })
+        .def_property_readonly("log_policy", [](const InferenceOutput &self) { return to_vec(self.log_policy); })
         .def_readwrite("heuristic", &InferenceOutput::heuristic);
 
     // Learning Input
@@ -95,7 +105,8 @@ void declare_model_evaluator_twoheaded_convnet(py::module &m) {
         .def("checkpoint_and_sync", &EvaluatorT::checkpoint_and_sync)
         .def("checkpoint_and_sync_without_optimizer", &EvaluatorT::checkpoint_and_sync_without_optimizer)
         .def("save_checkpoint", &EvaluatorT::save_checkpoint)
-        .def("save_checkpoint_without_optimizer", &EvaluatorT::save_checkpoint_without_optimizer);
+        .def("save_checkpoint_without_optimizer", &EvaluatorT::save_checkpoint_without_optimizer)
+        .def("flush_checkpoints", &EvaluatorT::flush_checkpoints);
 }
 
 }    // namespace hpts::bindings
@@ -5,8 +5,10 @@
 #define HPTS_UTIL_CONCEPTS_H_
 
 #include <concepts>
+#include <cstdint>
 #include <functional>
 #include <random>
+#include <ranges>
 #include <tuple>
 #include <type_traits>
 #include <variant>
@@ -97,10 +99,20 @@ concept HasHeuristic = requires(T t) {
 
 /**
  * Concept to check if a type has a policy
+ * The policy can either be owned (std::vector) or a view into batched storage (std::span)
  */
 template <typename T>
 concept HasPolicy = requires(T t) {
-    { t.policy } -> std::same_as<std::vector<double> &>;
+    requires std::ranges::sized_range<decltype(t.policy)>;
+    requires std::convertible_to<std::ranges::range_value_t<decltype(t.policy)>, double>;
+};
+
+/**
+ * Concept to check if a type selects which network heads are computed for it
+ */
+template <typename T>
+concept HasHeadMask = requires(T t) {
+    { t.heads } -> std::same_as<uint8_t &>;
 };
 
 /**
@@ -0,0 +1,84 @@
+// File: cpu_affinity.cpp
+// Description: Core lists and pinning of threads to cores, to keep search and inference threads on disjoint cores
+#include "util/cpu_affinity.h"
+
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_split.h>
+#include <absl/strings/string_view.h>
+#include <pthread.h>
+#include <sched.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+
+namespace hpts::cpu_affinity {
+
+static std::mutex search_cores_mutex;    // NOLINT
+static std::vector<int> search_cores;    // NOLINT
+
+namespace {
+auto parse_core(absl::string_view core_str, const std::string &core_list) -> int {
+    int core = 0;
+    if (!absl::SimpleAtoi(core_str, &core) || core < 0 || core >= CPU_SETSIZE) {
+        SPDLOG_ERROR("Invalid core {:s} in core list {:s}.", std::string(core_str), core_list);
+        std::exit(1);
+    }
+    return core;
+}
+}    // namespace
+
+auto parse_core_list(const std::string &core_list) -> std::vector<int> {
+    std::vector<int> cores;
+    for (const absl::string_view range : absl::StrSplit(core_list, ',', absl::SkipEmpty())) {
+        const std::vector<absl::string_view> bounds = absl::StrSplit(range, '-');
+        if (bounds.size() > 2) {
+            SPDLOG_ERROR("Invalid core range {:s} in core list {:s}.", std::string(range), core_list);
+            std::exit(1);
+        }
+        const int first = parse_core(bounds.front(), core_list);
+        const int last = parse_core(bounds.back(), core_list);
+        if (last < first) {
+            SPDLOG_ERROR("Invalid core range {:s} in core list {:s}.", std::string(range), core_list);
+            std::exit(1);
+        }
+        for (int core = first; core <= last; ++core) {
+            cores.push_back(core);
+        }
+    }
+    std::ranges::sort(cores);
+    const auto [first, last] = std::ranges::unique(cores);
+    cores.erase(first, last);
+    return cores;
+}
+
+void pin_thread(const std::vector<int> &cores) {
+    if (cores.empty()) {
+        return;
+    }
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (const auto &core : cores) {
+        CPU_SET(core, &cpu_set);
+    }
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set) != 0) {
+        SPDLOG_WARN("Unable to pin thread to {:d} cores starting at core {:d}.", cores.size(), cores.front());
+    }
+}
+
+void set_search_cores(const std::vector<int> &cores) {
+    std::lock_guard<std::mutex> lock(search_cores_mutex);
+    search_cores = cores;
+}
+
+void pin_search_thread() {
+    std::vector<int> cores;
+    {
+        std::lock_guard<std::mutex> lock(search_cores_mutex);
+        cores = search_cores;
+    }
+    pin_thread(cores);
+}
+
+}    // namespace hpts::cpu_affinity
@@ -0,0 +1,38 @@
+// File: cpu_affinity.h
+// Description: Core lists and pinning of threads to cores, to keep search and inference threads on disjoint cores
+
+#ifndef HPTS_UTIL_CPU_AFFINITY_H_
+#define HPTS_UTIL_CPU_AFFINITY_H_
+
+#include <string>
+#include <vector>
+
+namespace hpts::cpu_affinity {
+
+/**
+ * Parse a core list, i.e. 0-7,12,14-15
+ * @param core_list The core list, empty for no cores
+ * @return Sorted unique core ids
+ */
+auto parse_core_list(const std::string &core_list) -> std::vector<int>;
+
+/**
+ * Pin the calling thread to the given cores, threads it spawns afterwards (i.e. OpenMP workers) inherit the pinning
+ * @param cores The cores to pin to, empty leaves the thread unpinned
+ */
+void pin_thread(const std::vector<int> &cores);
+
+/**
+ * Set the cores search threads are pinned to, used by all thread pools started afterwards
+ * @param cores The cores to pin to, empty leaves search threads unpinned
+ */
+void set_search_cores(const std::vector<int> &cores);
+
+/**
+ * Pin the calling thread to the search cores, if set
+ */
+void pin_search_thread();
+
+}    // namespace hpts::cpu_affinity
+
+#endif    // HPTS_UTIL_CPU_AFFINITY_H_
@@ -21,6 +21,7 @@
 #include <absl/types/optional.h>
 
 #include <queue>
+#include <utility>
 
 namespace hpts {
 
@@ -38,21 +39,22 @@ public:
         return Push(value, absl::Now() + wait);
     }
     auto Push(const T& value, absl::Time deadline) noexcept -> bool {
-        absl::MutexLock lock(&m_);
-        if (block_new_values_) {
-            return false;
-        }
-        while ((int)q_.size() >= max_size_) {
-            if (absl::Now() > deadline || block_new_values_) {
-                return false;
-            }
-            cv_.WaitWithDeadline(&m_, deadline);
-        }
-        q_.push(value);
-        cv_.Signal();
-        return true;
+        return PushImpl(value, deadline);
+    }
+
+    // Add an element to the queue, moving it in. Allows for move-only element types.
+    auto Push(T&& value) noexcept -> bool {
+        return Push(std::move(value), absl::InfiniteDuration());
+    }
+    auto Push(T&& value, absl::Duration wait) noexcept -> bool {
+        return Push(std::move(value), absl::Now() + wait);
+    }
+    auto Push(T&& value, absl::Time deadline) noexcept -> bool {
+        return PushImpl(std::move(value), deadline);
     }
 
+    // Remove an element from the queue, waiting on the condition variable until one is available.
+    // Returns nullopt on deadline, or if the queue is empty and new values are blocked.
     auto Pop() noexcept -> absl::optional<T> {
         return Pop(absl::InfiniteDuration());
     }
@@ -67,9 +69,10 @@ public:
             }
             cv_.WaitWithDeadline(&m_, deadline);
         }
-        T val = q_.front();
+        T val = std::move(q_.front());
         q_.pop();
-        cv_.Signal();
+        // Pushers and poppers share the condition variable, so wake all to avoid waking the wrong kind of waiter
+        cv_.SignalAll();
         return val;
     }
 
@@ -98,6 +101,23 @@ public:
     }
 
 private:
+    template <typename U>
+    auto PushImpl(U&& value, absl::Time deadline) noexcept -> bool {
+        absl::MutexLock lock(&m_);
+        if (block_new_values_) {
+            return false;
+        }
+        while ((int)q_.size() >= max_size_) {
+            if (absl::Now() > deadline || block_new_values_) {
+                return false;
+            }
+            cv_.WaitWithDeadline(&m_, deadline);
+        }
+        q_.push(std::forward<U>(value));
+        cv_.SignalAll();
+        return true;
+    }
+
     bool block_new_values_ = false;
     int max_size_;
     std::queue<T> q_;
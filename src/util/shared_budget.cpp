@@ -0,0 +1,19 @@
+// File: shared_budget.cpp
+// Description: Expansion budget shared between threads searching the same problem
+
+#include "util/shared_budget.h"
+
+namespace hpts {
+
+SharedBudget::SharedBudget(int budget) noexcept : budget_(budget) {}
+
+auto SharedBudget::charge() noexcept -> bool {
+    const int used = used_.fetch_add(1, std::memory_order_relaxed) + 1;
+    return budget_ < 0 || used < budget_;
+}
+
+auto SharedBudget::used() const noexcept -> int {
+    return used_.load(std::memory_order_relaxed);
+}
+
+}    // namespace hpts
@@ -0,0 +1,34 @@
+// File: shared_budget.h
+// Description: Expansion budget shared between threads searching the same problem
+
+#ifndef HPTS_UTIL_SHARED_BUDGET_H_
+#define HPTS_UTIL_SHARED_BUDGET_H_
+
+#include <atomic>
+
+namespace hpts {
+
+class SharedBudget {
+public:
+    /**
+     * Create a budget which is jointly charged by all holders
+     * @param budget Total number of expansions allowed, negative for unlimited
+     */
+    explicit SharedBudget(int budget) noexcept;
+
+    /**
+     * Charge a single expansion against the budget
+     * @return True if the budget still allows further expansions after this charge
+     */
+    auto charge() noexcept -> bool;
+
+    [[nodiscard]] auto used() const noexcept -> int;
+
+private:
+    int budget_;
+    std::atomic<int> used_{0};
+};
+
+}    // namespace hpts
+
+#endif    // HPTS_UTIL_SHARED_BUDGET_H_
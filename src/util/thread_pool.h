@@ -14,6 +14,7 @@
 #include <thread>
 #include <vector>
 
+#include "util/cpu_affinity.h"
 #include "util/queue.h"
 #include "util/thread_mapper.h"
 
@@ -152,6 +153,7 @@ private:
         //     }
         // }
         thread_mapper::add(thread_idx);
+        cpu_affinity::pin_search_thread();
         while (true) {
             std::optional<QueueItemInput> item;
             {
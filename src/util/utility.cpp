@@ -105,6 +105,47 @@ auto log_policy_noise(std::vector<double> &&policy, double epsilon) -> std::vect
     return policy;
 }
 
+void log_policy_noise_batch(std::span<const double> policies, std::size_t num_actions, double epsilon,
+                            std::span<double> log_policies) {
+    assert(policies.size() == log_policies.size());
+    assert(num_actions > 0 && policies.size() % num_actions == 0);
+    const double scale = 1.0 - epsilon;
+    const double offset = (epsilon / static_cast<double>(num_actions)) + SMALL_E;
+    const std::size_t n = policies.size();
+    const double *__restrict in = policies.data();
+    double *__restrict out = log_policies.data();
+    // Mixing pass is pure arithmetic and vectorises, log pass is kept separate so it doesn't block the former
+    for (std::size_t i = 0; i < n; ++i) {
+        out[i] = (scale * in[i]) + offset;
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+        out[i] = std::log(out[i]);
+    }
+}
+
+void phs_cost_batch(std::span<const double> log_p, std::span<const double> g, std::span<const double> h,
+                    std::span<double> costs) {
+    assert(log_p.size() == g.size() && g.size() == h.size() && h.size() == costs.size());
+    const std::size_t n = costs.size();
+    const double *__restrict lp_in = log_p.data();
+    const double *__restrict g_in = g.data();
+    const double *__restrict h_in = h.data();
+    double *__restrict out = costs.data();
+    for (std::size_t i = 0; i < n; ++i) {
+        out[i] = std::max(h_in[i], 0.0) + g_in[i] + SMALL_E;
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+        out[i] = std::log(out[i]);
+    }
+    // Selects instead of branches so g = 0 doesn't break vectorisation
+    for (std::size_t i = 0; i < n; ++i) {
+        const double h_clipped = std::max(h_in[i], 0.0);
+        const double g_safe = (g_in[i] == 0) ? 1.0 : g_in[i];
+        const double cost = out[i] - (lp_in[i] * (1.0 + (h_clipped / g_safe)));
+        out[i] = (g_in[i] == 0) ? 0.0 : cost;
+    }
+}
+
 auto softmax(const std::vector<double> &values, double temperature) -> std::vector<double> {
     std::vector<double> new_values = values;
     for (double &v : new_values) {
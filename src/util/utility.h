@@ -7,7 +7,11 @@
 #include <spdlog/spdlog.h>
 
 #include <algorithm>
+#include <cmath>
+#include <concepts>
 #include <random>
+#include <ranges>
+#include <span>
 #include <sstream>
 #include <string>
 #include <utility>
@@ -98,6 +102,45 @@ auto log_policy_noise(const std::vector<double> &policy, double epsilon = 0) ->
 auto policy_noise(const std::vector<double> &policy, double epsilon = 0) -> std::vector<double>;
 // auto log_policy_noise(std::vector<double> &&policy, double epsilon = 0) -> std::vector<double>;
 
+/**
+ * Apply log + uniform mixture to a batch of policies, stored row-major in a single contiguous buffer.
+ * Loops are kept branch-free over contiguous memory so the compiler can vectorise them.
+ * @param policies The flattened batch of policies, num_actions entries per row
+ * @param num_actions Number of actions in each policy row
+ * @param epislon Amount of mixing with uniform policy, between 0 and 1.
+ * @param log_policies Preallocated output buffer of the same size as policies
+ */
+void log_policy_noise_batch(std::span<const double> policies, std::size_t num_actions, double epsilon,
+                            std::span<double> log_policies);
+
+/**
+ * Compute the PHS cost log(h + g) - log_p * (1 + h/g) for a batch of nodes in structure-of-arrays form.
+ * Negative heuristic values are clipped to 0, and nodes with g = 0 have a cost of 0.
+ * @param log_p The log path probabilities
+ * @param g The path costs
+ * @param h The heuristic values
+ * @param costs Preallocated output buffer of the same size as the inputs
+ */
+void phs_cost_batch(std::span<const double> log_p, std::span<const double> g, std::span<const double> h,
+                    std::span<double> costs);
+
+/**
+ * Compute the entropy (in nats) of a policy
+ * The policy can either be owned (i.e. std::vector<double>) or a view into batched storage (i.e. std::span<const float>)
+ * @param policy The action probabilities
+ * @return The entropy, 0 for a one-hot policy up to log(num_actions) for a uniform policy
+ */
+template <std::ranges::sized_range R>
+    requires std::convertible_to<std::ranges::range_value_t<R>, double>
+auto policy_entropy(const R &policy) -> double {
+    double entropy = 0;
+    for (const auto &value : policy) {
+        const auto p = static_cast<double>(value);
+        entropy -= (p > 0) ? p * std::log(p) : 0.0;
+    }
+    return entropy;
+}
+
 /**
  * Apply softmax to vector of values
  * @param values The values